@@ -2,16 +2,29 @@
 #include <cassert>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include <unistd.h>
+
 #include <omp.h>
 
+#include "a2_io.h"
 #include "a2_kernels.h"
+#include "a2_ooc.h"
+#include "a2_threads.h"
 #include "a2_utils.h"
+#include "a2_verify.h"
 
 static std::string get_arg(int argc, char** argv, const std::string& key, const std::string& def="") {
   for (int i = 1; i + 1 < argc; i++) {
@@ -30,41 +43,408 @@ static double get_arg_f(int argc, char** argv, const std::string& key, double de
   return std::atof(s.c_str());
 }
 
+// Low-precision runs: the f32 inputs are converted to storage type T once,
+// outside the timed region, then the T overload of the kernel is timed. The
+// conversion time is returned and added to conv_seconds, whatever the dtype.
+static void store_as(const float* s, bf16_t* d, size_t n) { convert_f32(s, d, n); }
+static void store_as(const float* s, fp16_t* d, size_t n) { convert_f32(s, d, n); }
+static void store_as(const float* s, int8_t* d, size_t n) { quantize_i8(s, d, n, 127.0f); }
+
+// The kernels overwrite C, so reps need no clearing. For i8 with AVX2, B is
+// packed into the dot-product layout once as well and the packed overload
+// is timed; the packing time is part of the returned conversion time.
+template <typename T, typename Acc>
+static double bench_gemm_lp(const AlignedBuffer& A32, const AlignedBuffer& B32, int m, int k, int n,
+                            int tileM, int tileK, int tileN, bool simd, const RepPolicy& pol,
+                            int reps, PerfSession& perf, std::vector<RepSample>& samples) {
+  AlignedBufferT<T> A = make_aligned<T>(A32.count, 64);
+  AlignedBufferT<T> B = make_aligned<T>(B32.count, 64);
+  AlignedBufferT<Acc> C = make_aligned<Acc>((size_t)m * (size_t)n, 64);
+  first_touch(A.ptr, A.count * sizeof(T));
+  first_touch(B.ptr, B.count * sizeof(T));
+  first_touch(C.ptr, C.count * sizeof(Acc));
+  const double t0 = now_seconds();
+  store_as(A32.ptr, A.ptr, A.count);
+  store_as(B32.ptr, B.ptr, B.count);
+
+#if defined(__AVX2__)
+  PackedBI8 Bp;
+  if constexpr (std::is_same<T, int8_t>::value) {
+    if (simd) Bp = pack_b_i8(B.ptr, k, n);
+  }
+#endif
+  const double conv_seconds = now_seconds() - t0;
+
+  auto call = [&]() {
+#if defined(__AVX2__)
+    if constexpr (std::is_same<T, int8_t>::value) {
+      if (simd) gemm_tiled_avx2(A.ptr, Bp, C.ptr, m, tileM, tileK, tileN);
+      else      gemm_tiled_scalar(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN);
+    } else {
+      if (simd) gemm_tiled_avx2(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN);
+      else      gemm_tiled_scalar(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN);
+    }
+#else
+    (void)simd;
+    gemm_tiled_scalar(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN);
+#endif
+  };
+  run_reps(pol, reps, perf, samples, call, [](int) {});
+#if defined(__AVX2__)
+  if (Bp.data.ptr) free_packed_b_i8(Bp);
+#endif
+  free_aligned(A); free_aligned(B); free_aligned(C);
+  return conv_seconds;
+}
+
+template <typename T, typename Acc>
+static double bench_spmm_lp(const CSR& A, const AlignedBuffer& B32, int n, int jblock, bool simd,
+                            const RepPolicy& pol, int reps, PerfSession& perf,
+                            std::vector<RepSample>& samples) {
+  AlignedBufferT<T> vals = make_aligned<T>(A.values.size(), 64);
+  AlignedBufferT<T> B = make_aligned<T>(B32.count, 64);
+  AlignedBufferT<Acc> C = make_aligned<Acc>((size_t)A.m * (size_t)n, 64);
+  first_touch(B.ptr, B.count * sizeof(T));
+  first_touch(C.ptr, C.count * sizeof(Acc));
+  const double t0 = now_seconds();
+  store_as(A.values.data(), vals.ptr, vals.count);
+  store_as(B32.ptr, B.ptr, B.count);
+  const double conv_seconds = now_seconds() - t0;
+
+  auto call = [&]() {
+#if defined(__AVX2__)
+    if (simd) spmm_csr_avx2(A, vals.ptr, B.ptr, C.ptr, n, jblock);
+    else      spmm_csr_scalar(A, vals.ptr, B.ptr, C.ptr, n, jblock);
+#else
+    (void)simd;
+    spmm_csr_scalar(A, vals.ptr, B.ptr, C.ptr, n, jblock);
+#endif
+  };
+  run_reps(pol, reps, perf, samples, call, [](int) {});
+  free_aligned(vals); free_aligned(B); free_aligned(C);
+  return conv_seconds;
+}
+
+// Untimed check of --variant strassen against gemm_tiled on the same inputs
+// (plain C = A*B). Both errors are relative to max|A| * max|B|; the bound is
+// strassen_error_bound plus k u for the classic reference itself.
+static void strassen_check(const float* A, const float* B, int m, int k, int n, int cutoff,
+                           int tileM, int tileK, int tileN, GemmArena& arena,
+                           int& levels, double& err, double& bound) {
+  AlignedBuffer Cs = make_aligned_f32((size_t)m * n, 64);
+  AlignedBuffer Cc = make_aligned_f32((size_t)m * n, 64);
+#if defined(__AVX2__)
+  gemm_strassen_avx2(A, B, Cs.ptr, m, k, n, cutoff, tileM, tileK, tileN, arena);
+  gemm_tiled_avx2(A, B, Cc.ptr, m, k, n, tileM, tileK, tileN);
+#else
+  gemm_strassen_scalar(A, B, Cs.ptr, m, k, n, cutoff, tileM, tileK, tileN, arena);
+  gemm_tiled_scalar(A, B, Cc.ptr, m, k, n, tileM, tileK, tileN);
+#endif
+  double amax = 0.0, bmax = 0.0, d = 0.0;
+  for (size_t i = 0; i < (size_t)m * k; i++) amax = std::max(amax, (double)std::fabs(A[i]));
+  for (size_t i = 0; i < (size_t)k * n; i++) bmax = std::max(bmax, (double)std::fabs(B[i]));
+  for (size_t i = 0; i < Cs.count; i++) d = std::max(d, (double)std::fabs(Cs.ptr[i] - Cc.ptr[i]));
+  free_aligned(Cs); free_aligned(Cc);
+
+  levels = strassen_levels(m, k, n, cutoff);
+  bound = strassen_error_bound(m, k, n, cutoff) + (double)k * std::ldexp(1.0, -24);
+  err = d / std::max(1e-30, amax * bmax);
+  if (err > bound) {
+    std::cerr << "strassen: error " << err << " exceeds bound " << bound << "\n";
+  }
+}
+
+// One row per timed call. An outlier's cause is the OS activity seen during
+// it: preempt (involuntary context switch), fault (page faults), both, or
+// unknown (neither, e.g. frequency or SMT-sibling noise).
+static void write_rep_rows(const std::string& path, const std::string& kernel,
+                           const std::string& variant, const std::string& layoutB,
+                           const std::string& pattern, int m, int k, int n, double density,
+                           int threads, const std::string& dtype, uint64_t seed, int run_id,
+                           const std::vector<RepSample>& samples, const std::vector<int>& outlier) {
+  const bool fresh = !file_exists(path);
+  std::ofstream f(path, std::ios::app);
+  if (!f) {
+    std::cerr << "--reps_csv " << path << ": cannot open\n";
+    return;
+  }
+  if (fresh) {
+    f << "kernel,variant,layoutB,pattern,m,k,n,density,threads,dtype,seed,run,rep,"
+      << "seconds,vol_csw,invol_csw,page_faults,outlier,cause\n";
+  }
+  for (size_t r = 0; r < samples.size(); r++) {
+    const RepSample& s = samples[r];
+    const bool o = r < outlier.size() && outlier[r];
+    std::string cause = "-";
+    if (o) {
+      if (s.invol_csw > 0 && s.page_faults > 0) cause = "preempt+fault";
+      else if (s.invol_csw > 0)                 cause = "preempt";
+      else if (s.page_faults > 0)               cause = "fault";
+      else                                      cause = "unknown";
+    }
+    f << kernel << "," << variant << "," << layoutB << "," << pattern << ","
+      << m << "," << k << "," << n << "," << density << "," << threads << ","
+      << dtype << "," << seed << "," << run_id << "," << r << ","
+      << s.seconds << "," << s.vol_csw << "," << s.invol_csw << "," << s.page_faults << ","
+      << (o ? 1 : 0) << "," << cause << "\n";
+  }
+}
+
+// --sweep input cache. fill_random is counter-based, so a random operand is
+// fully determined by (count, seed) and can be shared by every config that
+// asks for it; CSRs are keyed by their generator arguments (or file) and
+// handed out as zero-copy views. Pages keep the placement of the config that
+// first touched them. Entries used by the running config are never evicted;
+// others go least-recently-used first once cap_bytes is exceeded.
+struct SweepCache {
+  struct Dense { AlignedBuffer buf; uint64_t used = 0; };
+  struct Sparse { std::shared_ptr<CSR> csr; size_t bytes = 0; uint64_t used = 0; };
+  std::map<std::string, Dense> dense;
+  std::map<std::string, Sparse> sparse;
+  size_t bytes = 0;
+  size_t cap_bytes = 0;
+  uint64_t epoch = 0;  // config counter
+
+  bool owns(const float* p) const {
+    for (const auto& kv : dense) if (kv.second.buf.ptr == p) return true;
+    return false;
+  }
+  void make_room(size_t need) {
+    while (bytes + need > cap_bytes) {
+      std::string victim;
+      bool is_dense = false;
+      uint64_t oldest = epoch;
+      for (const auto& kv : dense)  if (kv.second.used < oldest) { oldest = kv.second.used; victim = kv.first; is_dense = true; }
+      for (const auto& kv : sparse) if (kv.second.used < oldest) { oldest = kv.second.used; victim = kv.first; is_dense = false; }
+      if (victim.empty()) return;
+      if (is_dense) {
+        bytes -= dense[victim].buf.count * sizeof(float);
+        free_aligned(dense[victim].buf);
+        dense.erase(victim);
+      } else {
+        bytes -= sparse[victim].bytes;
+        sparse.erase(victim);
+      }
+    }
+  }
+  void clear() {
+    for (auto& kv : dense) free_aligned(kv.second.buf);
+    dense.clear();
+    sparse.clear();
+    bytes = 0;
+  }
+};
+
+// count floats from fill_random(seed), first-touched by the current team;
+// from the cache when sweeping.
+static AlignedBuffer random_input(SweepCache* cache, size_t count, uint64_t seed) {
+  std::string key;
+  if (cache) {
+    key = std::to_string(count) + ":" + std::to_string(seed) + ":" + page_policy_name(page_policy());
+    auto it = cache->dense.find(key);
+    if (it != cache->dense.end()) {
+      it->second.used = cache->epoch;
+      return it->second.buf;
+    }
+    cache->make_room(count * sizeof(float));
+  }
+  AlignedBuffer b = make_aligned_f32(count, 64);
+  first_touch(b.ptr, b.count * sizeof(float));
+  fill_random(b.ptr, b.count, seed);
+  if (cache) {
+    cache->dense[key] = {b, cache->epoch};
+    cache->bytes += count * sizeof(float);
+  }
+  return b;
+}
+
+// Frees b unless the cache owns it.
+static void release_input(SweepCache* cache, AlignedBuffer& b) {
+  if (cache && cache->owns(b.ptr)) b = AlignedBuffer();
+  else free_aligned(b);
+}
+
+static CSR csr_view(const std::shared_ptr<CSR>& src) {
+  CSR v;
+  v.m = src->m;
+  v.k = src->k;
+  v.rowptr.view(src->rowptr.data(), src->rowptr.size(), src);
+  v.colidx.view(src->colidx.data(), src->colidx.size(), src);
+  v.values.view(src->values.data(), src->values.size(), src);
+  return v;
+}
+
 static void print_header() {
   std::cout
     << "kernel,variant,layoutB,pattern,m,k,n,density,threads,tileM,tileN,tileK,jblock,seed,run,"
     << "seconds,gflops,nnz,cpnz,ai,bytes_est,bandwidth_GBps,p50_us,p95_us,p99_us,conv_seconds,"
     << "freq_mhz,cycles_est,"
-    << "perf_task_clock_ms,perf_context_switches,perf_cpu_migrations,perf_page_faults\n";
+    << "perf_task_clock_ms,perf_context_switches,perf_cpu_migrations,perf_page_faults,"
+    << "dtype,batch,alpha,beta,bias,act,bind,dispatch_us,"
+    << "stream_op,stream_nt,cpu_node,mem_node,ws_level,"
+    << "hw_cycles,hw_instructions,ipc,llc_load_misses,llc_store_misses,dtlb_load_misses,fp_ops,"
+    << "cycles_src,"
+    << "peak_gflops,peak_GBps,roof_bytes,roof_bytes_src,roof_ai,roof_gflops,pct_of_roof,roof_bound,"
+    << "nnz_per_s,accum,"
+    << "reorder,bw_before,bw_after,mean_dist_before,mean_dist_after,"
+    << "panel_k,"
+    << "strassen_cutoff,strassen_levels,err_vs_classic,err_bound,"
+    << "warmup,reps,ci_lo_us,ci_hi_us,ci_half_pct,outliers,"
+    << "pages,page_kib,flush_cache,trans,ld_pad,"
+    << "ooc_io,ooc_mib,ooc_tile,io_seconds,io_wait_seconds,overlap_pct\n";
 }
 
-int main(int argc, char** argv) {
+// A bound team must sit on distinct CPUs, as many as it has threads or as
+// the node allows; a team collapsed onto fewer CPUs (a stale affinity mask,
+// a failed pin) would time every thread count as one core.
+static bool check_team_cpus(const ThreadTeam& team, const CpuTopology& topo) {
+  if (team.bind == ThreadBind::None && team.node < 0) return true;
+  size_t usable = 0;
+  for (size_t i = 0; i < topo.cpus.size(); i++) {
+    if (team.node < 0 || topo.node[i] == team.node) usable++;
+  }
+  std::vector<int> cpus = team.cpu;
+  std::sort(cpus.begin(), cpus.end());
+  const size_t distinct = (size_t)(std::unique(cpus.begin(), cpus.end()) - cpus.begin());
+  if (cpus.front() >= 0 && distinct == std::min(usable, (size_t)team.threads)) return true;
+  std::cerr << "thread team of " << team.threads << " pinned to";
+  for (int c : team.cpu) std::cerr << " " << c;
+  std::cerr << " (" << usable << " usable CPUs)\n";
+  return false;
+}
+
+// Per-config resources released on every exit of run_config, early error
+// returns included (a sweep keeps going after a failed config).
+struct ConfigScope {
+  PerfSession perf;
+  AlignedBuffer bias = {nullptr, 0};
+  ~ConfigScope() {
+    perf_close(perf);
+    if (bias.ptr) free_aligned(bias);
+  }
+};
+
+static int run_config(int argc, char** argv, SweepCache* cache) {
   const std::string kernel = get_arg(argc, argv, "--kernel", "gemm");
   const std::string variant = get_arg(argc, argv, "--variant", "simd");
   const std::string layoutB_s = get_arg(argc, argv, "--layoutB", "row");
-  const std::string pattern = get_arg(argc, argv, "--pattern", "uniform");
+  std::string pattern = get_arg(argc, argv, "--pattern", "uniform");
+
+  // real-world input: Matrix Market (.mtx) or binary CSR; overrides m/k/density/pattern
+  const std::string matrix_path = get_arg(argc, argv, "--matrix", "");
+  const std::string save_csr_path = get_arg(argc, argv, "--save_csr", "");
 
-  const int m = get_arg_i(argc, argv, "--m", 1024);
-  const int k = get_arg_i(argc, argv, "--k", 1024);
-  const int n = get_arg_i(argc, argv, "--n", 1024);
-  const double density = get_arg_f(argc, argv, "--density", 1.0);
+  int m = get_arg_i(argc, argv, "--m", 1024);
+  int k = get_arg_i(argc, argv, "--k", 1024);
+  int n = get_arg_i(argc, argv, "--n", 1024);
+  double density = get_arg_f(argc, argv, "--density", 1.0);
 
   const int threads = get_arg_i(argc, argv, "--threads", 1);
+  // pin OpenMP threads: close (fill a NUMA node first) | spread (round-robin nodes) | none
+  const std::string bind_s = get_arg(argc, argv, "--bind", "close");
+  // NUMA: run the team on one node's CPUs (-1 = all allowed CPUs)
+  const int numa_node = get_arg_i(argc, argv, "--numa_node", -1);
+
+  // stream: op = copy|scale|add|triad|all; nt = 1 for non-temporal stores;
+  // sweep = 1 for array sizes at each cache level plus DRAM (else DRAM only,
+  // or --stream_mib MiB per array); mem_node places the arrays on another
+  // node than --numa_node for cross-node bandwidth.
+  const std::string stream_op_s = get_arg(argc, argv, "--stream_op", "all");
+  const int stream_nt = get_arg_i(argc, argv, "--stream_nt", 0);
+  const int stream_sweep = get_arg_i(argc, argv, "--stream_sweep", 0);
+  const double stream_mib = get_arg_f(argc, argv, "--stream_mib", 0.0);
+  const int mem_node = get_arg_i(argc, argv, "--mem_node", -1);
   const int tileM = get_arg_i(argc, argv, "--tileM", 64);
   const int tileN = get_arg_i(argc, argv, "--tileN", 128);
   const int tileK = get_arg_i(argc, argv, "--tileK", 64);
   const int jblock = get_arg_i(argc, argv, "--jblock", 128);
+  // spmm_csr: A column panel for the 2D-blocked kernel (row-major f32 B);
+  // 0 = off (1D jblock tiling only), -1 = sized from the L2 capacity
+  int panel_k = get_arg_i(argc, argv, "--panel_k", 0);
+  // spmm_*/spmv: reorder A (and B / x to match) before format conversion:
+  // none | rcm (square A) | degree; its cost is part of conv_seconds
+  const std::string reorder_s = get_arg(argc, argv, "--reorder", "none");
+  // spmv: timed y = A x calls (square A iterates x <- y)
+  const int iters = get_arg_i(argc, argv, "--iters", 100);
+  // spgemm accumulator: auto (dense SPA for long rows, hash otherwise) | hash | dense
+  const std::string accum_s = get_arg(argc, argv, "--accum", "auto");
+  // gemm --variant morton: side of the Z-ordered packed tiles
+  const int morton_tile = get_arg_i(argc, argv, "--morton_tile", 64);
+  // gemm --variant strassen: recurse while min(m, k, n) > cutoff
+  const int strassen_cutoff = get_arg_i(argc, argv, "--strassen_cutoff", 512);
+  // gemm --variant simd/scalar (f32): op(A) op(B) through gemm_tiled_op, as
+  // nn | tn | nt | tt (t = that operand is stored transposed); --ld_pad adds
+  // that many floats to every leading dimension, so A, B and C are strided
+  // sub-blocks of wider matrices
+  const std::string trans_s = get_arg(argc, argv, "--trans", "nn");
+  const int ld_pad = std::max(0, get_arg_i(argc, argv, "--ld_pad", 0));
+  // gemm_ooc / spmm_ooc: out-of-core products over files in --ooc_dir. A and
+  // B are generated there once per shape and seed and kept; C is removed
+  // after the run. --ooc_mib bounds the resident tiles, --ooc_io pread | mmap
+  // picks how tiles are read, --ooc_cold 1 drops the dense operand files from
+  // the page cache before every call, so reads hit the device even when the
+  // files would fit in RAM.
+  const std::string ooc_dir = get_arg(argc, argv, "--ooc_dir", ".");
+  const int ooc_mib = std::max(1, get_arg_i(argc, argv, "--ooc_mib", 256));
+  const std::string ooc_io_s = get_arg(argc, argv, "--ooc_io", "pread");
+  const int ooc_cold = get_arg_i(argc, argv, "--ooc_cold", 1);
+
+  // alternative sparse formats (spmm_sell / spmm_bsr)
+  const int sell_c = get_arg_i(argc, argv, "--sell_c", 8);
+  const int sell_sigma = get_arg_i(argc, argv, "--sell_sigma", 256);
+  const int bsr_block = get_arg_i(argc, argv, "--bsr_block", 4);
+
+  // storage type for gemm / spmm_csr: f32 | bf16 | f16 | i8 (accumulation is f32, or i32 for i8)
+  const std::string dtype_s = get_arg(argc, argv, "--dtype", "f32");
+
+  // gemm_batched: number of independent m x k x n problems; --batch_mix 1
+  // draws each problem's square size from {16, 32, 64, 128} instead.
+  const int batch = get_arg_i(argc, argv, "--batch", 1000);
+  const int batch_mix = get_arg_i(argc, argv, "--batch_mix", 0);
+
+  // fused epilogue for f32 gemm and spmm_{csr,ell,sell,bsr}:
+  // C = act(alpha * A*B + beta * C + bias), bias = none | row (length m) | col (length n)
+  const double alpha = get_arg_f(argc, argv, "--alpha", 1.0);
+  const double beta = get_arg_f(argc, argv, "--beta", 0.0);
+  const std::string bias_s = get_arg(argc, argv, "--bias", "none");
+  const std::string act_s = get_arg(argc, argv, "--act", "none");
+
+  // spmm_auto: 1 = calibrate the cost model in-process before planning
+  const int auto_calibrate = get_arg_i(argc, argv, "--auto_calibrate", 1);
 
   const uint64_t seed = (uint64_t)get_arg_i(argc, argv, "--seed", 123);
   const int run_id = get_arg_i(argc, argv, "--run", 0);
 
   const double freq_mhz = get_arg_f(argc, argv, "--freq_mhz", 2400.0);
 
-  // perf fields that are actually measurable in your environment
-  const double perf_task_clock_ms = get_arg_f(argc, argv, "--perf_task_clock_ms", 0.0);
-  const double perf_context_switches = get_arg_f(argc, argv, "--perf_context_switches", 0.0);
-  const double perf_cpu_migrations = get_arg_f(argc, argv, "--perf_cpu_migrations", 0.0);
-  const double perf_page_faults = get_arg_f(argc, argv, "--perf_page_faults", 0.0);
+  // Timed reps: --warmup untimed calls, then --reps (0 = per-kernel default;
+  // spmv: --iters). --ci_pct X keeps timing, up to --max_reps, until the
+  // bootstrap 95% CI of the median is within +-X %. --reps_csv appends one row
+  // per timed call (wall time, context-switch / page-fault deltas, outlier
+  // flag and likely cause) to that file.
+  RepPolicy pol;
+  pol.warmup = std::max(0, get_arg_i(argc, argv, "--warmup", 1));
+  pol.reps = get_arg_i(argc, argv, "--reps", 0);
+  pol.max_reps = get_arg_i(argc, argv, "--max_reps", 200);
+  pol.ci_pct = get_arg_f(argc, argv, "--ci_pct", 0.0);
+  pol.seed = seed;
+  const std::string reps_csv = get_arg(argc, argv, "--reps_csv", "");
+  // 1 = evict the caches before every timed call by streaming a buffer of
+  // twice the L3 size (cold-cache timing)
+  const int flush_cache = get_arg_i(argc, argv, "--flush_cache", 0);
+
+  // in-process perf_event_open counters around the timed calls only (0 = off)
+  const int counters = get_arg_i(argc, argv, "--counters", 1);
+  // roofline: after the timed calls, measure the FMA peak and the DRAM STREAM
+  // ceiling on the same team and place the kernel under min(peak, BW*AI).
+  // --peak_gflops/--peak_GBps > 0 skip the respective measurement.
+  const int roofline = get_arg_i(argc, argv, "--roofline", 0);
+  double peak_gflops = get_arg_f(argc, argv, "--peak_gflops", 0.0);
+  double peak_gbps = get_arg_f(argc, argv, "--peak_GBps", 0.0);
+
+  // page policy for every AlignedBuffer: 4k | thp | 2m | 1g (hugetlb, falls
+  // back to thp); page_kib reports what actually backs the B operand
+  const std::string pages_s = get_arg(argc, argv, "--pages", "4k");
 
   const int header = get_arg_i(argc, argv, "--header", 0);
   if (header) {
@@ -72,10 +452,100 @@ int main(int argc, char** argv) {
     return 0;
   }
 
-  omp_set_num_threads(std::max(1, threads));
+  // --verify 1: check every kernel variant against a double-precision
+  // reference on --threads threads instead of timing (2 = list every case);
+  // exits 1 on any mismatch
+  const int verify = get_arg_i(argc, argv, "--verify", 0);
+  if (verify) {
+    omp_set_num_threads(std::max(1, threads));
+    return run_verify(seed, verify > 1) ? 1 : 0;
+  }
+
+  PagePolicy pages = PagePolicy::Small;
+  if (!parse_page_policy(pages_s, pages)) {
+    std::cerr << "Unknown --pages " << pages_s << "\n";
+    return 2;
+  }
+  set_page_policy(pages);
+
+  ThreadBind bind = ThreadBind::Close;
+  if (!parse_thread_bind(bind_s, bind)) {
+    std::cerr << "Unknown --bind " << bind_s << "\n";
+    return 2;
+  }
+  // Team is created, pinned and warmed here, so no timed call pays for
+  // thread creation; dispatch_us is reported on its own CSV column.
+  const CpuTopology topo = read_cpu_topology();
+  if (numa_node >= topo.nodes || mem_node >= topo.nodes) {
+    std::cerr << "--numa_node/--mem_node out of range (" << topo.nodes << " node(s))\n";
+    return 2;
+  }
+  ThreadTeam team = start_thread_team(threads, bind, numa_node);
+  if (!check_team_cpus(team, topo)) return 2;
+  std::vector<unsigned char> flush_buf;
+  if (flush_cache) {
+    // Swept by the whole team so every core's private L1/L2 is evicted too
+    // (a non-inclusive LLC leaves them warm); each thread's share is at
+    // least 2x its L2.
+    const size_t l2_share = 2 * topo.l2_bytes * (size_t)std::max(1, team.threads);
+    flush_buf.assign(std::max(2 * std::max<size_t>(topo.l3_bytes, (size_t)32 << 20), l2_share), 0);
+    pol.flush = [&flush_buf]() {
+      unsigned char* p = flush_buf.data();
+      const long lines = (long)(flush_buf.size() / 64);
+#pragma omp parallel for schedule(static)
+      for (long i = 0; i < lines; i++) p[(size_t)i * 64]++;
+    };
+  }
+  // Floats per STREAM array for a DRAM-resident run: 4x L3 across the three
+  // arrays, at least 64 MiB each.
+  const size_t dram_n = std::max<size_t>((size_t)16 << 20, 4 * topo.l3_bytes / (3 * sizeof(float)));
+
+  // Opened per team thread after the team exists; stream rows are not counted.
+  ConfigScope scope;
+  PerfSession& perf = scope.perf;
+  if (counters) perf_open(perf);
 
   LayoutB layoutB = (layoutB_s == "col") ? LayoutB::ColMajor : LayoutB::RowMajor;
 
+  DType dtype = DType::F32;
+  if (!parse_dtype(dtype_s, dtype)) {
+    std::cerr << "Unknown --dtype " << dtype_s << "\n";
+    return 2;
+  }
+  const double elem_bytes = (double)dtype_bytes(dtype);
+  if (dtype != DType::F32 && kernel != "gemm" && kernel != "spmm_csr") {
+    std::cerr << "--dtype " << dtype_s << " is only supported for gemm and spmm_csr\n";
+    return 2;
+  }
+
+  Epilogue epi;
+  epi.alpha = (float)alpha;
+  epi.beta = (float)beta;
+  if (!parse_activation(act_s, epi.act)) {
+    std::cerr << "Unknown --act " << act_s << "\n";
+    return 2;
+  }
+  if (bias_s != "none" && bias_s != "row" && bias_s != "col") {
+    std::cerr << "Unknown --bias " << bias_s << "\n";
+    return 2;
+  }
+  const bool fused = alpha != 1.0 || beta != 0.0 || bias_s != "none" || epi.act != Activation::None;
+  if (fused && (dtype != DType::F32 ||
+                (kernel != "gemm" && kernel != "spmm_csr" && kernel != "spmm_ell" &&
+                 kernel != "spmm_sell" && kernel != "spmm_bsr"))) {
+    std::cerr << "--alpha/--beta/--bias/--act are only supported for f32 gemm and spmm_{csr,ell,sell,bsr}\n";
+    return 2;
+  }
+  // Bias vectors are sized once m is final (--matrix may change it).
+  AlignedBuffer& bias = scope.bias;
+  auto attach_bias = [&]() {
+    if (bias_s == "none") return;
+    bias = make_aligned_f32((size_t)(bias_s == "row" ? m : n), 64);
+    fill_random(bias.ptr, bias.count, seed ^ 0xB1A5u);
+    if (bias_s == "row") epi.row_bias = bias.ptr;
+    else                 epi.col_bias = bias.ptr;
+  };
+
   double seconds = 0.0;
   double gflops = 0.0;
   size_t nnz = 0;
@@ -85,117 +555,917 @@ int main(int argc, char** argv) {
   double ai = 0.0;
   double bw_gbps = 0.0;
 
+  // Reordering: permutations and the bandwidth (max / mean |i - j|) of A
+  // before and after.
+  Reorder reorder = Reorder::None;
+  if (!parse_reorder(reorder_s, reorder)) {
+    std::cerr << "Unknown --reorder " << reorder_s << "\n";
+    return 2;
+  }
+  std::vector<int> row_perm, col_perm;
+  int bw_before = 0, bw_after = 0;
+  double dist_before = 0.0, dist_after = 0.0;
+
+  // gemm --variant strassen: recursion depth, and max |C - C_classic| and
+  // its a-priori bound, both relative to max|A| * max|B| (-1 / 0 otherwise)
+  int sw_levels = -1;
+  double sw_err = 0.0, sw_bound = 0.0;
+
+  // spgemm: output nonzeros per second and the accumulator policy
+  double nnz_per_s = 0.0;
+  SpgemmAccum accum = SpgemmAccum::Auto;
+
+  // gemm_ooc / spmm_ooc: resident tile, I/O thread busy time and the part of
+  // it compute waited for, per timed call (overlap_pct = hidden share)
+  bool ooc = false;
+  std::string ooc_tile = "-";
+  OocStats ooc_avg;
+
+  // Effective page size (KiB) behind the main streamed operand; 0 = none
+  // (spgemm's CSR arrays are std::vector).
+  size_t page_kib = 0;
+
   std::vector<double> call_times;
   call_times.reserve(32);
+  // Per-operation latencies when one call does many (gemm_batched: one entry
+  // per matrix per timed call); p50/p95/p99 come from these when non-empty.
+  std::vector<double> op_times;
+  std::vector<RepSample> samples;
+  // call_times from the timed samples; returns the median sample.
+  auto take_samples = [&]() -> double {
+    for (const RepSample& r : samples) call_times.push_back(r.seconds);
+    std::vector<double> tmp;
+    for (const RepSample& r : samples) tmp.push_back(r.seconds);
+    std::sort(tmp.begin(), tmp.end());
+    return tmp.empty() ? 0.0 : tmp[tmp.size() / 2];
+  };
+
+  // Stream rows override these per (op, size).
+  std::string row_stream_op = "none";
+  std::string row_level = "-";
+  int row_mem_node = -1;
+
+  // Counter columns are per timed call; empty when the event is unavailable.
+  // cycles_est is measured core cycles per call averaged over the team
+  // (cycles_src = pmu), else seconds * freq_mhz (cycles_src = freq).
+  PerfCounters pc;
+  auto per_call = [&](double total) -> std::string {
+    if (total < 0.0) return "";
+    return std::to_string(total / (double)std::max(1, perf.windows));
+  };
+
+  // Roofline columns (empty unless --roofline and a kernel row). Bytes are
+  // DRAM traffic from LLC misses (64 B lines, loads + stores) when counted,
+  // else bytes_est; the binding roof is whichever of peak and BW*AI is lower.
+  auto roofline_cols = [&]() -> std::string {
+    if (!roofline || kernel == "stream" || seconds <= 0.0) return ",,,,,,,";
+    const double flops = gflops * seconds * 1e9;
+    double bytes = bytes_est;
+    std::string src = "est";
+    if (pc.llc_load_misses >= 0.0 && perf.windows > 0) {
+      bytes = 64.0 * (pc.llc_load_misses + std::max(0.0, pc.llc_store_misses)) / (double)perf.windows;
+      src = "llc";
+    }
+    const double rai = flops / std::max(1.0, bytes);
+    const double mem_roof = peak_gbps * rai;
+    const double roof = std::min(peak_gflops, mem_roof);
+    const double pct = roof > 0.0 ? 100.0 * gflops / roof : 0.0;
+    const char* bound = peak_gflops <= mem_roof ? "compute" : "memory";
+    std::cerr << "[roofline] " << kernel << " " << variant << " " << dtype_s << ": "
+              << gflops << " GFLOP/s = " << pct << "% of " << bound << " roof " << roof
+              << " GFLOP/s (peak " << peak_gflops << " GFLOP/s, " << peak_gbps << " GB/s, AI "
+              << rai << " flop/B from " << src << ")\n";
+    std::ostringstream o;
+    o << peak_gflops << "," << peak_gbps << "," << bytes << "," << src << ","
+      << rai << "," << roof << "," << pct << "," << bound;
+    return o.str();
+  };
+
+  // Sparse input: --matrix (m/k/density/pattern follow the file) or a random
+  // CSR of the requested shape.
+  auto input_csr = [&](CSR& A) -> bool {
+    std::string key;
+    if (cache) {
+      std::ostringstream ks;
+      if (matrix_path.empty()) ks << m << ":" << k << ":" << density << ":" << pattern << ":" << seed;
+      else                     ks << "file:" << matrix_path;
+      key = ks.str();
+      auto it = cache->sparse.find(key);
+      if (it != cache->sparse.end()) {
+        it->second.used = cache->epoch;
+        A = csr_view(it->second.csr);
+        m = A.m;
+        k = A.k;
+        if (!matrix_path.empty()) {
+          density = (double)csr_nnz(A) / std::max(1.0, (double)m * (double)k);
+          pattern = "file";
+        }
+        return true;
+      }
+    }
+    auto remember = [&]() {
+      if (!cache) return;
+      auto owner = std::make_shared<CSR>(std::move(A));
+      const size_t bytes = csr_nnz(*owner) * 8 + owner->rowptr.size() * 4;
+      cache->make_room(bytes);
+      cache->sparse[key] = {owner, bytes, cache->epoch};
+      cache->bytes += bytes;
+      A = csr_view(owner);
+    };
+    if (matrix_path.empty()) {
+      A = make_random_csr(m, k, density, pattern, seed);
+      remember();
+      return true;
+    }
+    std::string err;
+    if (!load_matrix(matrix_path, A, err)) {
+      std::cerr << "--matrix " << matrix_path << ": " << err << "\n";
+      return false;
+    }
+    remember();
+    m = A.m;
+    k = A.k;
+    density = (double)csr_nnz(A) / std::max(1.0, (double)m * (double)k);
+    pattern = "file";
+    return true;
+  };
+
+  // Replaces A by P A Q^T when --reorder is set; the caller permutes B (or x)
+  // by col_perm.
+  auto reorder_csr = [&](CSR& A) -> bool {
+    if (reorder == Reorder::None) return true;
+    bw_before = csr_bandwidth(A, &dist_before);
+    if (!reorder_perm(A, reorder, row_perm, col_perm)) {
+      std::cerr << "--reorder " << reorder_s << " needs a square matrix\n";
+      return false;
+    }
+    A = permute_csr(A, row_perm, col_perm);
+    bw_after = csr_bandwidth(A, &dist_after);
+    return true;
+  };
+
+  auto emit_row = [&]() {
+    double p50 = 0.0, p95 = 0.0, p99 = 0.0;
+    percentile_us(call_times, p50, p95, p99);  // from a2_utils.*
+
+    // Median CI and outliers over the per-call times.
+    double ci_lo = 0.0, ci_hi = 0.0;
+    bootstrap_median_ci(call_times, pol.resamples, pol.seed, ci_lo, ci_hi);
+    ci_lo *= 1e6;
+    ci_hi *= 1e6;
+    const double ci_half_pct = p50 > 0.0 ? 50.0 * (ci_hi - ci_lo) / p50 : 0.0;
+    if (!op_times.empty()) percentile_us(op_times, p50, p95, p99);
+    std::vector<int> outlier;
+    outlier_fence(call_times, outlier);
+    int outliers = 0;
+    for (int o : outlier) outliers += o;
+    if (!reps_csv.empty() && !samples.empty()) write_rep_rows(reps_csv, kernel, variant, layoutB_s,
+        pattern, m, k, n, density, threads, dtype_s, seed, run_id, samples, outlier);
+
+    const bool pmu_cycles = pc.cycles >= 0.0 && perf.windows > 0;
+    const double cycles_est = pmu_cycles
+        ? pc.cycles / (double)perf.windows / (double)std::max(1, team.threads)
+        : seconds * (freq_mhz * 1e6);
+    const double cpnz = (nnz > 0) ? (cycles_est / (double)nnz) : 0.0;
+    const std::string ipc = (pc.cycles > 0.0 && pc.instructions >= 0.0)
+        ? std::to_string(pc.instructions / pc.cycles) : "";
+
+    std::cout
+      << kernel << "," << variant << "," << layoutB_s << "," << pattern << ","
+      << m << "," << k << "," << n << ","
+      << density << ","
+      << threads << ","
+      << tileM << "," << tileN << "," << tileK << "," << jblock << ","
+      << seed << "," << run_id << ","
+      << seconds << "," << gflops << ","
+      << nnz << "," << cpnz << ","
+      << ai << "," << bytes_est << "," << bw_gbps << ","
+      << p50 << "," << p95 << "," << p99 << ","
+      << conv_seconds << ","
+      << freq_mhz << "," << cycles_est << ","
+      << per_call(pc.task_clock_ms) << "," << per_call(pc.context_switches) << ","
+      << per_call(pc.cpu_migrations) << "," << per_call(pc.page_faults) << ","
+      << dtype_s << "," << (kernel == "gemm_batched" ? batch : 0) << ","
+      << alpha << "," << beta << "," << bias_s << "," << activation_name(epi.act) << ","
+      << thread_bind_name(team.bind) << "," << team.dispatch_us << ","
+      << row_stream_op << "," << stream_nt << "," << numa_node << "," << row_mem_node << "," << row_level << ","
+      << per_call(pc.cycles) << "," << per_call(pc.instructions) << "," << ipc << ","
+      << per_call(pc.llc_load_misses) << "," << per_call(pc.llc_store_misses) << ","
+      << per_call(pc.dtlb_load_misses) << "," << per_call(pc.fp_ops) << ","
+      << (pmu_cycles ? "pmu" : "freq") << ","
+      << roofline_cols() << ","
+      << nnz_per_s << "," << (kernel == "spgemm" ? spgemm_accum_name(accum) : "-") << ","
+      << reorder_name(reorder) << "," << bw_before << "," << bw_after << ","
+      << dist_before << "," << dist_after << ","
+      << panel_k << ","
+      << (sw_levels >= 0 ? strassen_cutoff : 0) << "," << sw_levels << ","
+      << sw_err << "," << sw_bound << ","
+      << pol.warmup << "," << samples.size() << "," << ci_lo << "," << ci_hi << ","
+      << ci_half_pct << "," << outliers << ","
+      << page_policy_name(pages) << "," << page_kib
+      << "," << flush_cache << "," << trans_s << "," << ld_pad << ","
+      << (ooc ? ooc_io_s : "none") << "," << (ooc ? ooc_mib : 0) << "," << ooc_tile << ","
+      << ooc_avg.io_seconds << "," << ooc_avg.wait_seconds << ","
+      << (ooc ? ooc_overlap_pct(ooc_avg) : 0.0)
+      << "\n";
+  };
 
   if (kernel == "stream") {
-    double gbps = stream_triad_bandwidth_gbps((size_t)64 * 1024 * 1024 / sizeof(float), 10, seed);
-    seconds = 0.0;
-    gflops = 0.0;
-    nnz = 0;
-    bytes_est = 0.0;
-    ai = 0.0;
-    bw_gbps = gbps;
-    call_times = {0.0};
+    std::vector<StreamOp> ops;
+    if (stream_op_s == "all") {
+      ops = {StreamOp::Copy, StreamOp::Scale, StreamOp::Add, StreamOp::Triad};
+    } else {
+      StreamOp op;
+      if (!parse_stream_op(stream_op_s, op)) {
+        std::cerr << "Unknown --stream_op " << stream_op_s << "\n";
+        return 2;
+      }
+      ops = {op};
+    }
+
+    // Floats per array. Cache levels: half of L1d/L2 per thread, half of L3;
+    // DRAM: dram_n.
+    const size_t T = (size_t)team.threads;
+    std::vector<size_t> sizes;
+    if (stream_mib > 0.0) {
+      sizes.push_back((size_t)(stream_mib * 1024.0 * 1024.0) / sizeof(float));
+    } else if (stream_sweep) {
+      for (size_t per_thread : {topo.l1d_bytes, topo.l2_bytes}) {
+        if (per_thread) sizes.push_back(T * per_thread / 2 / (3 * sizeof(float)));
+      }
+      if (topo.l3_bytes) sizes.push_back(topo.l3_bytes / 2 / (3 * sizeof(float)));
+      sizes.push_back(dram_n);
+    } else {
+      sizes.push_back(dram_n);
+    }
+
+    auto level_of = [&](double bytes) -> std::string {
+      const double per_thread = bytes / (double)T;
+      if (topo.l1d_bytes && per_thread <= (double)topo.l1d_bytes) return "L1";
+      if (topo.l2_bytes && per_thread <= (double)topo.l2_bytes) return "L2";
+      if (topo.l3_bytes && bytes <= (double)topo.l3_bytes) return "L3";
+      return "DRAM";
+    };
+
+    row_mem_node = mem_node >= 0 ? mem_node : numa_node;
+    for (size_t N : sizes) {
+      N = std::max<size_t>(N, 16 * T);
+      // Arrays are first-touched by a team pinned to the memory node, then
+      // the team moves back to the compute node; the pages stay put. A row
+      // whose pages did not land there would report local bandwidth as
+      // cross-node, so placement is checked on each array.
+      if (mem_node >= 0 && mem_node != numa_node) {
+        team = start_thread_team(threads, bind, mem_node);
+        if (!check_team_cpus(team, topo)) return 2;
+      }
+      StreamArrays sa = make_stream_arrays(N);
+      page_kib = buffer_page_kib(sa.a.ptr, N * sizeof(float));
+      if (mem_node >= 0 && mem_node != numa_node) {
+        team = start_thread_team(threads, bind, numa_node);
+        if (!check_team_cpus(team, topo)) {
+          free_stream_arrays(sa);
+          return 2;
+        }
+      }
+      if (row_mem_node >= 0) {
+        for (const float* p : {sa.a.ptr, sa.b.ptr, sa.c.ptr}) {
+          const int at = page_node(p + N / 2);
+          if (at >= 0 && at != row_mem_node) {
+            std::cerr << "stream: arrays landed on node " << at << ", not --mem_node " << row_mem_node << "\n";
+            free_stream_arrays(sa);
+            return 2;
+          }
+        }
+      }
+
+      for (StreamOp op : ops) {
+        StreamResult r = run_stream(op, sa, 10, stream_nt != 0);
+        m = (int)N;
+        k = 1;
+        seconds = r.best_seconds;
+        bytes_est = (double)stream_op_arrays(op) * (double)N * sizeof(float);
+        bw_gbps = r.best_gbps;
+        call_times = {r.best_seconds};
+        row_stream_op = stream_op_name(op);
+        row_level = level_of(bytes_est);
+        emit_row();
+      }
+      free_stream_arrays(sa);
+    }
+    return 0;
   } else if (kernel == "gemm") {
-    AlignedBuffer A = make_aligned_f32((size_t)m * (size_t)k, 64);
-    AlignedBuffer B = make_aligned_f32((size_t)k * (size_t)n, 64);
-    AlignedBuffer C = make_aligned_f32((size_t)m * (size_t)n, 64);
+    if (trans_s != "nn" && trans_s != "tn" && trans_s != "nt" && trans_s != "tt") {
+      std::cerr << "Unknown --trans " << trans_s << "\n";
+      return 2;
+    }
+    const Trans ta = trans_s[0] == 't' ? Trans::T : Trans::N;
+    const Trans tb = trans_s[1] == 't' ? Trans::T : Trans::N;
+    const bool op = (trans_s != "nn" || ld_pad > 0);
+    if (op && (dtype != DType::F32 || (variant != "simd" && variant != "scalar"))) {
+      std::cerr << "--trans/--ld_pad need --variant simd or scalar with f32\n";
+      return 2;
+    }
+    const bool rec = (variant == "recursive" || variant == "morton" || variant == "strassen");
+    if (rec && dtype != DType::F32) {
+      std::cerr << "--variant " << variant << " is only supported for f32 gemm\n";
+      return 2;
+    }
+    const int lda = (ta == Trans::N ? k : m) + ld_pad;
+    const int ldb = (tb == Trans::N ? n : k) + ld_pad;
+    const int ldc = n + ld_pad;
+    AlignedBuffer A = random_input(cache, (size_t)(ta == Trans::N ? m : k) * (size_t)lda, seed ^ 0xA5A5u);
+    AlignedBuffer B = random_input(cache, (size_t)(tb == Trans::N ? k : n) * (size_t)ldb, seed ^ 0x5A5Au);
+    AlignedBuffer C = make_aligned_f32((size_t)m * (size_t)ldc, 64);
+    page_kib = buffer_page_kib(B.ptr, B.count * sizeof(float));
+    first_touch(C.ptr, C.count * sizeof(float));
 
-    fill_random(A.ptr, A.count, seed ^ 0xA5A5u);
-    fill_random(B.ptr, B.count, seed ^ 0x5A5Au);
+    // beta != 0 reads C: every call starts from the same C0, restored untimed.
+    AlignedBuffer C0;
+    if (epi.beta != 0.0f) {
+      fill_random(C.ptr, C.count, seed ^ 0xC0C0u);
+      C0 = make_aligned_f32(C.count, 64);
+      std::memcpy(C0.ptr, C.ptr, C.count * sizeof(float));
+    }
+    auto restore_c = [&](int) {
+      if (C0.ptr) std::memcpy(C.ptr, C0.ptr, C.count * sizeof(float));
+    };
+    attach_bias();
+
+    // recursive/morton: cache-oblivious recursion (AVX2 leaves when built
+    // with AVX2); morton packs A and B into Z-ordered tiles first, and that
+    // packing is reported as conv_seconds.
+    // strassen: Strassen-Winograd over gemm_tiled leaves, temporaries from an
+    // arena sized here so no timed call allocates.
+    MortonMatrix Am, Bm;
+    if (variant == "morton") {
+      double c0 = now_seconds();
+      Am = make_morton(A.ptr, m, k, morton_tile);
+      Bm = make_morton(B.ptr, k, n, morton_tile);
+      conv_seconds = now_seconds() - c0;
+    }
+    GemmArena arena;
+    if (variant == "strassen") {
+      reserve_arena(arena, strassen_arena_floats(m, k, n, strassen_cutoff));
+      first_touch(arena.buf.ptr, arena.buf.count * sizeof(float));
+    }
 
     const int reps = 15;
-    for (int r = 0; r < reps; r++) {
-      zero_fill(C.ptr, C.count);
-      double t0 = now_seconds();
+    const bool simd = (variant == "simd");
+    if (dtype == DType::BF16)     conv_seconds = bench_gemm_lp<bf16_t, float>(A, B, m, k, n, tileM, tileK, tileN, simd, pol, reps, perf, samples);
+    else if (dtype == DType::F16) conv_seconds = bench_gemm_lp<fp16_t, float>(A, B, m, k, n, tileM, tileK, tileN, simd, pol, reps, perf, samples);
+    else if (dtype == DType::I8)  conv_seconds = bench_gemm_lp<int8_t, int32_t>(A, B, m, k, n, tileM, tileK, tileN, simd, pol, reps, perf, samples);
+    // the kernel overwrites C when beta == 0; otherwise restore_c resets it
+    auto call = [&]() {
 #if defined(__AVX2__)
-      if (variant == "simd") gemm_tiled_avx2(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN);
-      else                   gemm_tiled_scalar(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN);
+      if (variant == "recursive")  gemm_recursive_avx2(A.ptr, B.ptr, C.ptr, m, k, n, epi);
+      else if (variant == "morton") gemm_morton_avx2(Am, Bm, C.ptr, epi);
+      else if (variant == "strassen") gemm_strassen_avx2(A.ptr, B.ptr, C.ptr, m, k, n, strassen_cutoff,
+                                                         tileM, tileK, tileN, arena, epi);
+      else if (op && variant == "simd") gemm_tiled_op_avx2(ta, tb, A.ptr, lda, B.ptr, ldb, C.ptr, ldc,
+                                                          m, k, n, tileM, tileK, tileN, epi);
+      else if (op)                 gemm_tiled_op_scalar(ta, tb, A.ptr, lda, B.ptr, ldb, C.ptr, ldc,
+                                                        m, k, n, tileM, tileK, tileN, epi);
+      else if (variant == "simd")  gemm_tiled_avx2(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN, epi);
+      else                         gemm_tiled_scalar(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN, epi);
 #else
-      gemm_tiled_scalar(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN);
+      if (variant == "recursive")  gemm_recursive_scalar(A.ptr, B.ptr, C.ptr, m, k, n, epi);
+      else if (variant == "morton") gemm_morton_scalar(Am, Bm, C.ptr, epi);
+      else if (variant == "strassen") gemm_strassen_scalar(A.ptr, B.ptr, C.ptr, m, k, n, strassen_cutoff,
+                                                           tileM, tileK, tileN, arena, epi);
+      else if (op)                 gemm_tiled_op_scalar(ta, tb, A.ptr, lda, B.ptr, ldb, C.ptr, ldc,
+                                                        m, k, n, tileM, tileK, tileN, epi);
+      else                         gemm_tiled_scalar(A.ptr, B.ptr, C.ptr, m, k, n, tileM, tileK, tileN, epi);
 #endif
-      double t1 = now_seconds();
-      call_times.push_back(t1 - t0);
+    };
+    if (dtype == DType::F32) run_reps(pol, reps, perf, samples, call, restore_c);
+    seconds = take_samples();
+
+    const double flops = 2.0 * (double)m * (double)k * (double)n;
+    gflops = flops / std::max(1e-12, seconds) / 1e9;
+
+    bytes_est = elem_bytes * ((double)m * k + (double)k * n) + 4.0 * 2.0 * (double)m * n;
+    ai = flops / std::max(1.0, bytes_est);
+    bw_gbps = (bytes_est / std::max(1e-12, seconds)) / 1e9;
+
+    if (variant == "strassen") {
+      strassen_check(A.ptr, B.ptr, m, k, n, strassen_cutoff, tileM, tileK, tileN, arena,
+                     sw_levels, sw_err, sw_bound);
+      free_arena(arena);
+    }
+    if (variant == "morton") { free_morton(Am); free_morton(Bm); }
+    if (C0.ptr) free_aligned(C0);
+    release_input(cache, A); release_input(cache, B); free_aligned(C);
+  } else if (kernel == "gemm_batched") {
+    std::vector<GemmShape> shapes((size_t)std::max(1, batch));
+    std::mt19937_64 rng(seed);
+    const int mix_sizes[4] = {16, 32, 64, 128};
+    size_t a_total = 0, b_total = 0, c_total = 0;
+    double flops = 0.0;
+    for (auto& sh : shapes) {
+      if (batch_mix) { int d = mix_sizes[rng() % 4]; sh.m = sh.k = sh.n = d; }
+      else           { sh.m = m; sh.k = k; sh.n = n; }
+      a_total += (size_t)sh.m * sh.k;
+      b_total += (size_t)sh.k * sh.n;
+      c_total += (size_t)sh.m * sh.n;
+      flops += 2.0 * sh.m * sh.k * sh.n;
     }
 
-    std::vector<double> tmp = call_times;
-    std::sort(tmp.begin(), tmp.end());
-    seconds = tmp[tmp.size() / 2];
+    AlignedBuffer A = random_input(cache, a_total, seed ^ 0xA5A5u);
+    AlignedBuffer B = random_input(cache, b_total, seed ^ 0x5A5Au);
+    AlignedBuffer C = make_aligned_f32(c_total, 64);
+    page_kib = buffer_page_kib(B.ptr, B.count * sizeof(float));
+    first_touch(C.ptr, C.count * sizeof(float));
 
-    const double flops = 2.0 * (double)m * (double)k * (double)n;
+    std::vector<const float*> Ap(shapes.size()), Bp(shapes.size());
+    std::vector<float*> Cp(shapes.size());
+    size_t ao = 0, bo = 0, co = 0;
+    for (size_t b = 0; b < shapes.size(); b++) {
+      Ap[b] = A.ptr + ao; Bp[b] = B.ptr + bo; Cp[b] = C.ptr + co;
+      ao += (size_t)shapes[b].m * shapes[b].k;
+      bo += (size_t)shapes[b].k * shapes[b].n;
+      co += (size_t)shapes[b].m * shapes[b].n;
+    }
+
+    // Timed per batch (seconds, CI, reps rows); p50/p95/p99 are per-matrix
+    // latencies, each matrix timed by the thread that ran it, over every timed
+    // batch. The two clock reads per matrix are inside the batch time.
+    const int reps = 15;
+    const int count = (int)shapes.size();
+    std::vector<double> mat_secs((size_t)count);
+    int rep_index = 0;
+    auto call = [&]() {
+#if defined(__AVX2__)
+      if (variant == "simd") gemm_batched_avx2(Ap.data(), Bp.data(), Cp.data(), shapes.data(), count, mat_secs.data());
+      else                   gemm_batched_scalar(Ap.data(), Bp.data(), Cp.data(), shapes.data(), count, mat_secs.data());
+#else
+      gemm_batched_scalar(Ap.data(), Bp.data(), Cp.data(), shapes.data(), count, mat_secs.data());
+#endif
+      if (rep_index >= pol.warmup) op_times.insert(op_times.end(), mat_secs.begin(), mat_secs.end());
+    };
+    run_reps(pol, reps, perf, samples, call, [&](int i) { rep_index = i; });
+    seconds = take_samples();
     gflops = flops / std::max(1e-12, seconds) / 1e9;
 
-    bytes_est = 4.0 * ((double)m * k + (double)k * n + 2.0 * (double)m * n);
+    bytes_est = 4.0 * ((double)a_total + (double)b_total + (double)c_total);
     ai = flops / std::max(1.0, bytes_est);
     bw_gbps = (bytes_est / std::max(1e-12, seconds)) / 1e9;
 
-    free_aligned(A); free_aligned(B); free_aligned(C);
-  } else if (kernel == "spmm_csr") {
+    release_input(cache, A); release_input(cache, B); free_aligned(C);
+  } else if (kernel == "spmm_csr" || kernel == "spmm_csc" || kernel == "spmm_ell" ||
+             kernel == "spmm_sell" || kernel == "spmm_bsr" || kernel == "spmm_auto") {
+    const std::string fmt = kernel.substr(5);
+    const int reps = 20;
+    if ((fmt != "csr" || dtype != DType::F32) && layoutB != LayoutB::RowMajor) {
+      std::cerr << "--kernel " << kernel << " requires --layoutB row\n";
+      return 2;
+    }
+    // The dispatcher runs (and calibrates) the widest kernels compiled in.
+    if (fmt == "auto" && variant != "simd") {
+      std::cerr << "--kernel spmm_auto only supports --variant simd\n";
+      return 2;
+    }
+
+    // Calibration is per machine, not per matrix: kept out of conv_seconds.
+    SpmmCostModel model;
+    model.sell_c = sell_c;
+    model.sell_sigma = sell_sigma;
+    model.bsr_block = bsr_block;
+    if (fmt == "auto" && auto_calibrate) {
+      model = calibrate_spmm_cost_model(n, seed);
+      model.sell_c = sell_c; model.sell_sigma = sell_sigma; model.bsr_block = bsr_block;
+    }
+
+    // conv_seconds = CSR generation + conversion into the benchmarked format
+    // (spmm_auto: + structure analysis and conversion for the chosen path)
+    // (bf16/f16/i8: + conversion of the values and B to the storage type)
+    // (--matrix: load time; binary CSR is mmap'd, so this is mostly page-table setup)
     double t0c = now_seconds();
-    CSR A = make_random_csr(m, k, density, pattern, seed);
+    CSR A;
+    if (!input_csr(A)) return 2;
+    if (reorder != Reorder::None && layoutB != LayoutB::RowMajor) {
+      std::cerr << "--reorder requires --layoutB row\n";
+      return 2;
+    }
+    if (!reorder_csr(A)) return 2;
+    if (panel_k != 0 && (fmt != "csr" || dtype != DType::F32 || layoutB != LayoutB::RowMajor)) {
+      std::cerr << "--panel_k requires --kernel spmm_csr, --dtype f32 and --layoutB row\n";
+      return 2;
+    }
+    if (panel_k < 0) panel_k = csr_panel_k(A.k, std::min(jblock, n), topo.l2_bytes);
+    CSC Acsc; ELL Aell; SELL Asell; BSR Absr;
+    SpmmAutoPlan plan;
+    if (fmt == "auto")      plan = spmm_auto_plan(A, n, model, reps, true);
+    else if (fmt == "csc")  Acsc = csr_to_csc(A);
+    else if (fmt == "ell")  Aell = csr_to_ell(A);
+    else if (fmt == "sell") Asell = csr_to_sell(A, sell_c, sell_sigma);
+    else if (fmt == "bsr")  Absr = csr_to_bsr(A, bsr_block);
     double t1c = now_seconds();
     conv_seconds = t1c - t0c;
 
     nnz = csr_nnz(A);
 
-    AlignedBuffer B = make_aligned_f32((size_t)k * (size_t)n, 64);
+    if (!save_csr_path.empty()) {
+      std::string err;
+      if (!save_csr_binary(save_csr_path, A, err)) {
+        std::cerr << "--save_csr " << save_csr_path << ": " << err << "\n";
+        return 2;
+      }
+    }
+
+    AlignedBuffer B = random_input(cache, (size_t)k * (size_t)n, seed ^ 0x1234u);
     AlignedBuffer C = make_aligned_f32((size_t)m * (size_t)n, 64);
-    fill_random(B.ptr, B.count, seed ^ 0x1234u);
+    page_kib = buffer_page_kib(B.ptr, B.count * sizeof(float));
+    first_touch(C.ptr, C.count * sizeof(float));
+    if (reorder != Reorder::None) {
+      // B <- Q B, charged to conv_seconds like the matrix permutation
+      AlignedBuffer Bp = make_aligned_f32(B.count, 64);
+      first_touch(Bp.ptr, Bp.count * sizeof(float));
+      double t0p = now_seconds();
+      permute_rows(B.ptr, Bp.ptr, col_perm, n);
+      conv_seconds += now_seconds() - t0p;
+      release_input(cache, B);
+      B = Bp;
+    }
+    // beta != 0 reads C: every call starts from the same C0, restored untimed.
+    AlignedBuffer C0;
+    if (epi.beta != 0.0f) {
+      fill_random(C.ptr, C.count, seed ^ 0xC0C0u);
+      C0 = make_aligned_f32(C.count, 64);
+      std::memcpy(C0.ptr, C.ptr, C.count * sizeof(float));
+    }
+    auto restore_c = [&](int) {
+      if (C0.ptr) std::memcpy(C.ptr, C0.ptr, C.count * sizeof(float));
+    };
+    attach_bias();
 
-    const int reps = 20;
-    for (int r = 0; r < reps; r++) {
-      double t0 = now_seconds();
+    auto run_once = [&]() {
 #if defined(__AVX2__)
-      if (variant == "simd") spmm_csr_avx2(A, B.ptr, C.ptr, n, jblock, layoutB);
-      else                   spmm_csr_scalar(A, B.ptr, C.ptr, n, jblock, layoutB);
+      const bool simd = (variant == "simd");
 #else
-      spmm_csr_scalar(A, B.ptr, C.ptr, n, jblock, layoutB);
+      const bool simd = false;
 #endif
-      double t1 = now_seconds();
-      call_times.push_back(t1 - t0);
-    }
+      if (fmt == "auto") {
+        spmm_auto_run(plan, A, B.ptr, C.ptr, n, jblock);
+      } else if (fmt == "csc") {
+#if defined(__AVX2__)
+        if (simd) { spmm_csc_avx2(Acsc, B.ptr, C.ptr, n, jblock); return; }
+#endif
+        spmm_csc_scalar(Acsc, B.ptr, C.ptr, n, jblock);
+      } else if (fmt == "ell") {
+#if defined(__AVX2__)
+        if (simd) { spmm_ell_avx2(Aell, B.ptr, C.ptr, n, jblock, epi); return; }
+#endif
+        spmm_ell_scalar(Aell, B.ptr, C.ptr, n, jblock, epi);
+      } else if (fmt == "sell") {
+#if defined(__AVX2__)
+        if (simd) { spmm_sell_avx2(Asell, B.ptr, C.ptr, n, jblock, epi); return; }
+#endif
+        spmm_sell_scalar(Asell, B.ptr, C.ptr, n, jblock, epi);
+      } else if (fmt == "bsr") {
+#if defined(__AVX2__)
+        if (simd) { spmm_bsr_avx2(Absr, B.ptr, C.ptr, n, jblock, epi); return; }
+#endif
+        spmm_bsr_scalar(Absr, B.ptr, C.ptr, n, jblock, epi);
+      } else if (panel_k > 0) {
+#if defined(__AVX2__)
+        if (simd) { spmm_csr_panel_avx2(A, B.ptr, C.ptr, n, jblock, panel_k, epi); return; }
+#endif
+        spmm_csr_panel_scalar(A, B.ptr, C.ptr, n, jblock, panel_k, epi);
+      } else {
+#if defined(__AVX2__)
+        if (simd) { spmm_csr_avx2(A, B.ptr, C.ptr, n, jblock, layoutB, epi); return; }
+#endif
+        spmm_csr_scalar(A, B.ptr, C.ptr, n, jblock, layoutB, epi);
+      }
+    };
 
-    std::vector<double> tmp = call_times;
-    std::sort(tmp.begin(), tmp.end());
-    seconds = tmp[tmp.size() / 2];
+    const bool simd = (variant == "simd");
+    if (dtype == DType::BF16)     conv_seconds += bench_spmm_lp<bf16_t, float>(A, B, n, jblock, simd, pol, reps, perf, samples);
+    else if (dtype == DType::F16) conv_seconds += bench_spmm_lp<fp16_t, float>(A, B, n, jblock, simd, pol, reps, perf, samples);
+    else if (dtype == DType::I8)  conv_seconds += bench_spmm_lp<int8_t, int32_t>(A, B, n, jblock, simd, pol, reps, perf, samples);
+    if (dtype == DType::F32) run_reps(pol, reps, perf, samples, run_once, restore_c);
+    seconds = take_samples();
 
+    // flops count useful work only; padding shows up as lower gflops
     const double flops = 2.0 * (double)nnz * (double)n;
     gflops = flops / std::max(1e-12, seconds) / 1e9;
 
-    bytes_est = (double)nnz * 8.0 + (double)nnz * (double)n * 4.0 + (double)m * (double)n * 8.0;
+    // bytes: stored A entries (value + index, padding included), one B row
+    // per stored entry (per block column for BSR), C read+write.
+    double stored = (double)nnz;
+    double b_rows = (double)nnz;
+    double a_bytes = 0.0;
+    if (fmt == "ell")       stored = b_rows = (double)ell_stored(Aell);
+    else if (fmt == "sell") stored = b_rows = (double)sell_stored(Asell);
+    if (fmt == "bsr") {
+      double blocks = (double)Absr.bcolidx.size();
+      a_bytes = (double)bsr_stored(Absr) * 4.0 + blocks * 4.0;
+      b_rows = blocks * (double)Absr.bs;
+    } else {
+      a_bytes = stored * (4.0 + elem_bytes);
+    }
+    bytes_est = a_bytes + b_rows * (double)n * elem_bytes + (double)m * (double)n * 8.0;
+    ai = flops / std::max(1.0, bytes_est);
+    bw_gbps = (bytes_est / std::max(1e-12, seconds)) / 1e9;
+
+    free_spmm_auto_plan(plan);
+    if (C0.ptr) free_aligned(C0);
+    release_input(cache, B); free_aligned(C);
+  } else if (kernel == "spmv") {
+    // y = A x, iters times. Square A feeds y back as the next x (rescaled to
+    // max |x| = 1 outside the timed call, so values neither blow up nor go
+    // denormal), like the matvec in a power or Krylov iteration.
+    double t0c = now_seconds();
+    CSR A;
+    if (!input_csr(A)) return 2;
+    if (!reorder_csr(A)) return 2;
+    const SpmvPlan plan = make_spmv_plan(A, team.threads);
+    conv_seconds = now_seconds() - t0c;
+    nnz = csr_nnz(A);
+    n = 1;
+
+    AlignedBuffer x = make_aligned_f32((size_t)std::max(m, k), 64);
+    AlignedBuffer y = make_aligned_f32((size_t)std::max(m, k), 64);
+    first_touch(x.ptr, x.count * sizeof(float));
+    page_kib = buffer_page_kib(x.ptr, x.count * sizeof(float));
+    first_touch(y.ptr, y.count * sizeof(float));
+    fill_random(x.ptr, (size_t)k, seed ^ 0x5A5Au);
+    if (reorder != Reorder::None) {
+      double t0p = now_seconds();
+      permute_rows(x.ptr, y.ptr, col_perm, 1);
+      std::copy(y.ptr, y.ptr + k, x.ptr);
+      conv_seconds += now_seconds() - t0p;
+    }
+    const bool feedback = (m == k);
+
+    auto call = [&]() {
+#if defined(__AVX2__)
+      if (variant == "simd") spmv_csr_avx2(A, plan, x.ptr, y.ptr);
+      else                   spmv_csr_scalar(A, plan, x.ptr, y.ptr);
+#else
+      spmv_csr_scalar(A, plan, x.ptr, y.ptr);
+#endif
+    };
+    auto feed = [&](int it) {
+      if (!feedback || it == 0) return;
+      float mx = 0.0f;
+      for (int i = 0; i < m; i++) mx = std::max(mx, std::fabs(y.ptr[i]));
+      const float s = mx > 0.0f ? 1.0f / mx : 1.0f;
+      for (int i = 0; i < m; i++) x.ptr[i] = y.ptr[i] * s;
+    };
+    run_reps(pol, pol.reps > 0 ? pol.reps : iters, perf, samples, call, feed);
+    seconds = take_samples();
+
+    gflops = 2.0 * (double)nnz / std::max(1e-12, seconds) / 1e9;
+    // bytes: values + colidx + rowptr, x once (cache-resident reuse), y written
+    bytes_est = (double)nnz * 8.0 + ((double)m + 1.0) * 4.0 + (double)k * 4.0 + (double)m * 4.0;
+    ai = 2.0 * (double)nnz / std::max(1.0, bytes_est);
+    bw_gbps = (bytes_est / std::max(1e-12, seconds)) / 1e9;
+
+    free_aligned(x); free_aligned(y);
+  } else if (kernel == "spgemm") {
+    // C = A * B with B = A when A is square (A^2, two-hop neighbourhoods),
+    // else a random k x n CSR of the same density and pattern.
+    if (!parse_spgemm_accum(accum_s, accum)) {
+      std::cerr << "Unknown --accum " << accum_s << "\n";
+      return 2;
+    }
+    double t0c = now_seconds();
+    CSR A;
+    if (!input_csr(A)) return 2;
+    const bool square = (A.m == A.k);
+    CSR Bown;
+    if (!square) Bown = make_random_csr(k, n, density, pattern, seed ^ 0xB0B0u);
+    const CSR& B = square ? A : Bown;
+    n = B.k;
+    conv_seconds = now_seconds() - t0c;
+
+    const int reps = 10;
+    size_t nnz_c = 0;
+    // freeing C is part of the timed call
+    auto call = [&]() {
+      CSR C = spgemm_csr(A, B, accum);
+      nnz_c = csr_nnz(C);
+    };
+    run_reps(pol, reps, perf, samples, call, [](int) {});
+    seconds = take_samples();
+
+    // nnz is the output's; flops are the multiply-adds actually performed.
+    nnz = nnz_c;
+    const double products = (double)spgemm_products(A, B);
+    gflops = 2.0 * products / std::max(1e-12, seconds) / 1e9;
+    nnz_per_s = (double)nnz_c / std::max(1e-12, seconds);
+
+    // bytes: A entries, one B entry per product, C written once (+ row pointers)
+    bytes_est = (double)csr_nnz(A) * 8.0 + products * 8.0 + (double)nnz_c * 8.0 +
+                4.0 * (2.0 * (double)m + (double)k);
+    ai = 2.0 * products / std::max(1.0, bytes_est);
+    bw_gbps = (bytes_est / std::max(1e-12, seconds)) / 1e9;
+  } else if (kernel == "gemm_ooc" || kernel == "spmm_ooc") {
+    // C = A B with A, B and C in files; only --ooc_mib of tiles is resident.
+    // conv_seconds covers generating operand files that do not exist yet;
+    // bytes_est is the file traffic of one call.
+    OocIo io = OocIo::Pread;
+    if (!parse_ooc_io(ooc_io_s, io)) {
+      std::cerr << "Unknown --ooc_io " << ooc_io_s << "\n";
+      return 2;
+    }
+    if (variant != "simd" && variant != "scalar") {
+      std::cerr << "--kernel " << kernel << " needs --variant simd or scalar\n";
+      return 2;
+    }
+    ooc = true;
+    const bool sparse = (kernel == "spmm_ooc");
+    const bool simd = (variant == "simd");
+    const size_t budget = (size_t)ooc_mib << 20;
+    std::string err;
+    // Checked before any file is generated (spmm again once A is loaded).
+    OocPlan plan;
+    auto planned = [&]() {
+      if (sparse ? plan_spmm_ooc(m, k, n, budget, plan, err) : plan_gemm_ooc(m, k, n, budget, plan, err)) {
+        return true;
+      }
+      std::cerr << kernel << ": " << err << "\n";
+      return false;
+    };
+    if (!planned()) return 2;
+
+    double t0c = now_seconds();
+    CSR As;
+    if (sparse) {
+      // A is a binary CSR in ooc_dir (or --matrix), mapped rather than loaded
+      if (!matrix_path.empty()) {
+        if (!input_csr(As)) return 2;
+      } else {
+        std::ostringstream ap;
+        ap << ooc_dir << "/a2_ooc_A_" << m << "x" << k << "_" << density << "_" << pattern << "_"
+           << seed << ".a2csr";
+        if (!file_exists(ap.str()) &&
+            !save_csr_binary(ap.str(), make_random_csr(m, k, density, pattern, seed), err)) {
+          std::cerr << "spmm_ooc: " << err << "\n";
+          return 2;
+        }
+        if (!load_csr_binary(ap.str(), As, err)) {
+          std::cerr << "spmm_ooc: " << err << "\n";
+          return 2;
+        }
+        m = As.m;
+        k = As.k;
+      }
+      nnz = csr_nnz(As);
+      if (!planned()) return 2;
+    }
+    // Kept operand files are reused when their header matches.
+    auto operand = [&](const char* name, int rows, int cols, uint64_t s, DenseFile& f) -> bool {
+      std::ostringstream fp;
+      fp << ooc_dir << "/a2_ooc_" << name << "_" << rows << "x" << cols << "_" << s << ".f32";
+      const std::string path = fp.str();
+      if (file_exists(path) && open_dense_file(path, false, io == OocIo::Mmap, f, err) &&
+          f.rows == rows && f.cols == cols) {
+        return true;
+      }
+      close_dense_file(f);
+      if (!create_dense_file(path, rows, cols, true, s, err) ||
+          !open_dense_file(path, false, io == OocIo::Mmap, f, err)) {
+        std::cerr << kernel << ": " << err << "\n";
+        return false;
+      }
+      return true;
+    };
+    DenseFile Af, Bf, Cf;
+    if ((!sparse && !operand("A", m, k, seed ^ 0xA5A5u, Af)) || !operand("B", k, n, seed ^ 0x5A5Au, Bf)) {
+      close_dense_file(Af);
+      return 2;
+    }
+    std::ostringstream cp;
+    cp << ooc_dir << "/a2_ooc_C_" << m << "x" << n << "_" << ::getpid() << ".f32";
+    const std::string c_path = cp.str();
+    if (!create_dense_file(c_path, m, n, false, 0, err) || !open_dense_file(c_path, true, false, Cf, err)) {
+      std::cerr << kernel << ": " << err << "\n";
+      close_dense_file(Af);
+      close_dense_file(Bf);
+      return 2;
+    }
+    conv_seconds = now_seconds() - t0c;
+
+    bool ok = true;
+    bool timed = false;
+    int timed_calls = 0;
+    OocStats st;
+    auto call = [&]() {
+      if (sparse) ok = spmm_ooc(As, Bf, Cf, budget, simd, jblock, st, err) && ok;
+      else        ok = gemm_ooc(Af, Bf, Cf, budget, simd, tileM, tileK, tileN, st, err) && ok;
+      if (!timed) return;
+      timed_calls++;
+      ooc_avg.io_seconds += st.io_seconds;
+      ooc_avg.wait_seconds += st.wait_seconds;
+      ooc_avg.compute_seconds += st.compute_seconds;
+      ooc_avg.bytes += st.bytes;
+    };
+    auto prep = [&](int i) {
+      timed = (i >= pol.warmup);
+      if (!ooc_cold) return;
+      drop_dense_cache(Af);
+      drop_dense_cache(Bf);
+    };
+    run_reps(pol, 3, perf, samples, call, prep);
+    seconds = take_samples();
+
+    const double calls = (double)std::max(1, timed_calls);
+    ooc_avg.io_seconds /= calls;
+    ooc_avg.wait_seconds /= calls;
+    ooc_avg.compute_seconds /= calls;
+    ooc_avg.bytes /= calls;
+    std::ostringstream ts;
+    ts << plan.mb << "x" << plan.kb << "x" << plan.nb;
+    ooc_tile = ts.str();
+
+    const double flops = sparse ? 2.0 * (double)nnz * (double)n : 2.0 * (double)m * (double)k * (double)n;
+    gflops = flops / std::max(1e-12, seconds) / 1e9;
+    bytes_est = ooc_avg.bytes;
     ai = flops / std::max(1.0, bytes_est);
     bw_gbps = (bytes_est / std::max(1e-12, seconds)) / 1e9;
 
-    free_aligned(B); free_aligned(C);
+    // Spot check against the files; a wrong product is an error, not a row.
+    const double worst = ok ? (sparse ? spmm_ooc_check(As, Bf, Cf, seed)
+                                      : gemm_ooc_check(Af, Bf, Cf, seed)) : -1.0;
+    close_dense_file(Af);
+    close_dense_file(Bf);
+    close_dense_file(Cf);
+    std::remove(c_path.c_str());
+    if (!ok) {
+      std::cerr << kernel << ": " << err << "\n";
+      return 2;
+    }
+    if (worst < 0.0 || worst > 1.0) {
+      std::cerr << kernel << ": spot check failed (error " << worst << " x tolerance)\n";
+      return 2;
+    }
+    std::cerr << "[ooc] " << kernel << " " << variant << " " << ooc_io_s << ": compute "
+              << ooc_avg.compute_seconds << " s, I/O " << ooc_avg.io_seconds << " s, exposed I/O "
+              << ooc_avg.wait_seconds << " s, " << ooc_overlap_pct(ooc_avg) << "% of I/O hidden ("
+              << plan.steps << " steps of " << ooc_tile << ")\n";
   } else {
     std::cerr << "Unknown --kernel\n";
     return 2;
   }
 
-  double p50 = 0.0, p95 = 0.0, p99 = 0.0;
-  percentile_us(call_times, p50, p95, p99);  // from a2_utils.*
-
-  const double cycles_est = seconds * (freq_mhz * 1e6);
-  const double cpnz = (nnz > 0) ? (cycles_est / (double)nnz) : 0.0;
+  pc = perf_read(perf);
+  if (roofline) {
+    // Measured after the timed calls so the kernel sees a quiet machine; the
+    // DRAM ceiling is the best regular-store op (STREAM byte counting, like
+    // bytes_est).
+    if (peak_gflops <= 0.0) peak_gflops = fma_peak_gflops(5);
+    if (peak_gbps <= 0.0) {
+      StreamArrays sa = make_stream_arrays(dram_n);
+      for (StreamOp op : {StreamOp::Copy, StreamOp::Scale, StreamOp::Add, StreamOp::Triad}) {
+        peak_gbps = std::max(peak_gbps, run_stream(op, sa, 5, false).best_gbps);
+      }
+      free_stream_arrays(sa);
+    }
+  }
+  emit_row();
+  return 0;
+}
 
-  std::cout
-    << kernel << "," << variant << "," << layoutB_s << "," << pattern << ","
-    << m << "," << k << "," << n << ","
-    << density << ","
-    << threads << ","
-    << tileM << "," << tileN << "," << tileK << "," << jblock << ","
-    << seed << "," << run_id << ","
-    << seconds << "," << gflops << ","
-    << nnz << "," << cpnz << ","
-    << ai << "," << bytes_est << "," << bw_gbps << ","
-    << p50 << "," << p95 << "," << p99 << ","
-    << conv_seconds << ","
-    << freq_mhz << "," << cycles_est << ","
-    << perf_task_clock_ms << "," << perf_context_switches << ","
-    << perf_cpu_migrations << "," << perf_page_faults
-    << "\n";
+// --sweep spec.json: every config of the spec in this process, one CSV row
+// each, flushed as it completes. Random operands and CSRs are built once per
+// shape and reused across thread counts and variants (so conv_seconds then
+// excludes input generation); --sweep_cache_mib bounds what is kept.
+static int run_sweep(const std::string& path, const char* prog, size_t cap_mib) {
+  SweepSpec spec;
+  std::string err;
+  if (!load_sweep_spec(path, spec, err)) {
+    std::cerr << "--sweep " << path << ": " << err << "\n";
+    return 2;
+  }
+  if (spec.header) print_header();
+  std::cout.flush();
 
-  return 0;
+  SweepCache cache;
+  cache.cap_bytes = cap_mib << 20;
+  int failed = 0;
+  for (size_t c = 0; c < spec.configs.size(); c++) {
+    std::vector<char*> args;
+    args.push_back(const_cast<char*>(prog));
+    for (auto& a : spec.configs[c]) args.push_back(const_cast<char*>(a.c_str()));
+    args.push_back(nullptr);
+    cache.epoch++;
+    if (run_config((int)args.size() - 1, args.data(), &cache) != 0) {
+      std::cerr << "--sweep: config " << c << " failed, continuing\n";
+      failed++;
+    }
+    std::cout.flush();
+  }
+  cache.clear();
+  return failed ? 1 : 0;
 }
 
+int main(int argc, char** argv) {
+  const std::string sweep = get_arg(argc, argv, "--sweep", "");
+  if (!sweep.empty()) {
+    const int cap_mib = get_arg_i(argc, argv, "--sweep_cache_mib", 8192);
+    return run_sweep(sweep, argv[0], (size_t)std::max(0, cap_mib));
+  }
+  return run_config(argc, argv, nullptr);
+}
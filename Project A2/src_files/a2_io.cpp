@@ -0,0 +1,633 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+#include "a2_io.h"
+
+namespace {
+
+struct Mapping {
+  void* addr = nullptr;
+  size_t len = 0;
+  ~Mapping() { if (addr) munmap(addr, len); }
+};
+
+// Private mapping: readable everywhere, writable copy-on-write so CSR code
+// that touches the arrays never modifies the file.
+std::shared_ptr<Mapping> map_file(const std::string& path, std::string& err) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) { err = "cannot open " + path; return nullptr; }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    err = "cannot stat (or empty) " + path;
+    return nullptr;
+  }
+  auto m = std::make_shared<Mapping>();
+  m->len = (size_t)st.st_size;
+  m->addr = ::mmap(nullptr, m->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m->addr == MAP_FAILED) {
+    m->addr = nullptr;
+    err = "mmap failed for " + path;
+    return nullptr;
+  }
+  return m;
+}
+
+struct CsrBinHeader {
+  char magic[8];
+  int64_t m;
+  int64_t k;
+  int64_t nnz;
+  int64_t off_rowptr;
+  int64_t off_colidx;
+  int64_t off_values;
+  int64_t reserved;
+};
+static_assert(sizeof(CsrBinHeader) == 64, "binary CSR header must be 64 bytes");
+
+const char kCsrMagic[8] = {'A', '2', 'C', 'S', 'R', '0', '0', '1'};
+
+size_t align64(size_t x) { return (x + 63) & ~(size_t)63; }
+
+// A section of count elements at off must be non-negative, element-aligned
+// and lie inside the file; written so that off + bytes cannot overflow.
+bool section_fits(int64_t off, int64_t count, size_t elem, size_t len) {
+  if (off < 0 || count < 0 || (uint64_t)off % elem != 0) return false;
+  if ((uint64_t)count > len / elem) return false;
+  const size_t bytes = (size_t)count * elem;
+  return bytes <= len && (uint64_t)off <= len - bytes;
+}
+
+// One O(nnz) pass over the mapped arrays: rowptr non-decreasing within
+// [0, nnz], columns in [0, k) and sorted within each row. The row-panel and
+// out-of-core SpMM kernels index B by column and rely on sorted rows.
+bool csr_arrays_valid(const int* rowptr, const int* colidx, int m, int k, int nnz, std::string& err) {
+  if (rowptr[0] != 0 || rowptr[m] != nnz) { err = "binary CSR rowptr does not match nnz"; return false; }
+  int bad_ptr = 0, bad_col = 0, unsorted = 0;
+#pragma omp parallel for schedule(static) reduction(|:bad_ptr, bad_col, unsorted)
+  for (int i = 0; i < m; i++) {
+    const int lo = rowptr[i], hi = rowptr[i + 1];
+    if (lo > hi || lo < 0 || hi > nnz) { bad_ptr = 1; continue; }
+    for (int p = lo; p < hi; p++) {
+      const int c = colidx[p];
+      if (c < 0 || c >= k) bad_col = 1;
+      else if (p > lo && c < colidx[p - 1]) unsorted = 1;
+    }
+  }
+  if (bad_ptr) err = "binary CSR rowptr is not non-decreasing within [0, nnz]";
+  else if (bad_col) err = "binary CSR column index out of range";
+  else if (unsorted) err = "binary CSR columns are not sorted within a row";
+  return !(bad_ptr | bad_col | unsorted);
+}
+
+// ---------------------------------------------------------------------------
+// Matrix Market text parsing
+// ---------------------------------------------------------------------------
+
+const char* skip_ws(const char* p, const char* e) {
+  while (p < e && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  return p;
+}
+
+const char* next_line(const char* p, const char* e) {
+  const char* nl = (const char*)std::memchr(p, '\n', (size_t)(e - p));
+  return nl ? nl + 1 : e;
+}
+
+// Entry lines are non-blank and not comments.
+bool is_entry_line(const char* p, const char* e) {
+  p = skip_ws(p, e);
+  return p < e && *p != '\n' && *p != '%';
+}
+
+template <typename T>
+bool parse_num(const char*& p, const char* e, T& out) {
+  p = skip_ws(p, e);
+  if (p < e && *p == '+') p++;
+  auto r = std::from_chars(p, e, out);
+  if (r.ec != std::errc()) return false;
+  p = r.ptr;
+  return true;
+}
+
+std::string lower(std::string s) {
+  for (auto& c : s) c = (char)std::tolower((unsigned char)c);
+  return s;
+}
+
+}  // namespace
+
+bool load_matrix_market(const std::string& path, CSR& out, std::string& err) {
+  auto map = map_file(path, err);
+  if (!map) return false;
+  madvise(map->addr, map->len, MADV_SEQUENTIAL);
+
+  const char* base = (const char*)map->addr;
+  const char* end = base + map->len;
+
+  // Banner: %%MatrixMarket matrix coordinate <field> <symmetry>
+  const char* p = base;
+  const char* l1 = next_line(p, end);
+  std::string banner = lower(std::string(p, l1));
+  if (banner.rfind("%%matrixmarket", 0) != 0) { err = "missing %%MatrixMarket banner"; return false; }
+  if (banner.find("coordinate") == std::string::npos) { err = "only coordinate Matrix Market is supported"; return false; }
+  if (banner.find("complex") != std::string::npos) { err = "complex Matrix Market is not supported"; return false; }
+  const bool pattern = banner.find("pattern") != std::string::npos;
+  const bool skew = banner.find("skew-symmetric") != std::string::npos;
+  const bool symmetric = skew || banner.find("symmetric") != std::string::npos ||
+                         banner.find("hermitian") != std::string::npos;
+
+  // Size line follows the comment block.
+  p = l1;
+  while (p < end && !is_entry_line(p, end)) p = next_line(p, end);
+  int64_t m = 0, k = 0, declared = 0;
+  const char* q = p;
+  if (!parse_num(q, end, m) || !parse_num(q, end, k) || !parse_num(q, end, declared) ||
+      m <= 0 || k <= 0 || declared < 0 || m > INT_MAX || k > INT_MAX) {
+    err = "bad Matrix Market size line";
+    return false;
+  }
+  const char* data = next_line(p, end);
+
+  // Split the data region into per-thread chunks on line boundaries.
+  const int T = std::max(1, omp_get_max_threads());
+  std::vector<const char*> cut((size_t)T + 1);
+  cut[0] = data;
+  cut[(size_t)T] = end;
+  for (int t = 1; t < T; t++) {
+    const char* c = data + (size_t)(end - data) * (size_t)t / (size_t)T;
+    if (c > data && c[-1] != '\n') c = next_line(c, end);
+    cut[(size_t)t] = std::max(c, cut[(size_t)t - 1]);
+  }
+
+  // Pass 1: count entry lines per chunk.
+  std::vector<size_t> off((size_t)T + 1, 0);
+#pragma omp parallel for schedule(static, 1) num_threads(T)
+  for (int t = 0; t < T; t++) {
+    size_t c = 0;
+    for (const char* l = cut[(size_t)t]; l < cut[(size_t)t + 1]; l = next_line(l, end)) {
+      if (is_entry_line(l, end)) c++;
+    }
+    off[(size_t)t + 1] = c;
+  }
+  for (int t = 0; t < T; t++) off[(size_t)t + 1] += off[(size_t)t];
+  const size_t count = off[(size_t)T];
+  if ((int64_t)count != declared) {
+    err = "Matrix Market entry count " + std::to_string(count) + " != declared " + std::to_string(declared);
+    return false;
+  }
+
+  // csr_from_coo counts entries in int, before duplicates are merged.
+  if (count > (size_t)INT_MAX) { err = "Matrix Market entry count exceeds int"; return false; }
+
+  // Pass 2: parse into triplets at each chunk's offset.
+  std::vector<int> rows(count), cols(count);
+  std::vector<float> vals(count, 1.0f);
+  int bad = 0;
+#pragma omp parallel for schedule(static, 1) num_threads(T) reduction(|:bad)
+  for (int t = 0; t < T; t++) {
+    size_t d = off[(size_t)t];
+    for (const char* l = cut[(size_t)t]; l < cut[(size_t)t + 1] && !bad; l = next_line(l, end)) {
+      if (!is_entry_line(l, end)) continue;
+      const char* s = l;
+      int r = 0, c = 0;
+      if (!parse_num(s, end, r) || !parse_num(s, end, c) || r < 1 || r > m || c < 1 || c > k) { bad = 1; break; }
+      if (!pattern) {
+        float v = 0.0f;
+        if (!parse_num(s, end, v)) { bad = 1; break; }
+        vals[d] = v;
+      }
+      rows[d] = r - 1;
+      cols[d] = c - 1;
+      d++;
+    }
+  }
+  if (bad) { err = "malformed Matrix Market entry"; return false; }
+
+  // Symmetric storage lists one triangle: mirror the off-diagonal entries.
+  if (symmetric) {
+    size_t extra = 0;
+    for (size_t t = 0; t < count; t++) extra += (rows[t] != cols[t]);
+    if (count + extra > (size_t)INT_MAX) { err = "mirrored Matrix Market entry count exceeds int"; return false; }
+    rows.resize(count + extra);
+    cols.resize(count + extra);
+    vals.resize(count + extra);
+    size_t d = count;
+    for (size_t t = 0; t < count; t++) {
+      if (rows[t] == cols[t]) continue;
+      rows[d] = cols[t];
+      cols[d] = rows[t];
+      vals[d] = skew ? -vals[t] : vals[t];
+      d++;
+    }
+  }
+
+  out = csr_from_coo((int)m, (int)k, rows.size(), rows.data(), cols.data(), vals.data());
+  return true;
+}
+
+bool save_csr_binary(const std::string& path, const CSR& A, std::string& err) {
+  CsrBinHeader h{};
+  std::memcpy(h.magic, kCsrMagic, sizeof(h.magic));
+  h.m = A.m;
+  h.k = A.k;
+  h.nnz = (int64_t)A.values.size();
+  h.off_rowptr = (int64_t)align64(sizeof(CsrBinHeader));
+  h.off_colidx = (int64_t)align64((size_t)h.off_rowptr + ((size_t)A.m + 1) * sizeof(int));
+  h.off_values = (int64_t)align64((size_t)h.off_colidx + (size_t)h.nnz * sizeof(int));
+
+  FILE* f = std::fopen(path.c_str(), "wb");
+  if (!f) { err = "cannot create " + path; return false; }
+  static const char zeros[64] = {};
+  auto write_at = [&](int64_t off, const void* p, size_t bytes) {
+    long cur = std::ftell(f);
+    if (cur < off) std::fwrite(zeros, 1, (size_t)(off - cur), f);
+    return bytes == 0 || std::fwrite(p, 1, bytes, f) == bytes;
+  };
+  bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+            write_at(h.off_rowptr, A.rowptr.data(), A.rowptr.size() * sizeof(int)) &&
+            write_at(h.off_colidx, A.colidx.data(), A.colidx.size() * sizeof(int)) &&
+            write_at(h.off_values, A.values.data(), A.values.size() * sizeof(float));
+  ok = (std::fclose(f) == 0) && ok;
+  if (!ok) err = "write failed for " + path;
+  return ok;
+}
+
+bool load_csr_binary(const std::string& path, CSR& out, std::string& err) {
+  auto map = map_file(path, err);
+  if (!map) return false;
+  if (map->len < sizeof(CsrBinHeader)) { err = "file too small for binary CSR"; return false; }
+
+  CsrBinHeader h;
+  std::memcpy(&h, map->addr, sizeof(h));
+  if (std::memcmp(h.magic, kCsrMagic, sizeof(h.magic)) != 0) { err = "bad binary CSR magic"; return false; }
+  if (h.m < 0 || h.k < 0 || h.nnz < 0 || h.m >= INT_MAX || h.k > INT_MAX || h.nnz > INT_MAX ||
+      !section_fits(h.off_rowptr, h.m + 1, sizeof(int), map->len) ||
+      !section_fits(h.off_colidx, h.nnz, sizeof(int), map->len) ||
+      !section_fits(h.off_values, h.nnz, sizeof(float), map->len)) {
+    err = "corrupt binary CSR header";
+    return false;
+  }
+
+  char* base = (char*)map->addr;
+  int* rowptr = (int*)(base + h.off_rowptr);
+  int* colidx = (int*)(base + h.off_colidx);
+  if (!csr_arrays_valid(rowptr, colidx, (int)h.m, (int)h.k, (int)h.nnz, err)) return false;
+
+  out = CSR();
+  out.m = (int)h.m;
+  out.k = (int)h.k;
+  out.rowptr.view(rowptr, (size_t)h.m + 1, map);
+  out.colidx.view(colidx, (size_t)h.nnz, map);
+  out.values.view((float*)(base + h.off_values), (size_t)h.nnz, map);
+  return true;
+}
+
+bool load_matrix(const std::string& path, CSR& out, std::string& err) {
+  FILE* f = std::fopen(path.c_str(), "rb");
+  if (!f) { err = "cannot open " + path; return false; }
+  char magic[8] = {};
+  size_t got = std::fread(magic, 1, sizeof(magic), f);
+  std::fclose(f);
+  if (got == sizeof(magic) && std::memcmp(magic, kCsrMagic, sizeof(magic)) == 0) {
+    return load_csr_binary(path, out, err);
+  }
+  return load_matrix_market(path, out, err);
+}
+
+// ---------------------------------------------------------------------------
+// Dense float32 files (out-of-core operands)
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct DenseHeader {
+  char magic[8];
+  int64_t rows;
+  int64_t cols;
+  int64_t reserved[5];
+};
+static_assert(sizeof(DenseHeader) == 64, "dense file header must be 64 bytes");
+
+const char kDenseMagic[8] = {'A', '2', 'D', 'N', 'S', '0', '0', '1'};
+
+// pread/pwrite until done: both may transfer less than asked.
+bool pread_all(int fd, void* dst, size_t bytes, off_t off) {
+  char* p = (char*)dst;
+  while (bytes > 0) {
+    ssize_t r = ::pread(fd, p, bytes, off);
+    if (r <= 0) return false;
+    p += r; off += r; bytes -= (size_t)r;
+  }
+  return true;
+}
+
+bool pwrite_all(int fd, const void* src, size_t bytes, off_t off) {
+  const char* p = (const char*)src;
+  while (bytes > 0) {
+    ssize_t r = ::pwrite(fd, p, bytes, off);
+    if (r <= 0) return false;
+    p += r; off += r; bytes -= (size_t)r;
+  }
+  return true;
+}
+
+off_t dense_offset(const DenseFile& f, int64_t r, int64_t c) {
+  return (off_t)sizeof(DenseHeader) + (off_t)((r * f.cols + c) * (int64_t)sizeof(float));
+}
+
+}  // namespace
+
+bool create_dense_file(const std::string& path, int64_t rows, int64_t cols, bool fill,
+                       uint64_t seed, std::string& err) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) { err = "cannot create " + path; return false; }
+  DenseHeader h{};
+  std::memcpy(h.magic, kDenseMagic, sizeof(h.magic));
+  h.rows = rows;
+  h.cols = cols;
+  const size_t total = (size_t)rows * (size_t)cols;
+  bool ok = pwrite_all(fd, &h, sizeof(h), 0) &&
+            ::ftruncate(fd, (off_t)(sizeof(h) + total * sizeof(float))) == 0;
+  if (ok && fill) {
+    const size_t chunk = (size_t)4 << 20;
+    AlignedBuffer buf = make_aligned_f32(std::min(chunk, std::max<size_t>(total, 1)), 64);
+    for (size_t c = 0; ok && c * chunk < total; c++) {
+      const size_t len = std::min(chunk, total - c * chunk);
+      fill_random(buf.ptr, len, seed + c);
+      ok = pwrite_all(fd, buf.ptr, len * sizeof(float), (off_t)(sizeof(h) + c * chunk * sizeof(float)));
+    }
+    free_aligned(buf);
+  }
+  ok = (::close(fd) == 0) && ok;
+  if (!ok) err = "write failed for " + path;
+  return ok;
+}
+
+bool open_dense_file(const std::string& path, bool writable, bool mapped, DenseFile& out,
+                     std::string& err) {
+  out = DenseFile();
+  int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (fd < 0) { err = "cannot open " + path; return false; }
+  DenseHeader h;
+  struct stat st;
+  if (!pread_all(fd, &h, sizeof(h), 0) || std::memcmp(h.magic, kDenseMagic, sizeof(h.magic)) != 0 ||
+      h.rows < 0 || h.cols < 0 || ::fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(h) + (size_t)h.rows * (size_t)h.cols * sizeof(float)) {
+    ::close(fd);
+    err = "not a dense float32 file (or truncated): " + path;
+    return false;
+  }
+  out.fd = fd;
+  out.rows = h.rows;
+  out.cols = h.cols;
+  if (mapped && h.rows * h.cols > 0) {
+    out.map_len = (size_t)st.st_size;
+    void* p = ::mmap(nullptr, out.map_len, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      close_dense_file(out);
+      err = "mmap failed for " + path;
+      return false;
+    }
+    out.map_base = p;
+    out.map = (const float*)((const char*)p + sizeof(h));
+  }
+  return true;
+}
+
+void close_dense_file(DenseFile& f) {
+  if (f.map_base) ::munmap(f.map_base, f.map_len);
+  if (f.fd >= 0) ::close(f.fd);
+  f = DenseFile();
+}
+
+bool read_dense_block(const DenseFile& f, int64_t row0, int64_t rows, int64_t col0, int64_t cols,
+                      float* dst) {
+  if (rows <= 0 || cols <= 0) return true;
+  if (f.map) {
+    for (int64_t r = 0; r < rows; r++) {
+      std::memcpy(dst + r * cols, f.map + (row0 + r) * f.cols + col0, (size_t)cols * sizeof(float));
+    }
+    return true;
+  }
+  if (col0 == 0 && cols == f.cols) {
+    return pread_all(f.fd, dst, (size_t)(rows * cols) * sizeof(float), dense_offset(f, row0, 0));
+  }
+  for (int64_t r = 0; r < rows; r++) {
+    if (!pread_all(f.fd, dst + r * cols, (size_t)cols * sizeof(float), dense_offset(f, row0 + r, col0))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void drop_dense_cache(const DenseFile& f) {
+  if (f.map_base) ::madvise(f.map_base, f.map_len, MADV_DONTNEED);
+  if (f.fd >= 0) ::posix_fadvise(f.fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+bool write_dense_block(const DenseFile& f, int64_t row0, int64_t rows, int64_t col0, int64_t cols,
+                       const float* src) {
+  if (rows <= 0 || cols <= 0) return true;
+  if (col0 == 0 && cols == f.cols) {
+    return pwrite_all(f.fd, src, (size_t)(rows * cols) * sizeof(float), dense_offset(f, row0, 0));
+  }
+  for (int64_t r = 0; r < rows; r++) {
+    if (!pwrite_all(f.fd, src + r * cols, (size_t)cols * sizeof(float), dense_offset(f, row0 + r, col0))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Sweep spec (JSON subset: no \u escapes)
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct JVal {
+  enum Kind { Null, Bool, Num, Str, Arr, Obj } kind = Null;
+  std::string text;  // Str contents, Num as written, Bool "1"/"0"
+  std::vector<JVal> arr;
+  std::vector<std::pair<std::string, JVal>> obj;
+};
+
+struct JParser {
+  const char* b;
+  const char* p;
+  const char* e;
+  std::string err;
+
+  void ws() { while (p < e && std::isspace((unsigned char)*p)) p++; }
+  bool fail(const char* what) {
+    if (err.empty()) err = std::string(what) + " at byte " + std::to_string((long)(p - b));
+    return false;
+  }
+  bool lit(const char* s) {
+    const size_t n = std::strlen(s);
+    if ((size_t)(e - p) < n || std::strncmp(p, s, n) != 0) return false;
+    p += n;
+    return true;
+  }
+  bool str(std::string& out) {
+    if (p >= e || *p != '"') return fail("expected string");
+    p++;
+    out.clear();
+    while (p < e && *p != '"') {
+      char c = *p++;
+      if (c == '\\' && p < e) {
+        c = *p++;
+        if (c == 'n') c = '\n';
+        else if (c == 't') c = '\t';
+        else if (c != '"' && c != '\\' && c != '/') return fail("unsupported escape");
+      }
+      out.push_back(c);
+    }
+    if (p >= e) return fail("unterminated string");
+    p++;
+    return true;
+  }
+  bool value(JVal& v) {
+    ws();
+    if (p >= e) return fail("unexpected end");
+    if (*p == '{') {
+      v.kind = JVal::Obj;
+      p++;
+      ws();
+      if (p < e && *p == '}') { p++; return true; }
+      for (;;) {
+        ws();
+        std::string key;
+        if (!str(key)) return false;
+        ws();
+        if (p >= e || *p != ':') return fail("expected ':'");
+        p++;
+        v.obj.emplace_back(key, JVal());
+        if (!value(v.obj.back().second)) return false;
+        ws();
+        if (p < e && *p == ',') { p++; continue; }
+        if (p < e && *p == '}') { p++; return true; }
+        return fail("expected ',' or '}'");
+      }
+    }
+    if (*p == '[') {
+      v.kind = JVal::Arr;
+      p++;
+      ws();
+      if (p < e && *p == ']') { p++; return true; }
+      for (;;) {
+        v.arr.emplace_back();
+        if (!value(v.arr.back())) return false;
+        ws();
+        if (p < e && *p == ',') { p++; continue; }
+        if (p < e && *p == ']') { p++; return true; }
+        return fail("expected ',' or ']'");
+      }
+    }
+    if (*p == '"') { v.kind = JVal::Str; return str(v.text); }
+    if (lit("true"))  { v.kind = JVal::Bool; v.text = "1"; return true; }
+    if (lit("false")) { v.kind = JVal::Bool; v.text = "0"; return true; }
+    if (lit("null"))  { v.kind = JVal::Null; return true; }
+    const char* s = p;
+    while (p < e && (std::isdigit((unsigned char)*p) || std::strchr("+-.eE", *p))) p++;
+    if (p == s) return fail("unexpected character");
+    v.kind = JVal::Num;
+    v.text.assign(s, p);
+    return true;
+  }
+};
+
+std::string flag_name(const std::string& key) {
+  return key.compare(0, 2, "--") == 0 ? key : "--" + key;
+}
+
+// Appends every combination of obj[i..] to cur, one config each.
+bool expand_run(const std::vector<std::pair<std::string, JVal>>& obj, size_t i,
+                std::vector<std::string>& cur, const std::vector<std::string>& defaults,
+                std::vector<std::vector<std::string>>& out, std::string& err) {
+  if (i == obj.size()) {
+    out.push_back(cur);
+    out.back().insert(out.back().end(), defaults.begin(), defaults.end());
+    return true;
+  }
+  const JVal& v = obj[i].second;
+  const std::string flag = flag_name(obj[i].first);
+  std::vector<const JVal*> vals;
+  if (v.kind == JVal::Arr) for (const JVal& a : v.arr) vals.push_back(&a);
+  else vals.push_back(&v);
+  for (const JVal* a : vals) {
+    if (a->kind == JVal::Arr || a->kind == JVal::Obj || a->kind == JVal::Null) {
+      err = "value of " + obj[i].first + " must be a string, number or boolean";
+      return false;
+    }
+    cur.push_back(flag);
+    cur.push_back(a->text);
+    if (!expand_run(obj, i + 1, cur, defaults, out, err)) return false;
+    cur.resize(cur.size() - 2);
+  }
+  return true;
+}
+
+}  // namespace
+
+bool load_sweep_spec(const std::string& path, SweepSpec& out, std::string& err) {
+  FILE* f = std::fopen(path.c_str(), "rb");
+  if (!f) { err = "cannot open " + path; return false; }
+  std::string text;
+  char buf[1 << 16];
+  size_t got;
+  while ((got = std::fread(buf, 1, sizeof(buf), f)) > 0) text.append(buf, got);
+  std::fclose(f);
+
+  JParser jp{text.data(), text.data(), text.data() + text.size(), ""};
+  JVal root;
+  if (!jp.value(root)) { err = jp.err; return false; }
+  if (root.kind != JVal::Obj) { err = "spec must be a JSON object"; return false; }
+
+  out = SweepSpec();
+  std::vector<std::string> defaults;
+  const JVal* runs = nullptr;
+  for (const auto& kv : root.obj) {
+    if (kv.first == "header") {
+      out.header = kv.second.text == "1";
+    } else if (kv.first == "defaults" && kv.second.kind == JVal::Obj) {
+      for (const auto& d : kv.second.obj) {
+        if (d.second.kind == JVal::Arr || d.second.kind == JVal::Obj) {
+          err = "default " + d.first + " must be a single value";
+          return false;
+        }
+        defaults.push_back(flag_name(d.first));
+        defaults.push_back(d.second.text);
+      }
+    } else if (kv.first == "runs" && kv.second.kind == JVal::Arr) {
+      runs = &kv.second;
+    } else {
+      err = "unknown or malformed key " + kv.first;
+      return false;
+    }
+  }
+  if (!runs) { err = "spec has no \"runs\" array"; return false; }
+  for (const JVal& r : runs->arr) {
+    if (r.kind != JVal::Obj) { err = "each run must be an object"; return false; }
+    std::vector<std::string> cur;
+    if (!expand_run(r.obj, 0, cur, defaults, out.configs, err)) return false;
+  }
+  return true;
+}
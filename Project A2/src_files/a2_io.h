@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "a2_kernels.h"
+
+// Matrix Market coordinate files (real/integer/pattern; general/symmetric/
+// skew-symmetric). The file is mmap'd and parsed by all OpenMP threads.
+bool load_matrix_market(const std::string& path, CSR& out, std::string& err);
+
+// Compact binary CSR: 64-byte header, then rowptr/colidx/values as int32/int32/
+// float32, each section 64-byte aligned. Loading mmaps the file and points the
+// CSR arrays straight at it (copy-on-write), so no parsing or copying happens;
+// one O(nnz) pass rejects out-of-range offsets/columns and unsorted rows.
+bool save_csr_binary(const std::string& path, const CSR& A, std::string& err);
+bool load_csr_binary(const std::string& path, CSR& out, std::string& err);
+
+// Dispatch on content: binary CSR magic, else Matrix Market.
+bool load_matrix(const std::string& path, CSR& out, std::string& err);
+
+// Dense row-major float32 file for the out-of-core kernels: 64-byte header
+// ("A2DNS001", rows, cols), then rows * cols floats. create_dense_file fills
+// it with fill_random data in 16 MiB chunks (chunk c from seed + c), so the
+// matrix never has to fit in memory; fill = false leaves a sparse all-zero
+// file. An open DenseFile keeps its descriptor for pread/pwrite; mapped
+// files also carry a shared read-only mapping, and block reads copy out of
+// it instead of calling pread.
+struct DenseFile {
+  int fd = -1;
+  int64_t rows = 0;
+  int64_t cols = 0;
+  const float* map = nullptr;  // first element when mapped
+  void* map_base = nullptr;
+  size_t map_len = 0;
+};
+
+bool create_dense_file(const std::string& path, int64_t rows, int64_t cols, bool fill,
+                       uint64_t seed, std::string& err);
+bool open_dense_file(const std::string& path, bool writable, bool mapped, DenseFile& out,
+                     std::string& err);
+void close_dense_file(DenseFile& f);
+
+// Block [row0, row0 + rows) x [col0, col0 + cols) to / from a packed buffer
+// (row stride cols): one call when the rows span the full width, else one
+// per row. Writes always use pwrite. Thread-safe for disjoint blocks.
+bool read_dense_block(const DenseFile& f, int64_t row0, int64_t rows, int64_t col0, int64_t cols,
+                      float* dst);
+bool write_dense_block(const DenseFile& f, int64_t row0, int64_t rows, int64_t col0, int64_t cols,
+                       const float* src);
+
+// Evicts the file's clean pages from the page cache (and this process's
+// mapping of them), so the next read goes to the device: cold-file timing
+// for files that would otherwise stay cached between reps.
+void drop_dense_cache(const DenseFile& f);
+
+// Sweep spec for a2_benchmark --sweep: a JSON object
+//   {"header": true,
+//    "defaults": {"threads": 8, "bind": "close"},
+//    "runs": [{"kernel": "gemm", "variant": ["scalar", "simd"],
+//              "m": 1536, "k": 1536, "n": 1536, "run": [1, 2, 3]}, ...]}
+// Keys are a2_benchmark flags with or without the leading "--"; values are
+// strings, numbers (kept as written) or booleans (1 / 0). Array values expand
+// to the cartesian product, first key outermost. Each config lists the run's
+// own flags before the defaults, so they take precedence (first flag wins).
+struct SweepSpec {
+  bool header = false;
+  std::vector<std::vector<std::string>> configs;  // flag, value, flag, value, ...
+};
+
+bool load_sweep_spec(const std::string& path, SweepSpec& out, std::string& err);
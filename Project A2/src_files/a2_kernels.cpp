@@ -1,323 +1,3121 @@
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <random>
 #include <vector>
 
 #include <omp.h>
+#include <sys/mman.h>
 
 #include "a2_kernels.h"
+#include "a2_threads.h"
 #include "a2_utils.h"
 
 #if defined(__AVX2__)
   #include <immintrin.h>
 #endif
 
-static void* aligned_malloc(size_t bytes, size_t alignment) {
+// ---------------------------------------------------------------------------
+// Aligned allocation and page policy
+// ---------------------------------------------------------------------------
+
+static PagePolicy g_page_policy = PagePolicy::Small;
+
+// MAP_HUGETLB blocks need their length for munmap; everything else is free()d.
+static std::mutex g_huge_mu;
+static std::map<void*, size_t> g_huge_blocks;
+
+const char* page_policy_name(PagePolicy p) {
+  switch (p) {
+    case PagePolicy::Small: return "4k";
+    case PagePolicy::THP: return "thp";
+    case PagePolicy::Huge2M: return "2m";
+    case PagePolicy::Huge1G: return "1g";
+  }
+  return "?";
+}
+
+bool parse_page_policy(const std::string& s, PagePolicy& out) {
+  if (s == "4k")  { out = PagePolicy::Small; return true; }
+  if (s == "thp") { out = PagePolicy::THP; return true; }
+  if (s == "2m")  { out = PagePolicy::Huge2M; return true; }
+  if (s == "1g")  { out = PagePolicy::Huge1G; return true; }
+  return false;
+}
+
+void set_page_policy(PagePolicy p) { g_page_policy = p; }
+PagePolicy page_policy() { return g_page_policy; }
+
+static const size_t k2M = (size_t)2 << 20;
+static const size_t k1G = (size_t)1 << 30;
+
+static void* alloc_small(size_t bytes, size_t alignment) {
   void* p = nullptr;
-  if (posix_memalign(&p, alignment, bytes) != 0) return nullptr;
+  if (posix_memalign(&p, alignment, std::max<size_t>(bytes, 1)) != 0) std::abort();
+  return p;
+}
+
+static void* alloc_thp(size_t bytes) {
+  const size_t len = (bytes + k2M - 1) / k2M * k2M;
+  void* p = alloc_small(len, k2M);
+  madvise(p, len, MADV_HUGEPAGE);  // advisory; EINVAL without THP support
+  return p;
+}
+
+static void* alloc_hugetlb(size_t bytes, size_t page) {
+  const int flag = page == k1G ? (30 << MAP_HUGE_SHIFT) : (21 << MAP_HUGE_SHIFT);
+  const size_t len = (bytes + page - 1) / page * page;
+  void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flag, -1, 0);
+  if (p == MAP_FAILED) return nullptr;
+  std::lock_guard<std::mutex> lock(g_huge_mu);
+  g_huge_blocks[p] = len;
   return p;
 }
 
+void* alloc_aligned_bytes(size_t bytes, size_t alignment) {
+  const PagePolicy pol = g_page_policy;
+  const size_t page = pol == PagePolicy::Huge1G ? k1G : k2M;
+  if (pol == PagePolicy::Small || bytes < page / 2) return alloc_small(bytes, alignment);
+  if (pol != PagePolicy::THP) {
+    if (void* p = alloc_hugetlb(bytes, page)) return p;
+    // reachable from parallel regions (per-thread pack buffers)
+    static std::atomic<bool> warned{false};
+    if (!warned.exchange(true)) {
+      std::fprintf(stderr, "[pages] no %s hugetlb pages for %zu bytes, falling back to THP\n",
+                   page_policy_name(pol), bytes);
+    }
+  }
+  return alloc_thp(bytes);
+}
+
+void free_aligned_bytes(void* p) {
+  if (!p) return;
+  {
+    std::lock_guard<std::mutex> lock(g_huge_mu);
+    auto it = g_huge_blocks.find(p);
+    if (it != g_huge_blocks.end()) {
+      munmap(p, it->second);
+      g_huge_blocks.erase(it);
+      return;
+    }
+  }
+  std::free(p);
+}
+
+size_t buffer_page_kib(const void* p, size_t bytes) {
+  FILE* f = std::fopen("/proc/self/smaps", "r");
+  if (!f || bytes == 0) {
+    if (f) std::fclose(f);
+    return 0;
+  }
+  const uintptr_t a0 = (uintptr_t)p, a1 = a0 + bytes;
+  char line[512];
+  bool in = false;
+  size_t kernel_kib = 0, thp_kib = 0, span_kib = 0, covered_kib = 0;
+  while (std::fgets(line, sizeof(line), f)) {
+    unsigned long lo, hi;
+    if (std::sscanf(line, "%lx-%lx ", &lo, &hi) == 2 && std::strchr(line, '-') < std::strchr(line, ' ')) {
+      in = lo < a1 && hi > a0;
+      if (in) {
+        // VMAs may extend past the buffer; THP is counted per VMA.
+        span_kib = (std::min<uintptr_t>(hi, a1) - std::max<uintptr_t>(lo, a0)) / 1024;
+        covered_kib += span_kib;
+      }
+      continue;
+    }
+    if (!in) continue;
+    size_t v = 0;
+    if (std::sscanf(line, "KernelPageSize: %zu kB", &v) == 1) kernel_kib = std::max(kernel_kib, v);
+    else if (std::sscanf(line, "AnonHugePages: %zu kB", &v) == 1) thp_kib += std::min(v, span_kib);
+  }
+  std::fclose(f);
+  if (covered_kib == 0) return 0;
+  if (kernel_kib > 4) return kernel_kib;
+  return 2 * thp_kib >= covered_kib ? 2048 : 4;
+}
+
 AlignedBuffer make_aligned_f32(size_t count, size_t alignment) {
-  AlignedBuffer b;
-  b.count = count;
-  b.ptr = (float*)aligned_malloc(count * sizeof(float), alignment);
-  if (!b.ptr) std::abort();
-  return b;
+  return make_aligned<float>(count, alignment);
+}
+
+// Counter-based fill: x[i] is a hash of (seed, i), so the contents do not
+// depend on the thread count or the SIMD width. The static split matches
+// first_touch and the kernels' static row loops, so each page is written by
+// the thread that later reads it. Two rounds of a 32-bit avalanche hash
+// (lowbias32) per element; the top 24 bits give a float in [-1, 1) exactly,
+// so the scalar and AVX2 paths agree bit for bit.
+static inline uint32_t fill_mix(uint32_t x) {
+  x ^= x >> 16; x *= 0x7feb352du;
+  x ^= x >> 15; x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
 }
 
-void free_aligned(AlignedBuffer& b) {
-  std::free(b.ptr);
-  b.ptr = nullptr;
-  b.count = 0;
+static inline float fill_value(size_t i, uint32_t k0, uint32_t k1) {
+  const uint32_t u = fill_mix(fill_mix((uint32_t)i + k0) ^ ((uint32_t)((uint64_t)i >> 32) + k1));
+  return (float)(u >> 8) * (1.0f / 8388608.0f) - 1.0f;
 }
 
+#if defined(__AVX2__)
+static inline __m256i fill_mix8(__m256i x) {
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+  x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x7feb352du));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+  x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x846ca68bu));
+  return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+#endif
+
 void fill_random(float* x, size_t n, uint64_t seed) {
-  std::mt19937_64 rng(seed);
-  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
-  for (size_t i = 0; i < n; i++) x[i] = dist(rng);
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull;  // splitmix64 of the seed -> two keys
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  const uint32_t k0 = (uint32_t)z, k1 = (uint32_t)(z >> 32);
+  const long groups = (long)(n / 8);
+
+#pragma omp parallel for schedule(static)
+  for (long g = 0; g < groups; g++) {
+    const size_t i = (size_t)g * 8;
+#if defined(__AVX2__)
+    // groups of 8 never straddle a 2^32 boundary, so the high word is shared
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i c = _mm256_add_epi32(_mm256_set1_epi32((int)((uint32_t)i + k0)), lane);
+    __m256i h = _mm256_set1_epi32((int)((uint32_t)((uint64_t)i >> 32) + k1));
+    __m256i u = fill_mix8(_mm256_xor_si256(fill_mix8(c), h));
+    __m256 f = _mm256_cvtepi32_ps(_mm256_srli_epi32(u, 8));
+    f = _mm256_fmsub_ps(f, _mm256_set1_ps(1.0f / 8388608.0f), _mm256_set1_ps(1.0f));
+    _mm256_storeu_ps(x + i, f);
+#else
+    for (size_t j = i; j < i + 8; j++) x[j] = fill_value(j, k0, k1);
+#endif
+  }
+  for (size_t i = (size_t)groups * 8; i < n; i++) x[i] = fill_value(i, k0, k1);
 }
 
 void zero_fill(float* x, size_t n) {
   std::memset(x, 0, n * sizeof(float));
 }
 
-CSR make_random_csr(int m, int k, double density, const std::string& pattern, uint64_t seed) {
-  std::mt19937_64 rng(seed);
-  std::uniform_real_distribution<float> vdist(-1.0f, 1.0f);
-  std::uniform_int_distribution<int> coldist(0, k - 1);
-
-  CSR A;
-  A.m = m; A.k = k;
-  A.rowptr.resize((size_t)m + 1, 0);
-
-  std::vector<std::vector<int>> cols((size_t)m);
-  std::vector<std::vector<float>> vals((size_t)m);
+// Small counter-seeded generator: one independent stream per row, so the
+// matrix is identical for any thread count and rows need no shared state.
+struct RowRng {
+  using result_type = uint64_t;
+  uint64_t s;
+  RowRng(uint64_t seed, uint64_t row) : s(seed ^ (row * 0x9E3779B97F4A7C15ull + 0xD1B54A32D192ED03ull)) {}
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~(result_type)0; }
+  result_type operator()() {
+    // splitmix64
+    uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+  int uniform_int(int lo, int hi) {  // inclusive
+    uint64_t span = (uint64_t)(hi - lo) + 1;
+    return lo + (int)(((unsigned __int128)(*this)() * span) >> 64);
+  }
+  float uniform_val() {  // [-1, 1)
+    return (float)((*this)() >> 40) * (2.0f / 16777216.0f) - 1.0f;
+  }
+};
 
-  if (pattern == "band") {
+// Column window and draw count for row i of a synthetic pattern.
+static void random_row_shape(int i, int m, int k, double density, int pattern_id,
+                             RowRng& rng, int& lo, int& hi, int& target) {
+  if (pattern_id == 1) {  // band
     int bw = std::max(1, (int)std::round(k * std::min(0.20, std::max(0.01, density * 5.0))));
-    for (int i = 0; i < m; i++) {
-      int center = (int)((int64_t)i * k / std::max(1, m));
-      int lo = std::max(0, center - bw);
-      int hi = std::min(k - 1, center + bw);
-      int span = hi - lo + 1;
-      int target = (int)std::round(span * std::min(1.0, density * (double)k / (double)span));
-      target = std::max(1, std::min(span, target));
-      cols[(size_t)i].reserve((size_t)target);
-      vals[(size_t)i].reserve((size_t)target);
-      std::uniform_int_distribution<int> bdist(lo, hi);
-      for (int t = 0; t < target; t++) {
-        int c = bdist(rng);
-        cols[(size_t)i].push_back(c);
-        vals[(size_t)i].push_back(vdist(rng));
-      }
-      std::sort(cols[(size_t)i].begin(), cols[(size_t)i].end());
-      cols[(size_t)i].erase(std::unique(cols[(size_t)i].begin(), cols[(size_t)i].end()), cols[(size_t)i].end());
-    }
-  } else if (pattern == "blockdiag") {
-    int blocks = 8;
+    int center = (int)((int64_t)i * k / std::max(1, m));
+    lo = std::max(0, center - bw);
+    hi = std::min(k - 1, center + bw);
+  } else if (pattern_id == 2) {  // blockdiag
+    const int blocks = 8;
     int bm = std::max(1, m / blocks);
     int bk = std::max(1, k / blocks);
-    for (int i = 0; i < m; i++) {
-      int bi = std::min(blocks - 1, i / bm);
-      int lo = bi * bk;
-      int hi = std::min(k - 1, lo + bk - 1);
-      int span = hi - lo + 1;
-      int target = (int)std::round(span * std::min(1.0, density * (double)k / (double)span));
-      target = std::max(1, std::min(span, target));
-      cols[(size_t)i].reserve((size_t)target);
-      vals[(size_t)i].reserve((size_t)target);
-      std::uniform_int_distribution<int> bdist(lo, hi);
-      for (int t = 0; t < target; t++) {
-        int c = bdist(rng);
-        cols[(size_t)i].push_back(c);
-        vals[(size_t)i].push_back(vdist(rng));
-      }
-      std::sort(cols[(size_t)i].begin(), cols[(size_t)i].end());
-      cols[(size_t)i].erase(std::unique(cols[(size_t)i].begin(), cols[(size_t)i].end()), cols[(size_t)i].end());
-    }
-  } else {
-    // uniform
-    double expected = (double)m * (double)k * density;
-    int nnz = (int)std::round(expected);
-    nnz = std::max(m, nnz);
-    std::uniform_int_distribution<int> rowdist(0, m - 1);
+    int bi = std::min(blocks - 1, i / bm);
+    lo = std::min(k - 1, bi * bk);
+    hi = std::min(k - 1, lo + bk - 1);
+  } else {  // uniform
+    lo = 0;
+    hi = k - 1;
+    std::binomial_distribution<int> cdist(k, std::min(1.0, std::max(0.0, density)));
+    target = std::max(1, cdist(rng));
+    return;
+  }
+  int span = hi - lo + 1;
+  target = (int)std::round(span * std::min(1.0, density * (double)k / (double)span));
+  target = std::max(1, std::min(span, target));
+}
 
-    for (int t = 0; t < nnz; t++) {
-      int r = rowdist(rng);
-      int c = coldist(rng);
-      cols[(size_t)r].push_back(c);
-      vals[(size_t)r].push_back(vdist(rng));
+// Close the gaps left by per-row dedup: row i keeps len[i] entries starting at
+// rowptr[i]. Moves are leftward and in row order, so this is done in place.
+static void compact_csr_rows(CSR& A, const std::vector<int>& len) {
+  int dst = 0;
+  for (int i = 0; i < A.m; i++) {
+    int src = A.rowptr[(size_t)i];
+    int l = len[(size_t)i];
+    if (dst != src && l > 0) {
+      std::memmove(&A.colidx[(size_t)dst], &A.colidx[(size_t)src], (size_t)l * sizeof(int));
+      std::memmove(&A.values[(size_t)dst], &A.values[(size_t)src], (size_t)l * sizeof(float));
     }
+    A.rowptr[(size_t)i] = dst;
+    dst += l;
+  }
+  A.rowptr[(size_t)A.m] = dst;
+  A.colidx.resize((size_t)dst);
+  A.values.resize((size_t)dst);
+}
 
-    for (int r = 0; r < m; r++) {
-      auto& rc = cols[(size_t)r];
-      auto& rv = vals[(size_t)r];
-      if (rc.empty()) { rc.push_back(coldist(rng)); rv.push_back(vdist(rng)); }
-
-      std::vector<size_t> idx(rc.size());
-      for (size_t i = 0; i < idx.size(); i++) idx[i] = i;
-      std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b){ return rc[a] < rc[b]; });
+// Two passes over rows: (1) draw each row's count, (2) after an exclusive
+// prefix sum, draw columns straight into the final colidx slice, sort and
+// dedup in place, then draw values. Only rowptr/colidx/values are allocated.
+CSR make_random_csr(int m, int k, double density, const std::string& pattern, uint64_t seed) {
+  const int pattern_id = (pattern == "band") ? 1 : (pattern == "blockdiag") ? 2 : 0;
 
-      std::vector<int> rc2; rc2.reserve(rc.size());
-      std::vector<float> rv2; rv2.reserve(rv.size());
-      int last = -1;
-      for (size_t t2 = 0; t2 < idx.size(); t2++) {
-        int c = rc[idx[t2]];
-        if (c == last) continue;
-        last = c;
-        rc2.push_back(c);
-        rv2.push_back(rv[idx[t2]]);
-      }
-      rc.swap(rc2);
-      rv.swap(rv2);
-    }
-  }
+  CSR A;
+  A.m = m; A.k = k;
+  A.rowptr.assign((size_t)m + 1, 0);
 
-  size_t total = 0;
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < m; i++) {
-    A.rowptr[(size_t)i] = (int)total;
-    total += cols[(size_t)i].size();
+    RowRng rng(seed, (uint64_t)i);
+    int lo, hi, target;
+    random_row_shape(i, m, k, density, pattern_id, rng, lo, hi, target);
+    A.rowptr[(size_t)i + 1] = target;
   }
-  A.rowptr[(size_t)m] = (int)total;
+  for (int i = 0; i < m; i++) A.rowptr[(size_t)i + 1] += A.rowptr[(size_t)i];
 
+  const size_t total = (size_t)A.rowptr[(size_t)m];
   A.colidx.resize(total);
   A.values.resize(total);
+  std::vector<int> len((size_t)m);
 
-  size_t p = 0;
+#pragma omp parallel for schedule(dynamic, 64)
   for (int i = 0; i < m; i++) {
-    for (size_t t = 0; t < cols[(size_t)i].size(); t++) {
-      A.colidx[p] = cols[(size_t)i][t];
-      A.values[p] = vals[(size_t)i][t];
-      p++;
+    RowRng rng(seed, (uint64_t)i);
+    int lo, hi, target;
+    random_row_shape(i, m, k, density, pattern_id, rng, lo, hi, target);
+
+    int* c = &A.colidx[(size_t)A.rowptr[(size_t)i]];
+    float* v = &A.values[(size_t)A.rowptr[(size_t)i]];
+    for (int t = 0; t < target; t++) c[t] = rng.uniform_int(lo, hi);
+    std::sort(c, c + target);
+    int u = (int)(std::unique(c, c + target) - c);
+    for (int t = 0; t < u; t++) v[t] = rng.uniform_val();
+    len[(size_t)i] = u;
+  }
+
+  compact_csr_rows(A, len);
+  return A;
+}
+
+// COO -> CSR with the same two-pass scheme: atomic per-row counts, prefix sum,
+// atomic-cursor scatter of (column, COO index) into the final arrays, then a
+// per-row sort by (column, COO index) and in-place merge of duplicates
+// (summed, Matrix Market semantics). The scatter order depends on thread
+// timing; the sort key does not, so duplicates are summed in input order and
+// the CSR is identical on every run and thread count. count must fit in int.
+CSR csr_from_coo(int m, int k, size_t count, const int* rows, const int* cols, const float* vals) {
+  CSR A;
+  A.m = m; A.k = k;
+  A.rowptr.assign((size_t)m + 1, 0);
+
+#pragma omp parallel for schedule(static)
+  for (size_t t = 0; t < count; t++) {
+#pragma omp atomic
+    A.rowptr[(size_t)rows[t] + 1]++;
+  }
+  for (int i = 0; i < m; i++) A.rowptr[(size_t)i + 1] += A.rowptr[(size_t)i];
+
+  A.colidx.resize(count);
+  A.values.resize(count);
+  std::vector<int> src(count);  // COO index of each scattered entry
+  std::vector<int> cursor(A.rowptr.begin(), A.rowptr.end() - 1);
+
+#pragma omp parallel for schedule(static)
+  for (size_t t = 0; t < count; t++) {
+    int d;
+#pragma omp atomic capture
+    d = cursor[(size_t)rows[t]]++;
+    A.colidx[(size_t)d] = cols[t];
+    src[(size_t)d] = (int)t;
+  }
+
+  std::vector<int> len((size_t)m);
+#pragma omp parallel
+  {
+    std::vector<std::pair<int, int>> scratch;  // (column, COO index), reused across rows
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < m; i++) {
+      int p0 = A.rowptr[(size_t)i];
+      int l = A.rowptr[(size_t)i + 1] - p0;
+      int* c = &A.colidx[(size_t)p0];
+      float* v = &A.values[(size_t)p0];
+      const int* s = &src[(size_t)p0];
+
+      scratch.resize((size_t)l);
+      for (int t = 0; t < l; t++) scratch[(size_t)t] = {c[t], s[t]};
+      std::sort(scratch.begin(), scratch.end());
+
+      int u = 0;
+      for (int t = 0; t < l; t++) {
+        const int col = scratch[(size_t)t].first;
+        const float val = vals ? vals[(size_t)scratch[(size_t)t].second] : 1.0f;
+        if (u > 0 && c[u - 1] == col) {
+          v[u - 1] += val;
+        } else {
+          c[u] = col;
+          v[u] = val;
+          u++;
+        }
+      }
+      len[(size_t)i] = u;
     }
   }
+
+  compact_csr_rows(A, len);
   return A;
 }
 
 size_t csr_nnz(const CSR& A) { return A.values.size(); }
 
-void gemm_tiled_scalar(const float* A, const float* B, float* C,
-                       int m, int k, int n, int tileM, int tileK, int tileN) {
-  // Parallelize by ii blocks (each thread writes distinct rows of C)
+CSC csr_to_csc(const CSR& A) {
+  CSC T;
+  T.m = A.m; T.k = A.k;
+  const size_t nnz = csr_nnz(A);
+  T.colptr.assign((size_t)A.k + 1, 0);
+  T.rowidx.resize(nnz);
+  T.values.resize(nnz);
+
+  for (size_t p = 0; p < nnz; p++) T.colptr[(size_t)A.colidx[p] + 1]++;
+  for (int c = 0; c < A.k; c++) T.colptr[(size_t)c + 1] += T.colptr[(size_t)c];
+
+  // Rows are visited in order, so each column's rowidx comes out sorted.
+  std::vector<int> next(T.colptr.begin(), T.colptr.end() - 1);
+  for (int i = 0; i < A.m; i++) {
+    for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+      int d = next[(size_t)A.colidx[(size_t)p]]++;
+      T.rowidx[(size_t)d] = i;
+      T.values[(size_t)d] = A.values[(size_t)p];
+    }
+  }
+  return T;
+}
+
+ELL csr_to_ell(const CSR& A) {
+  ELL E;
+  E.m = A.m; E.k = A.k;
+  int width = 0;
+  for (int i = 0; i < A.m; i++) width = std::max(width, A.rowptr[(size_t)i + 1] - A.rowptr[(size_t)i]);
+  E.width = width;
+  E.colidx.assign((size_t)A.m * (size_t)width, 0);
+  E.values.assign((size_t)A.m * (size_t)width, 0.0f);
+
 #pragma omp parallel for schedule(static)
-  for (int ii = 0; ii < m; ii += tileM) {
-    for (int kk = 0; kk < k; kk += tileK) {
-      for (int jj = 0; jj < n; jj += tileN) {
-        int i_end = std::min(m, ii + tileM);
-        int k_end = std::min(k, kk + tileK);
-        int j_end = std::min(n, jj + tileN);
-        for (int i = ii; i < i_end; i++) {
-          for (int t = kk; t < k_end; t++) {
-            float a = A[i * k + t];
-            const float* b = &B[t * n + jj];
-            float* c = &C[i * n + jj];
-            for (int j = jj; j < j_end; j++) {
-              c[j - jj] += a * b[j - jj];
-            }
-          }
+  for (int i = 0; i < A.m; i++) {
+    int p0 = A.rowptr[(size_t)i];
+    int len = A.rowptr[(size_t)i + 1] - p0;
+    int* ci = &E.colidx[(size_t)i * width];
+    float* vi = &E.values[(size_t)i * width];
+    for (int t = 0; t < len; t++) {
+      ci[t] = A.colidx[(size_t)p0 + t];
+      vi[t] = A.values[(size_t)p0 + t];
+    }
+    // pad with the row's last column so padding hits an already-hot B row
+    int pad_col = (len > 0) ? ci[len - 1] : 0;
+    for (int t = len; t < width; t++) ci[t] = pad_col;
+  }
+  return E;
+}
+
+SELL csr_to_sell(const CSR& A, int C, int sigma) {
+  SELL S;
+  S.m = A.m; S.k = A.k;
+  S.C = std::max(1, C);
+  S.sigma = std::max(1, sigma);
+  const int m = A.m;
+  const int slices = (m + S.C - 1) / S.C;
+  auto row_len = [&](int i) { return A.rowptr[(size_t)i + 1] - A.rowptr[(size_t)i]; };
+
+  // Sort rows by decreasing length within each sigma-window so that rows of
+  // similar length share a slice and padding stays small.
+  S.perm.assign((size_t)slices * (size_t)S.C, -1);
+  for (int i = 0; i < m; i++) S.perm[(size_t)i] = i;
+  for (int w0 = 0; w0 < m; w0 += S.sigma) {
+    int w1 = std::min(m, w0 + S.sigma);
+    std::stable_sort(S.perm.begin() + w0, S.perm.begin() + w1,
+                     [&](int a, int b){ return row_len(a) > row_len(b); });
+  }
+
+  S.sliceptr.assign((size_t)slices + 1, 0);
+  S.slicelen.assign((size_t)slices, 0);
+  for (int s = 0; s < slices; s++) {
+    int len = 0;
+    for (int r = 0; r < S.C; r++) {
+      int row = S.perm[(size_t)s * S.C + r];
+      if (row >= 0) len = std::max(len, row_len(row));
+    }
+    S.slicelen[(size_t)s] = len;
+    S.sliceptr[(size_t)s + 1] = S.sliceptr[(size_t)s] + len * S.C;
+  }
+
+  S.colidx.assign((size_t)S.sliceptr[(size_t)slices], 0);
+  S.values.assign((size_t)S.sliceptr[(size_t)slices], 0.0f);
+
+#pragma omp parallel for schedule(static)
+  for (int s = 0; s < slices; s++) {
+    int base = S.sliceptr[(size_t)s];
+    int len = S.slicelen[(size_t)s];
+    for (int r = 0; r < S.C; r++) {
+      int row = S.perm[(size_t)s * S.C + r];
+      int p0 = (row >= 0) ? A.rowptr[(size_t)row] : 0;
+      int rl = (row >= 0) ? row_len(row) : 0;
+      int pad_col = (rl > 0) ? A.colidx[(size_t)p0 + rl - 1] : 0;
+      for (int t = 0; t < len; t++) {
+        size_t d = (size_t)base + (size_t)t * S.C + r;
+        if (t < rl) {
+          S.colidx[d] = A.colidx[(size_t)p0 + t];
+          S.values[d] = A.values[(size_t)p0 + t];
+        } else {
+          S.colidx[d] = pad_col;
         }
       }
     }
   }
+  return S;
 }
 
-#if defined(__AVX2__)
-void gemm_tiled_avx2(const float* A, const float* B, float* C,
-                     int m, int k, int n, int tileM, int tileK, int tileN) {
-#pragma omp parallel for schedule(static)
-  for (int ii = 0; ii < m; ii += tileM) {
-    for (int kk = 0; kk < k; kk += tileK) {
-      for (int jj = 0; jj < n; jj += tileN) {
-        int i_end = std::min(m, ii + tileM);
-        int k_end = std::min(k, kk + tileK);
-        int j_end = std::min(n, jj + tileN);
-        int j_vec_end = jj + ((j_end - jj) / 8) * 8;
-
-        for (int i = ii; i < i_end; i++) {
-          for (int t = kk; t < k_end; t++) {
-            __m256 a8 = _mm256_set1_ps(A[i * k + t]);
-            const float* b = &B[t * n + jj];
-            float* c = &C[i * n + jj];
-
-            for (int j = jj; j < j_vec_end; j += 8) {
-              __m256 bv = _mm256_loadu_ps(b + (j - jj));
-              __m256 cv = _mm256_loadu_ps(c + (j - jj));
-              cv = _mm256_fmadd_ps(a8, bv, cv);
-              _mm256_storeu_ps(c + (j - jj), cv);
-            }
-            for (int j = j_vec_end; j < j_end; j++) {
-              C[i * n + j] += A[i * k + t] * B[t * n + j];
-            }
-          }
+BSR csr_to_bsr(const CSR& A, int bs) {
+  BSR R;
+  R.m = A.m; R.k = A.k;
+  R.bs = std::max(1, bs);
+  const int b = R.bs;
+  R.mb = (A.m + b - 1) / b;
+  const int kb = (A.k + b - 1) / b;
+
+  R.browptr.assign((size_t)R.mb + 1, 0);
+  std::vector<int> stamp((size_t)kb, -1);
+  std::vector<int> slot((size_t)kb, -1);
+  std::vector<int> list;
+
+  for (int bi = 0; bi < R.mb; bi++) {
+    int r0 = bi * b;
+    int r1 = std::min(A.m, r0 + b);
+
+    list.clear();
+    for (int i = r0; i < r1; i++) {
+      for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+        int bc = A.colidx[(size_t)p] / b;
+        if (stamp[(size_t)bc] != bi) { stamp[(size_t)bc] = bi; list.push_back(bc); }
+      }
+    }
+    std::sort(list.begin(), list.end());
+
+    size_t q0 = R.bcolidx.size();
+    for (size_t t = 0; t < list.size(); t++) {
+      slot[(size_t)list[t]] = (int)(q0 + t);
+      R.bcolidx.push_back(list[t]);
+    }
+    R.values.resize(R.bcolidx.size() * (size_t)b * (size_t)b, 0.0f);
+
+    for (int i = r0; i < r1; i++) {
+      for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+        int c = A.colidx[(size_t)p];
+        size_t q = (size_t)slot[(size_t)(c / b)];
+        R.values[q * b * b + (size_t)(i - r0) * b + (size_t)(c % b)] = A.values[(size_t)p];
+      }
+    }
+    R.browptr[(size_t)bi + 1] = (int)R.bcolidx.size();
+  }
+  return R;
+}
+
+size_t ell_stored(const ELL& A) { return A.values.size(); }
+size_t sell_stored(const SELL& A) { return A.values.size(); }
+size_t bsr_stored(const BSR& A) { return A.values.size(); }
+
+// ---------------------------------------------------------------------------
+// Reordering
+// ---------------------------------------------------------------------------
+
+const char* reorder_name(Reorder r) {
+  switch (r) {
+    case Reorder::None:   return "none";
+    case Reorder::Rcm:    return "rcm";
+    case Reorder::Degree: return "degree";
+  }
+  return "?";
+}
+
+bool parse_reorder(const std::string& s, Reorder& out) {
+  if (s == "none")   { out = Reorder::None;   return true; }
+  if (s == "rcm")    { out = Reorder::Rcm;    return true; }
+  if (s == "degree") { out = Reorder::Degree; return true; }
+  return false;
+}
+
+// BFS levels from root over G; returns the last level (the vertices farthest
+// from root) and the depth. visited is scratch (all -1 on entry and exit).
+static std::vector<int> bfs_last_level(const CSR& G, int root, std::vector<int>& visited, int& depth) {
+  std::vector<int> order{root}, last{root};
+  visited[(size_t)root] = 0;
+  depth = 0;
+  for (size_t head = 0; head < order.size();) {
+    const size_t level_end = order.size();
+    std::vector<int> level;
+    for (; head < level_end; head++) {
+      const int u = order[head];
+      for (int p = G.rowptr[(size_t)u]; p < G.rowptr[(size_t)u + 1]; p++) {
+        const int v = G.colidx[(size_t)p];
+        if (visited[(size_t)v] < 0) {
+          visited[(size_t)v] = depth + 1;
+          order.push_back(v);
+          level.push_back(v);
         }
       }
     }
+    if (level.empty()) break;
+    last.swap(level);
+    depth++;
   }
+  for (int u : order) visited[(size_t)u] = -1;
+  return last;
 }
-#endif // __AVX2__
 
-void spmm_csr_scalar(const CSR& A, const float* B, float* C, int n,
-                     int jblock, LayoutB layoutB) {
+// Cuthill-McKee on the symmetrized pattern, one component at a time from a
+// pseudo-peripheral start (George-Liu: restart from the lowest-degree vertex
+// of the last BFS level while the depth grows), neighbours by ascending
+// degree; the reversed order is RCM.
+static std::vector<int> rcm_order(const CSR& A) {
   const int m = A.m;
-  zero_fill(C, (size_t)m * (size_t)n);
+  const size_t nnz = csr_nnz(A);
+  std::vector<int> r(2 * nnz), c(2 * nnz);
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int i = 0; i < m; i++) {
+    for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+      r[2 * (size_t)p] = i;     c[2 * (size_t)p] = A.colidx[(size_t)p];
+      r[2 * (size_t)p + 1] = A.colidx[(size_t)p]; c[2 * (size_t)p + 1] = i;
+    }
+  }
+  const CSR G = csr_from_coo(m, m, 2 * nnz, r.data(), c.data(), nullptr);
+  auto degree = [&](int u) { return G.rowptr[(size_t)u + 1] - G.rowptr[(size_t)u]; };
 
-  auto getB = [&](int col, int j)->float {
-    if (layoutB == LayoutB::RowMajor) return B[col * n + j];
-    return B[j * A.k + col];
-  };
+  std::vector<int> by_degree((size_t)m);
+  for (int i = 0; i < m; i++) by_degree[(size_t)i] = i;
+  std::stable_sort(by_degree.begin(), by_degree.end(), [&](int a, int b) { return degree(a) < degree(b); });
 
-#pragma omp parallel for schedule(static)
-  for (int i = 0; i < m; i++) {
-    int p0 = A.rowptr[(size_t)i];
-    int p1 = A.rowptr[(size_t)i + 1];
-    float* crow = &C[i * n];
+  std::vector<int> order, visited((size_t)m, -1), nbrs;
+  std::vector<char> placed((size_t)m, 0);
+  order.reserve((size_t)m);
+  for (int seed : by_degree) {
+    if (placed[(size_t)seed]) continue;
+    int root = seed, depth = 0;
+    std::vector<int> last = bfs_last_level(G, root, visited, depth);
+    for (int tries = 0; tries < 4; tries++) {
+      const int cand = *std::min_element(last.begin(), last.end(),
+                                         [&](int a, int b) { return degree(a) < degree(b); });
+      int cdepth = 0;
+      std::vector<int> clast = bfs_last_level(G, cand, visited, cdepth);
+      if (cdepth <= depth) break;
+      root = cand; depth = cdepth; last.swap(clast);
+    }
 
-    for (int j0 = 0; j0 < n; j0 += jblock) {
-      int j1 = std::min(n, j0 + jblock);
-      for (int p = p0; p < p1; p++) {
-        int col = A.colidx[(size_t)p];
-        float a = A.values[(size_t)p];
-        for (int j = j0; j < j1; j++) {
-          crow[j] += a * getB(col, j);
-        }
+    size_t head = order.size();
+    order.push_back(root);
+    placed[(size_t)root] = 1;
+    for (; head < order.size(); head++) {
+      const int u = order[head];
+      nbrs.clear();
+      for (int p = G.rowptr[(size_t)u]; p < G.rowptr[(size_t)u + 1]; p++) {
+        const int v = G.colidx[(size_t)p];
+        if (!placed[(size_t)v]) { placed[(size_t)v] = 1; nbrs.push_back(v); }
       }
+      std::stable_sort(nbrs.begin(), nbrs.end(), [&](int a, int b) { return degree(a) < degree(b); });
+      order.insert(order.end(), nbrs.begin(), nbrs.end());
     }
   }
+  std::reverse(order.begin(), order.end());
+  return order;
 }
 
-#if defined(__AVX2__)
-void spmm_csr_avx2(const CSR& A, const float* B, float* C, int n,
-                   int jblock, LayoutB layoutB) {
-  if (layoutB != LayoutB::RowMajor) {
-    spmm_csr_scalar(A, B, C, n, jblock, layoutB);
-    return;
+bool reorder_perm(const CSR& A, Reorder r, std::vector<int>& row_perm, std::vector<int>& col_perm) {
+  if (r == Reorder::Rcm && A.m != A.k) return false;
+  row_perm.resize((size_t)A.m);
+  col_perm.resize((size_t)A.k);
+  for (int i = 0; i < A.m; i++) row_perm[(size_t)i] = i;
+  for (int j = 0; j < A.k; j++) col_perm[(size_t)j] = j;
+  if (r == Reorder::Rcm) {
+    row_perm = rcm_order(A);
+    col_perm = row_perm;
+  } else if (r == Reorder::Degree) {
+    std::vector<int> count((size_t)A.k, 0);
+    for (size_t p = 0; p < csr_nnz(A); p++) count[(size_t)A.colidx[p]]++;
+    auto len = [&](int i) { return A.rowptr[(size_t)i + 1] - A.rowptr[(size_t)i]; };
+    std::stable_sort(row_perm.begin(), row_perm.end(), [&](int a, int b) { return len(a) > len(b); });
+    std::stable_sort(col_perm.begin(), col_perm.end(),
+                     [&](int a, int b) { return count[(size_t)a] > count[(size_t)b]; });
+  }
+  return true;
+}
+
+CSR permute_csr(const CSR& A, const std::vector<int>& row_perm, const std::vector<int>& col_perm) {
+  std::vector<int> col_new((size_t)A.k);
+  for (int j = 0; j < A.k; j++) col_new[(size_t)col_perm[(size_t)j]] = j;
+
+  CSR P;
+  P.m = A.m; P.k = A.k;
+  P.rowptr.assign((size_t)A.m + 1, 0);
+  for (int i = 0; i < A.m; i++) {
+    const int o = row_perm[(size_t)i];
+    P.rowptr[(size_t)i + 1] = P.rowptr[(size_t)i] + (A.rowptr[(size_t)o + 1] - A.rowptr[(size_t)o]);
   }
+  P.colidx.resize(csr_nnz(A));
+  P.values.resize(csr_nnz(A));
 
-  const int m = A.m;
-  zero_fill(C, (size_t)m * (size_t)n);
+#pragma omp parallel
+  {
+    std::vector<std::pair<int, float>> row;  // reused across rows
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < A.m; i++) {
+      const int o = row_perm[(size_t)i];
+      row.clear();
+      for (int p = A.rowptr[(size_t)o]; p < A.rowptr[(size_t)o + 1]; p++) {
+        row.push_back({col_new[(size_t)A.colidx[(size_t)p]], A.values[(size_t)p]});
+      }
+      std::sort(row.begin(), row.end(),
+                [](const std::pair<int, float>& a, const std::pair<int, float>& b){ return a.first < b.first; });
+      const size_t d = (size_t)P.rowptr[(size_t)i];
+      for (size_t q = 0; q < row.size(); q++) {
+        P.colidx[d + q] = row[q].first;
+        P.values[d + q] = row[q].second;
+      }
+    }
+  }
+  return P;
+}
 
+void permute_rows(const float* src, float* dst, const std::vector<int>& perm, int n) {
 #pragma omp parallel for schedule(static)
-  for (int i = 0; i < m; i++) {
-    int p0 = A.rowptr[(size_t)i];
-    int p1 = A.rowptr[(size_t)i + 1];
-    float* crow = &C[i * n];
+  for (long i = 0; i < (long)perm.size(); i++) {
+    std::memcpy(dst + (size_t)i * n, src + (size_t)perm[(size_t)i] * n, (size_t)n * sizeof(float));
+  }
+}
 
-    for (int j0 = 0; j0 < n; j0 += jblock) {
-      int j1 = std::min(n, j0 + jblock);
-      int j_vec_end = j0 + ((j1 - j0) / 8) * 8;
+int csr_bandwidth(const CSR& A, double* mean) {
+  int bw = 0;
+  double sum = 0.0;
+#pragma omp parallel for schedule(static) reduction(max:bw) reduction(+:sum)
+  for (int i = 0; i < A.m; i++) {
+    for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+      const int d = std::abs(A.colidx[(size_t)p] - i);
+      bw = std::max(bw, d);
+      sum += d;
+    }
+  }
+  if (mean) *mean = sum / std::max<double>(1.0, (double)csr_nnz(A));
+  return bw;
+}
 
-      for (int p = p0; p < p1; p++) {
-        int col = A.colidx[(size_t)p];
-        float a = A.values[(size_t)p];
-        __m256 a8 = _mm256_set1_ps(a);
-        const float* brow = &B[col * n];
+// ---------------------------------------------------------------------------
+// Fused epilogue
+// ---------------------------------------------------------------------------
 
-        for (int j = j0; j < j_vec_end; j += 8) {
-          __m256 bv = _mm256_loadu_ps(brow + j);
-          __m256 cv = _mm256_loadu_ps(crow + j);
-          cv = _mm256_fmadd_ps(a8, bv, cv);
-          _mm256_storeu_ps(crow + j, cv);
+const char* activation_name(Activation a) {
+  switch (a) {
+    case Activation::None: return "none";
+    case Activation::ReLU: return "relu";
+    case Activation::GELU: return "gelu";
+  }
+  return "?";
+}
+
+bool parse_activation(const std::string& s, Activation& out) {
+  if (s == "none") { out = Activation::None; return true; }
+  if (s == "relu") { out = Activation::ReLU; return true; }
+  if (s == "gelu") { out = Activation::GELU; return true; }
+  return false;
+}
+
+// Kernels accumulate alpha * A*B on top of epi_seed(C) and pass the final
+// value through epi_finish. The SIMD paths fold both into the first and last
+// update of each C vector so it stays in a register across the epilogue.
+static inline float epi_seed(const Epilogue& e, float c) {
+  return e.beta == 0.0f ? 0.0f : e.beta * c;
+}
+
+// tanh form of GELU; the AVX2 path evaluates the same expression.
+static inline float gelu(float x) {
+  const float y = 0.7978845608f * (x + 0.044715f * x * x * x);
+  return 0.5f * x * (1.0f + std::tanh(y));
+}
+
+static inline float epi_finish(const Epilogue& e, float v, int i, int j) {
+  if (e.row_bias) v += e.row_bias[i];
+  if (e.col_bias) v += e.col_bias[j];
+  switch (e.act) {
+    case Activation::ReLU: return v > 0.0f ? v : 0.0f;
+    case Activation::GELU: return gelu(v);
+    default: return v;
+  }
+}
+
+// Plain overwrite (C = A*B): register-tile kernels store the tile directly.
+static inline bool epi_is_plain(const Epilogue& e) {
+  return e.alpha == 1.0f && e.beta == 0.0f && !e.row_bias && !e.col_bias &&
+         e.act == Activation::None;
+}
+
+// C = epilogue(seed) for rows [i0, i1), columns [j0, j1): the result when
+// the product contributes nothing (k == 0, empty sparse rows).
+static void epi_only(const Epilogue& e, float* C, int n, int i0, int i1, int j0, int j1) {
+  for (int i = i0; i < i1; i++) {
+    float* crow = &C[(size_t)i * n];
+    for (int j = j0; j < j1; j++) crow[j] = epi_finish(e, epi_seed(e, crow[j]), i, j);
+  }
+}
+
+#if defined(__AVX2__)
+// exp(x) for |x| <= 88: 2^round(x*log2e) times a degree-5 polynomial on the
+// remainder (Cephes coefficients, ~1 ulp in the GELU range).
+static inline __m256 exp256_ps(__m256 x) {
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-88.0f)), _mm256_set1_ps(88.0f));
+  __m256 fx = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+                              _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(0.693359375f), x);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(-2.12194440e-4f), x);
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+  __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(fx), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+}
+
+// 0.5 x (1 + tanh(y)) == x - x / (exp(2y) + 1)
+static inline __m256 gelu8(__m256 x) {
+  __m256 x3 = _mm256_mul_ps(_mm256_mul_ps(x, x), x);
+  __m256 y = _mm256_mul_ps(_mm256_set1_ps(2.0f * 0.7978845608f),
+                           _mm256_fmadd_ps(_mm256_set1_ps(0.044715f), x3, x));
+  __m256 d = _mm256_add_ps(exp256_ps(y), _mm256_set1_ps(1.0f));
+  return _mm256_sub_ps(x, _mm256_div_ps(x, d));
+}
+
+static inline __m256 epi_seed8(const Epilogue& e, const float* c) {
+  if (e.beta == 0.0f) return _mm256_setzero_ps();
+  return _mm256_mul_ps(_mm256_set1_ps(e.beta), _mm256_loadu_ps(c));
+}
+
+// v holds columns j..j+7 of row i.
+static inline __m256 epi_finish8(const Epilogue& e, __m256 v, int i, int j) {
+  if (e.row_bias) v = _mm256_add_ps(v, _mm256_set1_ps(e.row_bias[i]));
+  if (e.col_bias) v = _mm256_add_ps(v, _mm256_loadu_ps(e.col_bias + j));
+  switch (e.act) {
+    case Activation::ReLU: return _mm256_max_ps(v, _mm256_setzero_ps());
+    case Activation::GELU: return gelu8(v);
+    default: return v;
+  }
+}
+#endif // __AVX2__
+
+// ---------------------------------------------------------------------------
+// Tiled GEMM on op(A) * op(B) with leading dimensions
+// ---------------------------------------------------------------------------
+
+// Each thread owns ii blocks of C rows. For every (ii, kk) and (kk, jj) tile
+// an untransposed operand is used in place through its leading dimension; a
+// transposed one is packed once into a row-major tile (transposed on the way)
+// and the tile is reused across the whole inner loop, so the transpose costs
+// one tile copy per reuse instead of a pass over the matrix.
+
+// dst (rows x cols, row stride ldd) = transpose of the cols x rows block at
+// src (row stride lds).
+static void pack_trans_scalar(const float* src, size_t lds, int rows, int cols,
+                              float* dst, int ldd) {
+  for (int c = 0; c < cols; c++) {
+    const float* s = src + (size_t)c * lds;
+    for (int r = 0; r < rows; r++) dst[(size_t)r * ldd + c] = s[r];
+  }
+}
+
+void gemm_tiled_op_scalar(Trans transA, Trans transB, const float* A, int lda,
+                          const float* B, int ldb, float* C, int ldc, int m, int k, int n,
+                          int tileM, int tileK, int tileN, const Epilogue& epi) {
+  if (k == 0) {
+    epi_only(epi, C, ldc, 0, m, 0, n);
+    return;
+  }
+#pragma omp parallel
+  {
+    AlignedBuffer pa, pb;
+    if (transA == Trans::T) pa = make_aligned_f32((size_t)tileM * tileK, 64);
+    if (transB == Trans::T) pb = make_aligned_f32((size_t)tileK * tileN, 64);
+#pragma omp for schedule(static)
+    for (int ii = 0; ii < m; ii += tileM) {
+      const int mi = std::min(m, ii + tileM) - ii;
+      for (int kk = 0; kk < k; kk += tileK) {
+        const int kt = std::min(k, kk + tileK) - kk;
+        const float* a = A + (size_t)ii * lda + kk;
+        size_t la = (size_t)lda;
+        if (transA == Trans::T) {
+          pack_trans_scalar(A + (size_t)kk * lda + ii, lda, mi, kt, pa.ptr, tileK);
+          a = pa.ptr;
+          la = (size_t)tileK;
         }
-        for (int j = j_vec_end; j < j1; j++) {
-          crow[j] += a * brow[j];
+        for (int jj = 0; jj < n; jj += tileN) {
+          const int nj = std::min(n, jj + tileN) - jj;
+          const float* b = B + (size_t)kk * ldb + jj;
+          size_t lb = (size_t)ldb;
+          if (transB == Trans::T) {
+            pack_trans_scalar(B + (size_t)jj * ldb + kk, ldb, kt, nj, pb.ptr, tileN);
+            b = pb.ptr;
+            lb = (size_t)tileN;
+          }
+          for (int i = 0; i < mi; i++) {
+            for (int t = 0; t < kt; t++) {
+              const float av = epi.alpha * a[i * la + t];
+              const float* bt = &b[t * lb];
+              float* c = &C[(size_t)(ii + i) * ldc + jj];
+              if (kk + t != 0 && kk + t != k - 1) {
+                for (int j = 0; j < nj; j++) c[j] += av * bt[j];
+                continue;
+              }
+              for (int j = 0; j < nj; j++) {
+                float v = (kk + t == 0) ? epi_seed(epi, c[j]) : c[j];
+                v += av * bt[j];
+                c[j] = (kk + t == k - 1) ? epi_finish(epi, v, ii + i, jj + j) : v;
+              }
+            }
+          }
         }
       }
     }
+    free_aligned(pa);
+    free_aligned(pb);
   }
 }
-#endif // __AVX2__
-
-double stream_triad_bandwidth_gbps(size_t N, int iters, uint64_t seed) {
-  (void)seed;
-  AlignedBuffer a = make_aligned_f32(N, 64);
-  AlignedBuffer b = make_aligned_f32(N, 64);
-  AlignedBuffer c = make_aligned_f32(N, 64);
 
-  fill_random(a.ptr, N, 1);
-  fill_random(b.ptr, N, 2);
-  fill_random(c.ptr, N, 3);
+void gemm_tiled_scalar(const float* A, const float* B, float* C,
+                       int m, int k, int n, int tileM, int tileK, int tileN,
+                       const Epilogue& epi) {
+  gemm_tiled_op_scalar(Trans::N, Trans::N, A, k, B, n, C, n, m, k, n, tileM, tileK, tileN, epi);
+}
 
-  volatile float s = 1.1f;
+#if defined(__AVX2__)
+// 8 x 8 block: dst row r = src column r.
+static inline void transpose8_avx2(const float* src, size_t lds, float* dst, int ldd) {
+  __m256 r[8], t[8];
+  for (int i = 0; i < 8; i++) r[i] = _mm256_loadu_ps(src + (size_t)i * lds);
+  for (int i = 0; i < 8; i += 2) {
+    t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+    t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+  }
+  for (int i = 0; i < 8; i += 4) {
+    r[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+    r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xEE);
+    r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+    r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xEE);
+  }
+  for (int i = 0; i < 4; i++) {
+    _mm256_storeu_ps(dst + (size_t)i * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+    _mm256_storeu_ps(dst + (size_t)(i + 4) * ldd, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+  }
+}
 
-  double t0 = now_seconds();
-  for (int it = 0; it < iters; it++) {
-#pragma omp parallel for schedule(static)
-    for (size_t i = 0; i < N; i++) {
-      a.ptr[i] = b.ptr[i] + s * c.ptr[i];
+static void pack_trans_avx2(const float* src, size_t lds, int rows, int cols,
+                            float* dst, int ldd) {
+  const int r8 = rows & ~7, c8 = cols & ~7;
+  for (int c = 0; c < c8; c += 8) {
+    for (int r = 0; r < r8; r += 8) {
+      transpose8_avx2(src + (size_t)c * lds + r, lds, dst + (size_t)r * ldd + c, ldd);
     }
   }
-  double t1 = now_seconds();
-  double sec = std::max(1e-9, t1 - t0);
+  if (r8 < rows) pack_trans_scalar(src + r8, lds, rows - r8, cols, dst + (size_t)r8 * ldd, ldd);
+  if (c8 < cols) pack_trans_scalar(src + (size_t)c8 * lds, lds, r8, cols - c8, dst + c8, ldd);
+}
 
-  double bytes_per_iter = (double)N * sizeof(float) * 4.0;
-  double gbps = (bytes_per_iter * (double)iters) / sec / 1e9;
+void gemm_tiled_op_avx2(Trans transA, Trans transB, const float* A, int lda,
+                        const float* B, int ldb, float* C, int ldc, int m, int k, int n,
+                        int tileM, int tileK, int tileN, const Epilogue& epi) {
+  if (k == 0) {
+    epi_only(epi, C, ldc, 0, m, 0, n);
+    return;
+  }
+#pragma omp parallel
+  {
+    AlignedBuffer pa, pb;
+    if (transA == Trans::T) pa = make_aligned_f32((size_t)tileM * tileK, 64);
+    if (transB == Trans::T) pb = make_aligned_f32((size_t)tileK * tileN, 64);
+#pragma omp for schedule(static)
+    for (int ii = 0; ii < m; ii += tileM) {
+      const int mi = std::min(m, ii + tileM) - ii;
+      for (int kk = 0; kk < k; kk += tileK) {
+        const int kt = std::min(k, kk + tileK) - kk;
+        const float* a = A + (size_t)ii * lda + kk;
+        size_t la = (size_t)lda;
+        if (transA == Trans::T) {
+          pack_trans_avx2(A + (size_t)kk * lda + ii, lda, mi, kt, pa.ptr, tileK);
+          a = pa.ptr;
+          la = (size_t)tileK;
+        }
+        for (int jj = 0; jj < n; jj += tileN) {
+          const int nj = std::min(n, jj + tileN) - jj;
+          const float* b = B + (size_t)kk * ldb + jj;
+          size_t lb = (size_t)ldb;
+          if (transB == Trans::T) {
+            pack_trans_avx2(B + (size_t)jj * ldb + kk, ldb, kt, nj, pb.ptr, tileN);
+            b = pb.ptr;
+            lb = (size_t)tileN;
+          }
+          // The first k step seeds each C vector from beta * C (or zero) and
+          // the last one applies bias and activation before the store, so the
+          // epilogue costs no extra traffic over C.
+          float* ct = C + (size_t)ii * ldc + jj;
+          const bool first = (kk == 0), last = (kk + kt == k);
+          const int nv = (nj / 8) * 8;
+          for (int i = 0; i < mi; i++) {
+            float* c = ct + (size_t)i * ldc;
+            for (int t = 0; t < kt; t++) {
+              const float av = epi.alpha * a[(size_t)i * la + t];
+              const __m256 a8 = _mm256_set1_ps(av);
+              const float* bt = b + (size_t)t * lb;
+              const bool seed = first && t == 0;
+              const bool fin = last && t == kt - 1;
 
-  free_aligned(a); free_aligned(b); free_aligned(c);
-  return gbps;
-}
+              if (!seed && !fin) {
+                for (int j = 0; j < nv; j += 8) {
+                  __m256 cv = _mm256_loadu_ps(c + j);
+                  cv = _mm256_fmadd_ps(a8, _mm256_loadu_ps(bt + j), cv);
+                  _mm256_storeu_ps(c + j, cv);
+                }
+                for (int j = nv; j < nj; j++) c[j] += av * bt[j];
+                continue;
+              }
 
+              for (int j = 0; j < nv; j += 8) {
+                __m256 cv = seed ? epi_seed8(epi, c + j) : _mm256_loadu_ps(c + j);
+                cv = _mm256_fmadd_ps(a8, _mm256_loadu_ps(bt + j), cv);
+                if (fin) cv = epi_finish8(epi, cv, ii + i, jj + j);
+                _mm256_storeu_ps(c + j, cv);
+              }
+              for (int j = nv; j < nj; j++) {
+                float v = seed ? epi_seed(epi, c[j]) : c[j];
+                v += av * bt[j];
+                c[j] = fin ? epi_finish(epi, v, ii + i, jj + j) : v;
+              }
+            }
+          }
+        }
+      }
+    }
+    free_aligned(pa);
+    free_aligned(pb);
+  }
+}
+
+void gemm_tiled_avx2(const float* A, const float* B, float* C,
+                     int m, int k, int n, int tileM, int tileK, int tileN,
+                     const Epilogue& epi) {
+  gemm_tiled_op_avx2(Trans::N, Trans::N, A, k, B, n, C, n, m, k, n, tileM, tileK, tileN, epi);
+}
+#endif // __AVX2__
+
+// ---------------------------------------------------------------------------
+// Cache-oblivious recursive GEMM
+// ---------------------------------------------------------------------------
+
+// Leaf size (elements per side) for the row-major recursion, and the work
+// below which a split stops spawning tasks.
+static const int kRecLeaf = 64;
+static const double kRecTaskFlops = 4.0e6;
+
+// C block (+)= alpha * A block * B block over kt steps. first/last say whether
+// this k slice is the first/last one for the block, which decides whether C is
+// seeded from the epilogue and whether bias/activation are applied. gi/gj are
+// the block's global row/column (for the bias vectors).
+static void rec_base_scalar(const float* A, int lda, const float* B, int ldb, float* C, int ldc,
+                            int mi, int kt, int nj, int gi, int gj, bool first, bool last,
+                            const Epilogue& e) {
+  for (int i = 0; i < mi; i++) {
+    float* c = &C[(size_t)i * ldc];
+    if (first) {
+      for (int j = 0; j < nj; j++) c[j] = epi_seed(e, c[j]);
+    }
+    for (int t = 0; t < kt; t++) {
+      const float a = e.alpha * A[(size_t)i * lda + t];
+      const float* b = &B[(size_t)t * ldb];
+      for (int j = 0; j < nj; j++) c[j] += a * b[j];
+    }
+    if (last) {
+      for (int j = 0; j < nj; j++) c[j] = epi_finish(e, c[j], gi + i, gj + j);
+    }
+  }
+}
+
+#if defined(__AVX2__)
+// R x 8V register tile: the k loop only touches registers; C is read (unless
+// seeded) and written once per leaf.
+template <int R, int V>
+static inline void rec_tile_avx2(const float* A, int lda, const float* B, int ldb, float* C, int ldc,
+                                 int kt, int gi, int gj, bool first, bool last, const Epilogue& e) {
+  __m256 acc[R][V];
+  for (int r = 0; r < R; r++)
+    for (int v = 0; v < V; v++) acc[r][v] = _mm256_setzero_ps();
+  for (int t = 0; t < kt; t++) {
+    __m256 b[V];
+    for (int v = 0; v < V; v++) b[v] = _mm256_loadu_ps(&B[(size_t)t * ldb + 8 * v]);
+    for (int r = 0; r < R; r++) {
+      const __m256 a = _mm256_broadcast_ss(&A[(size_t)r * lda + t]);
+      for (int v = 0; v < V; v++) acc[r][v] = _mm256_fmadd_ps(a, b[v], acc[r][v]);
+    }
+  }
+  const __m256 alpha8 = _mm256_set1_ps(e.alpha);
+  for (int r = 0; r < R; r++) {
+    for (int v = 0; v < V; v++) {
+      float* c = &C[(size_t)r * ldc + 8 * v];
+      __m256 cv = first ? epi_seed8(e, c) : _mm256_loadu_ps(c);
+      cv = _mm256_fmadd_ps(alpha8, acc[r][v], cv);
+      if (last) cv = epi_finish8(e, cv, gi + r, gj + 8 * v);
+      _mm256_storeu_ps(c, cv);
+    }
+  }
+}
+
+static void rec_base_avx2(const float* A, int lda, const float* B, int ldb, float* C, int ldc,
+                          int mi, int kt, int nj, int gi, int gj, bool first, bool last,
+                          const Epilogue& e) {
+  const int n16 = (nj / 16) * 16;
+  const int n8 = (nj / 8) * 8;
+  int i = 0;
+  for (; i + 4 <= mi; i += 4) {
+    const float* a = &A[(size_t)i * lda];
+    float* c = &C[(size_t)i * ldc];
+    for (int j = 0; j < n16; j += 16) {
+      rec_tile_avx2<4, 2>(a, lda, B + j, ldb, c + j, ldc, kt, gi + i, gj + j, first, last, e);
+    }
+    if (n16 < n8) rec_tile_avx2<4, 1>(a, lda, B + n16, ldb, c + n16, ldc, kt, gi + i, gj + n16, first, last, e);
+  }
+  for (; i < mi; i++) {
+    const float* a = &A[(size_t)i * lda];
+    float* c = &C[(size_t)i * ldc];
+    for (int j = 0; j < n16; j += 16) {
+      rec_tile_avx2<1, 2>(a, lda, B + j, ldb, c + j, ldc, kt, gi + i, gj + j, first, last, e);
+    }
+    if (n16 < n8) rec_tile_avx2<1, 1>(a, lda, B + n16, ldb, c + n16, ldc, kt, gi + i, gj + n16, first, last, e);
+  }
+  if (n8 < nj) {
+    rec_base_scalar(A, lda, B + n8, ldb, C + n8, ldc, mi, kt, nj - n8, gi, gj + n8, first, last, e);
+  }
+}
+#endif // __AVX2__
+
+// Midpoint of [lo, lo + len), rounded up to a multiple of step when that
+// still leaves two non-empty halves (keeps leaves on whole register tiles).
+static inline int rec_mid(int lo, int len, int step) {
+  int h = ((len / 2 + step - 1) / step) * step;
+  if (h <= 0 || h >= len) h = len / 2;
+  return lo + h;
+}
+
+// Halves the longest of the three ranges until none exceeds leaf, then calls
+// base(i0, i1, t0, t1, j0, j1). Ranges are in elements or in tiles;
+// unit_flops is the work of one unit^3 cell.
+template <typename Base>
+static void rec_split(const Base& base, int i0, int i1, int t0, int t1, int j0, int j1,
+                      int leaf, int step_m, int step_n, double unit_flops) {
+  const int mi = i1 - i0, kt = t1 - t0, nj = j1 - j0;
+  if (mi <= leaf && kt <= leaf && nj <= leaf) {
+    base(i0, i1, t0, t1, j0, j1);
+    return;
+  }
+  // Both k halves accumulate into the same C block, so they run in order.
+  if (kt >= mi && kt >= nj) {
+    const int tm = rec_mid(t0, kt, 1);
+    rec_split(base, i0, i1, t0, tm, j0, j1, leaf, step_m, step_n, unit_flops);
+    rec_split(base, i0, i1, tm, t1, j0, j1, leaf, step_m, step_n, unit_flops);
+    return;
+  }
+  const bool spawn = unit_flops * mi * (double)kt * nj > kRecTaskFlops;
+  if (mi >= nj) {
+    const int im = rec_mid(i0, mi, step_m);
+#pragma omp task if (spawn) default(shared) firstprivate(i0, im, t0, t1, j0, j1)
+    rec_split(base, i0, im, t0, t1, j0, j1, leaf, step_m, step_n, unit_flops);
+    rec_split(base, im, i1, t0, t1, j0, j1, leaf, step_m, step_n, unit_flops);
+  } else {
+    const int jm = rec_mid(j0, nj, step_n);
+#pragma omp task if (spawn) default(shared) firstprivate(i0, i1, t0, t1, j0, jm)
+    rec_split(base, i0, i1, t0, t1, j0, jm, leaf, step_m, step_n, unit_flops);
+    rec_split(base, i0, i1, t0, t1, jm, j1, leaf, step_m, step_n, unit_flops);
+  }
+#pragma omp taskwait
+}
+
+// One team; the recursion starts on a single thread and the others pick up
+// tasks at the barrier.
+template <typename Base>
+static void rec_run(const Base& base, int mi, int kt, int nj, int leaf, int step_m, int step_n,
+                    double unit_flops) {
+#pragma omp parallel
+#pragma omp single
+  rec_split(base, 0, mi, 0, kt, 0, nj, leaf, step_m, step_n, unit_flops);
+}
+
+template <bool Simd>
+static void gemm_recursive_impl(const float* A, const float* B, float* C, int m, int k, int n,
+                                const Epilogue& epi) {
+  if (k == 0) {
+    epi_only(epi, C, n, 0, m, 0, n);
+    return;
+  }
+  auto base = [&](int i0, int i1, int t0, int t1, int j0, int j1) {
+    const float* a = &A[(size_t)i0 * k + t0];
+    const float* b = &B[(size_t)t0 * n + j0];
+    float* c = &C[(size_t)i0 * n + j0];
+#if defined(__AVX2__)
+    if (Simd) {
+      rec_base_avx2(a, k, b, n, c, n, i1 - i0, t1 - t0, j1 - j0, i0, j0, t0 == 0, t1 == k, epi);
+      return;
+    }
+#endif
+    rec_base_scalar(a, k, b, n, c, n, i1 - i0, t1 - t0, j1 - j0, i0, j0, t0 == 0, t1 == k, epi);
+  };
+  rec_run(base, m, k, n, kRecLeaf, 4, 16, 2.0);
+}
+
+void gemm_recursive_scalar(const float* A, const float* B, float* C, int m, int k, int n,
+                           const Epilogue& epi) {
+  gemm_recursive_impl<false>(A, B, C, m, k, n, epi);
+}
+
+#if defined(__AVX2__)
+void gemm_recursive_avx2(const float* A, const float* B, float* C, int m, int k, int n,
+                         const Epilogue& epi) {
+  gemm_recursive_impl<true>(A, B, C, m, k, n, epi);
+}
+#endif
+
+// Tile slots in visiting order: halve the longer side of the tile grid (rows
+// on ties), which is Z-order on square power-of-two grids.
+static void morton_slots(int r0, int r1, int c0, int c1, int col_tiles, std::vector<int>& slot, int& next) {
+  if (r1 - r0 == 1 && c1 - c0 == 1) {
+    slot[(size_t)r0 * col_tiles + c0] = next++;
+    return;
+  }
+  if (r1 - r0 >= c1 - c0) {
+    const int rm = r0 + (r1 - r0) / 2;
+    morton_slots(r0, rm, c0, c1, col_tiles, slot, next);
+    morton_slots(rm, r1, c0, c1, col_tiles, slot, next);
+  } else {
+    const int cm = c0 + (c1 - c0) / 2;
+    morton_slots(r0, r1, c0, cm, col_tiles, slot, next);
+    morton_slots(r0, r1, cm, c1, col_tiles, slot, next);
+  }
+}
+
+MortonMatrix make_morton(const float* X, int rows, int cols, int tile) {
+  MortonMatrix M;
+  M.rows = rows;
+  M.cols = cols;
+  M.tile = std::max(1, tile);
+  M.row_tiles = (rows + M.tile - 1) / M.tile;
+  M.col_tiles = (cols + M.tile - 1) / M.tile;
+  const size_t tiles = (size_t)M.row_tiles * M.col_tiles;
+  M.slot.assign(tiles, 0);
+  int next = 0;
+  if (tiles) morton_slots(0, M.row_tiles, 0, M.col_tiles, M.col_tiles, M.slot, next);
+
+  const size_t tt = (size_t)M.tile * M.tile;
+  M.data = make_aligned_f32(std::max<size_t>(1, tiles * tt), 64);
+#pragma omp parallel for schedule(static)
+  for (long id = 0; id < (long)tiles; id++) {
+    const int ti = (int)(id / M.col_tiles), tj = (int)(id % M.col_tiles);
+    float* dst = M.data.ptr + (size_t)M.slot[(size_t)id] * tt;
+    for (int r = 0; r < M.tile; r++) {
+      const int gr = ti * M.tile + r;
+      for (int c = 0; c < M.tile; c++) {
+        const int gc = tj * M.tile + c;
+        dst[(size_t)r * M.tile + c] = (gr < rows && gc < cols) ? X[(size_t)gr * cols + gc] : 0.0f;
+      }
+    }
+  }
+  return M;
+}
+
+void free_morton(MortonMatrix& M) {
+  free_aligned(M.data);
+  M.slot.clear();
+  M.rows = M.cols = M.row_tiles = M.col_tiles = 0;
+}
+
+template <bool Simd>
+static void gemm_morton_impl(const MortonMatrix& A, const MortonMatrix& B, float* C,
+                             const Epilogue& epi) {
+  const int m = A.rows, k = A.cols, n = B.cols, T = A.tile;
+  if (B.rows != k || B.tile != T) std::abort();
+  if (k == 0) {
+    epi_only(epi, C, n, 0, m, 0, n);
+    return;
+  }
+  const size_t tt = (size_t)T * T;
+  // One tile triple per leaf; edge tiles use the real extents (the zero
+  // padding is never multiplied).
+  auto base = [&](int ti, int, int tk, int, int tj, int) {
+    const float* a = A.data.ptr + (size_t)A.slot[(size_t)ti * A.col_tiles + tk] * tt;
+    const float* b = B.data.ptr + (size_t)B.slot[(size_t)tk * B.col_tiles + tj] * tt;
+    const int i0 = ti * T, t0 = tk * T, j0 = tj * T;
+    const int mi = std::min(T, m - i0), kt = std::min(T, k - t0), nj = std::min(T, n - j0);
+    float* c = &C[(size_t)i0 * n + j0];
+#if defined(__AVX2__)
+    if (Simd) {
+      rec_base_avx2(a, T, b, T, c, n, mi, kt, nj, i0, j0, tk == 0, t0 + kt == k, epi);
+      return;
+    }
+#endif
+    rec_base_scalar(a, T, b, T, c, n, mi, kt, nj, i0, j0, tk == 0, t0 + kt == k, epi);
+  };
+  rec_run(base, A.row_tiles, A.col_tiles, B.col_tiles, 1, 1, 1, 2.0 * (double)tt * T);
+}
+
+void gemm_morton_scalar(const MortonMatrix& A, const MortonMatrix& B, float* C, const Epilogue& epi) {
+  gemm_morton_impl<false>(A, B, C, epi);
+}
+
+#if defined(__AVX2__)
+void gemm_morton_avx2(const MortonMatrix& A, const MortonMatrix& B, float* C, const Epilogue& epi) {
+  gemm_morton_impl<true>(A, B, C, epi);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Strassen-Winograd GEMM
+// ---------------------------------------------------------------------------
+
+// Arena slices are rounded to 16 floats so every slice stays 64-byte aligned.
+static inline size_t arena_span(size_t floats) { return (floats + 15) & ~(size_t)15; }
+
+void reserve_arena(GemmArena& a, size_t floats) {
+  if (a.top != 0) std::abort();
+  if (a.buf.count >= floats) return;
+  free_aligned(a.buf);
+  a.buf = make_aligned_f32(arena_span(floats), 64);
+}
+
+void free_arena(GemmArena& a) {
+  free_aligned(a.buf);
+  a.top = 0;
+}
+
+static float* arena_take(GemmArena& a, size_t floats) {
+  const size_t span = arena_span(floats);
+  if (a.top + span > a.buf.count) std::abort();
+  float* p = a.buf.ptr + a.top;
+  a.top += span;
+  return p;
+}
+
+static const int kStrassenMinCutoff = 16;
+
+static inline bool sw_split(int m, int k, int n, int cutoff) {
+  return std::min(m, std::min(k, n)) > std::max(cutoff, kStrassenMinCutoff);
+}
+
+int strassen_levels(int m, int k, int n, int cutoff) {
+  int l = 0;
+  while (sw_split(m, k, n, cutoff)) { m /= 2; k /= 2; n /= 2; l++; }
+  return l;
+}
+
+double strassen_error_bound(int m, int k, int n, int cutoff) {
+  const int levels = strassen_levels(m, k, n, cutoff);
+  const double big = (double)std::max(m, std::max(k, n));
+  const double n0 = std::ceil(big / std::ldexp(1.0, levels));
+  return (std::pow(18.0, levels) * (n0 * n0 + 6.0 * n0) - 6.0 * big) * std::ldexp(1.0, -24);
+}
+
+// Per level: X (mh x kh), Y (kh x nh), Z (mh x nh). Leaves run on the
+// strided quadrants in place and need none.
+static size_t sw_floats(int m, int k, int n, int cutoff) {
+  if (!sw_split(m, k, n, cutoff)) return 0;
+  const int mh = m / 2, kh = k / 2, nh = n / 2;
+  return arena_span((size_t)mh * kh) + arena_span((size_t)kh * nh) + arena_span((size_t)mh * nh) +
+         sw_floats(mh, kh, nh, cutoff);
+}
+
+size_t strassen_arena_floats(int m, int k, int n, int cutoff) {
+  // + the staged product for beta != 0
+  return sw_floats(m, k, n, cutoff) + arena_span((size_t)m * n);
+}
+
+struct SwCtx {
+  int cutoff, tileM, tileK, tileN;
+  bool simd;
+  GemmArena* arena;
+};
+
+// Below this many elements an add runs on the calling thread.
+static const size_t kSwParallelElems = (size_t)1 << 15;
+
+// D = X + s * Y on rows x cols blocks; D may alias X or Y.
+static void sw_add(float* D, int ldd, const float* X, int ldx, const float* Y, int ldy, float s,
+                   int rows, int cols) {
+#pragma omp parallel for schedule(static) if ((size_t)rows * cols > kSwParallelElems)
+  for (int i = 0; i < rows; i++) {
+    float* d = D + (size_t)i * ldd;
+    const float* x = X + (size_t)i * ldx;
+    const float* y = Y + (size_t)i * ldy;
+    for (int j = 0; j < cols; j++) d[j] = x[j] + s * y[j];
+  }
+}
+
+// C = A * B with gemm_tiled straight on the strided quadrants.
+static void sw_leaf(const float* A, int lda, const float* B, int ldb, float* C, int ldc,
+                    int m, int k, int n, const SwCtx& ctx) {
+#if defined(__AVX2__)
+  if (ctx.simd) {
+    gemm_tiled_op_avx2(Trans::N, Trans::N, A, lda, B, ldb, C, ldc, m, k, n,
+                       ctx.tileM, ctx.tileK, ctx.tileN);
+    return;
+  }
+#endif
+  gemm_tiled_op_scalar(Trans::N, Trans::N, A, lda, B, ldb, C, ldc, m, k, n,
+                       ctx.tileM, ctx.tileK, ctx.tileN);
+}
+
+// Odd trailing row / column / k step of an m x k x n product whose even core
+// [0, me) x [0, ke) x [0, ne) is already in C.
+static void sw_peel(const float* A, int lda, const float* B, int ldb, float* C, int ldc,
+                    int m, int k, int n, int me, int ke, int ne) {
+  if (ke < k) {
+#pragma omp parallel for schedule(static) if ((size_t)me * ne > kSwParallelElems)
+    for (int i = 0; i < me; i++) {
+      const float a = A[(size_t)i * lda + ke];
+      const float* b = B + (size_t)ke * ldb;
+      float* c = C + (size_t)i * ldc;
+      for (int j = 0; j < ne; j++) c[j] += a * b[j];
+    }
+  }
+  if (ne < n) {
+#pragma omp parallel for schedule(static) if ((size_t)me * k > kSwParallelElems)
+    for (int i = 0; i < me; i++) {
+      const float* a = A + (size_t)i * lda;
+      float s = 0.0f;
+      for (int t = 0; t < k; t++) s += a[t] * B[(size_t)t * ldb + ne];
+      C[(size_t)i * ldc + ne] = s;
+    }
+  }
+  if (me < m) {
+    const float* a = A + (size_t)me * lda;
+    float* c = C + (size_t)me * ldc;
+    for (int j = 0; j < n; j++) c[j] = 0.0f;
+    for (int t = 0; t < k; t++) {
+      const float* b = B + (size_t)t * ldb;
+      for (int j = 0; j < n; j++) c[j] += a[t] * b[j];
+    }
+  }
+}
+
+// C = A * B (overwrite, no epilogue) on strided views. Winograd's schedule
+// with the C quadrants as product storage and three temporaries: X for the A
+// sums, Y for the B sums, Z for P1 = A11 B11.
+static void sw_rec(const float* A, int lda, const float* B, int ldb, float* C, int ldc,
+                   int m, int k, int n, const SwCtx& ctx) {
+  if (!sw_split(m, k, n, ctx.cutoff)) {
+    sw_leaf(A, lda, B, ldb, C, ldc, m, k, n, ctx);
+    return;
+  }
+  const int mh = m / 2, kh = k / 2, nh = n / 2;
+  const float* A11 = A;
+  const float* A12 = A + kh;
+  const float* A21 = A + (size_t)mh * lda;
+  const float* A22 = A21 + kh;
+  const float* B11 = B;
+  const float* B12 = B + nh;
+  const float* B21 = B + (size_t)kh * ldb;
+  const float* B22 = B21 + nh;
+  float* C11 = C;
+  float* C12 = C + nh;
+  float* C21 = C + (size_t)mh * ldc;
+  float* C22 = C21 + nh;
+
+  GemmArena& ar = *ctx.arena;
+  const size_t mark = ar.top;
+  float* X = arena_take(ar, (size_t)mh * kh);
+  float* Y = arena_take(ar, (size_t)kh * nh);
+  float* Z = arena_take(ar, (size_t)mh * nh);
+
+  sw_add(X, kh, A11, lda, A21, lda, -1.0f, mh, kh);     // S3 = A11 - A21
+  sw_add(Y, nh, B22, ldb, B12, ldb, -1.0f, kh, nh);     // T3 = B22 - B12
+  sw_rec(X, kh, Y, nh, C21, ldc, mh, kh, nh, ctx);      // P7 = S3 T3
+  sw_add(X, kh, A21, lda, A22, lda, 1.0f, mh, kh);      // S1 = A21 + A22
+  sw_add(Y, nh, B12, ldb, B11, ldb, -1.0f, kh, nh);     // T1 = B12 - B11
+  sw_rec(X, kh, Y, nh, C22, ldc, mh, kh, nh, ctx);      // P5 = S1 T1
+  sw_add(X, kh, X, kh, A11, lda, -1.0f, mh, kh);        // S2 = S1 - A11
+  sw_add(Y, nh, B22, ldb, Y, nh, -1.0f, kh, nh);        // T2 = B22 - T1
+  sw_rec(X, kh, Y, nh, C12, ldc, mh, kh, nh, ctx);      // P6 = S2 T2
+  sw_add(X, kh, A12, lda, X, kh, -1.0f, mh, kh);        // S4 = A12 - S2
+  sw_rec(X, kh, B22, ldb, C11, ldc, mh, kh, nh, ctx);   // P3 = S4 B22
+  sw_rec(A11, lda, B11, ldb, Z, nh, mh, kh, nh, ctx);   // P1 = A11 B11
+  sw_add(C12, ldc, Z, nh, C12, ldc, 1.0f, mh, nh);      // U2 = P1 + P6
+  sw_add(C21, ldc, C12, ldc, C21, ldc, 1.0f, mh, nh);   // U3 = U2 + P7
+  sw_add(C12, ldc, C12, ldc, C22, ldc, 1.0f, mh, nh);   // U4 = U2 + P5
+  sw_add(C22, ldc, C21, ldc, C22, ldc, 1.0f, mh, nh);   // C22 = U3 + P5
+  sw_add(C12, ldc, C12, ldc, C11, ldc, 1.0f, mh, nh);   // C12 = U4 + P3
+  sw_add(Y, nh, Y, nh, B21, ldb, -1.0f, kh, nh);        // T4 = T2 - B21
+  sw_rec(A22, lda, Y, nh, C11, ldc, mh, kh, nh, ctx);   // P4 = A22 T4
+  sw_add(C21, ldc, C21, ldc, C11, ldc, -1.0f, mh, nh);  // C21 = U3 - P4
+  sw_rec(A12, lda, B21, ldb, C11, ldc, mh, kh, nh, ctx);  // P2 = A12 B21
+  sw_add(C11, ldc, C11, ldc, Z, nh, 1.0f, mh, nh);      // C11 = P1 + P2
+  ar.top = mark;
+
+  if (2 * mh < m || 2 * kh < k || 2 * nh < n) {
+    sw_peel(A, lda, B, ldb, C, ldc, m, k, n, 2 * mh, 2 * kh, 2 * nh);
+  }
+}
+
+template <bool Simd>
+static void gemm_strassen_impl(const float* A, const float* B, float* C, int m, int k, int n,
+                               int cutoff, int tileM, int tileK, int tileN, GemmArena& arena,
+                               const Epilogue& epi) {
+  if (k == 0) {
+    epi_only(epi, C, n, 0, m, 0, n);
+    return;
+  }
+  const bool staged = epi.beta != 0.0f;
+  const size_t need = sw_floats(m, k, n, cutoff) + (staged ? arena_span((size_t)m * n) : 0);
+  if (arena.buf.count < need) reserve_arena(arena, strassen_arena_floats(m, k, n, cutoff));
+
+  const SwCtx ctx = {cutoff, tileM, tileK, tileN, Simd, &arena};
+  const size_t mark = arena.top;
+  float* P = staged ? arena_take(arena, (size_t)m * n) : C;
+  sw_rec(A, k, B, n, P, n, m, k, n, ctx);
+  if (!epi_is_plain(epi)) {
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < m; i++) {
+      const float* p = P + (size_t)i * n;
+      float* c = C + (size_t)i * n;
+      for (int j = 0; j < n; j++) c[j] = epi_finish(epi, epi_seed(epi, c[j]) + epi.alpha * p[j], i, j);
+    }
+  }
+  arena.top = mark;
+}
+
+void gemm_strassen_scalar(const float* A, const float* B, float* C, int m, int k, int n,
+                          int cutoff, int tileM, int tileK, int tileN, GemmArena& arena,
+                          const Epilogue& epi) {
+  gemm_strassen_impl<false>(A, B, C, m, k, n, cutoff, tileM, tileK, tileN, arena, epi);
+}
+
+#if defined(__AVX2__)
+void gemm_strassen_avx2(const float* A, const float* B, float* C, int m, int k, int n,
+                        int cutoff, int tileM, int tileK, int tileN, GemmArena& arena,
+                        const Epilogue& epi) {
+  gemm_strassen_impl<true>(A, B, C, m, k, n, cutoff, tileM, tileK, tileN, arena, epi);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Batched small GEMM
+// ---------------------------------------------------------------------------
+
+// Below this much total work the batch runs on the calling thread.
+static const double kBatchedParallelFlops = 2.0e6;
+
+static void gemm_small_scalar(const float* A, const float* B, float* C, int m, int k, int n) {
+  for (int i = 0; i < m; i++) {
+    float* c = &C[(size_t)i * n];
+    for (int j = 0; j < n; j++) c[j] = 0.0f;
+    for (int t = 0; t < k; t++) {
+      float a = A[(size_t)i * k + t];
+      const float* b = &B[(size_t)t * n];
+      for (int j = 0; j < n; j++) c[j] += a * b[j];
+    }
+  }
+}
+
+void gemm_batched_scalar(const float* const* A, const float* const* B, float* const* C,
+                         const GemmShape* shapes, int count, double* seconds) {
+  double work = 0.0;
+  for (int b = 0; b < count; b++) work += 2.0 * shapes[b].m * shapes[b].k * shapes[b].n;
+
+#pragma omp parallel for schedule(dynamic, 4) if (work > kBatchedParallelFlops)
+  for (int b = 0; b < count; b++) {
+    const double t0 = seconds ? now_seconds() : 0.0;
+    gemm_small_scalar(A[b], B[b], C[b], shapes[b].m, shapes[b].k, shapes[b].n);
+    if (seconds) seconds[b] = now_seconds() - t0;
+  }
+}
+
+#if defined(__AVX2__)
+// 4 x 16 register tile (8 ymm accumulators); M % 4 == 0 and N % 16 == 0.
+// With M/K/N known at compile time the k loop unrolls completely and all
+// A/B offsets become immediates.
+template <int M, int K, int N>
+static void gemm_small_fixed_avx2(const float* A, const float* B, float* C) {
+  static_assert(M % 4 == 0 && N % 16 == 0, "fixed kernel needs M%4==0, N%16==0");
+  for (int i = 0; i < M; i += 4) {
+    for (int j = 0; j < N; j += 16) {
+      __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+      __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+      __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+      __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+#pragma GCC unroll 128
+      for (int t = 0; t < K; t++) {
+        __m256 b0 = _mm256_loadu_ps(&B[t * N + j]);
+        __m256 b1 = _mm256_loadu_ps(&B[t * N + j + 8]);
+        __m256 a0 = _mm256_broadcast_ss(&A[(i + 0) * K + t]);
+        __m256 a1 = _mm256_broadcast_ss(&A[(i + 1) * K + t]);
+        __m256 a2 = _mm256_broadcast_ss(&A[(i + 2) * K + t]);
+        __m256 a3 = _mm256_broadcast_ss(&A[(i + 3) * K + t]);
+        c00 = _mm256_fmadd_ps(a0, b0, c00); c01 = _mm256_fmadd_ps(a0, b1, c01);
+        c10 = _mm256_fmadd_ps(a1, b0, c10); c11 = _mm256_fmadd_ps(a1, b1, c11);
+        c20 = _mm256_fmadd_ps(a2, b0, c20); c21 = _mm256_fmadd_ps(a2, b1, c21);
+        c30 = _mm256_fmadd_ps(a3, b0, c30); c31 = _mm256_fmadd_ps(a3, b1, c31);
+      }
+      _mm256_storeu_ps(&C[(i + 0) * N + j], c00); _mm256_storeu_ps(&C[(i + 0) * N + j + 8], c01);
+      _mm256_storeu_ps(&C[(i + 1) * N + j], c10); _mm256_storeu_ps(&C[(i + 1) * N + j + 8], c11);
+      _mm256_storeu_ps(&C[(i + 2) * N + j], c20); _mm256_storeu_ps(&C[(i + 2) * N + j + 8], c21);
+      _mm256_storeu_ps(&C[(i + 3) * N + j], c30); _mm256_storeu_ps(&C[(i + 3) * N + j + 8], c31);
+    }
+  }
+}
+
+// Any shape: same 4-row tile, 8-wide column vectors, scalar tails.
+static void gemm_small_avx2(const float* A, const float* B, float* C, int m, int k, int n) {
+  const int n_vec = (n / 8) * 8;
+  int i = 0;
+  for (; i + 4 <= m; i += 4) {
+    for (int j = 0; j < n_vec; j += 8) {
+      __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+      __m256 c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+      for (int t = 0; t < k; t++) {
+        __m256 b = _mm256_loadu_ps(&B[(size_t)t * n + j]);
+        c0 = _mm256_fmadd_ps(_mm256_broadcast_ss(&A[(size_t)(i + 0) * k + t]), b, c0);
+        c1 = _mm256_fmadd_ps(_mm256_broadcast_ss(&A[(size_t)(i + 1) * k + t]), b, c1);
+        c2 = _mm256_fmadd_ps(_mm256_broadcast_ss(&A[(size_t)(i + 2) * k + t]), b, c2);
+        c3 = _mm256_fmadd_ps(_mm256_broadcast_ss(&A[(size_t)(i + 3) * k + t]), b, c3);
+      }
+      _mm256_storeu_ps(&C[(size_t)(i + 0) * n + j], c0);
+      _mm256_storeu_ps(&C[(size_t)(i + 1) * n + j], c1);
+      _mm256_storeu_ps(&C[(size_t)(i + 2) * n + j], c2);
+      _mm256_storeu_ps(&C[(size_t)(i + 3) * n + j], c3);
+    }
+  }
+  for (; i < m; i++) {
+    for (int j = 0; j < n_vec; j += 8) {
+      __m256 c0 = _mm256_setzero_ps();
+      for (int t = 0; t < k; t++) {
+        c0 = _mm256_fmadd_ps(_mm256_broadcast_ss(&A[(size_t)i * k + t]),
+                             _mm256_loadu_ps(&B[(size_t)t * n + j]), c0);
+      }
+      _mm256_storeu_ps(&C[(size_t)i * n + j], c0);
+    }
+  }
+  if (n_vec < n) {
+    for (int r = 0; r < m; r++) {
+      for (int j = n_vec; j < n; j++) {
+        float sum = 0.0f;
+        for (int t = 0; t < k; t++) sum += A[(size_t)r * k + t] * B[(size_t)t * n + j];
+        C[(size_t)r * n + j] = sum;
+      }
+    }
+  }
+}
+
+static inline void gemm_small_dispatch_avx2(const float* A, const float* B, float* C, const GemmShape& s) {
+  if (s.m == s.k && s.k == s.n) {
+    switch (s.m) {
+      case 16:  gemm_small_fixed_avx2<16, 16, 16>(A, B, C); return;
+      case 32:  gemm_small_fixed_avx2<32, 32, 32>(A, B, C); return;
+      case 64:  gemm_small_fixed_avx2<64, 64, 64>(A, B, C); return;
+      case 128: gemm_small_fixed_avx2<128, 128, 128>(A, B, C); return;
+      default: break;
+    }
+  }
+  gemm_small_avx2(A, B, C, s.m, s.k, s.n);
+}
+
+void gemm_batched_avx2(const float* const* A, const float* const* B, float* const* C,
+                       const GemmShape* shapes, int count, double* seconds) {
+  double work = 0.0;
+  for (int b = 0; b < count; b++) work += 2.0 * shapes[b].m * shapes[b].k * shapes[b].n;
+
+#pragma omp parallel for schedule(dynamic, 4) if (work > kBatchedParallelFlops)
+  for (int b = 0; b < count; b++) {
+    const double t0 = seconds ? now_seconds() : 0.0;
+    gemm_small_dispatch_avx2(A[b], B[b], C[b], shapes[b]);
+    if (seconds) seconds[b] = now_seconds() - t0;
+  }
+}
+#endif // __AVX2__
+
+void gemm_batched(const float* const* A, const float* const* B, float* const* C,
+                  const GemmShape* shapes, int count, double* seconds) {
+#if defined(__AVX2__)
+  gemm_batched_avx2(A, B, C, shapes, count, seconds);
+#else
+  gemm_batched_scalar(A, B, C, shapes, count, seconds);
+#endif
+}
+
+void spmm_csr_scalar(const CSR& A, const float* B, float* C, int n,
+                     int jblock, LayoutB layoutB, const Epilogue& epi) {
+  const int m = A.m;
+
+  auto getB = [&](int col, int j)->float {
+    if (layoutB == LayoutB::RowMajor) return B[col * n + j];
+    return B[j * A.k + col];
+  };
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < m; i++) {
+    int p0 = A.rowptr[(size_t)i];
+    int p1 = A.rowptr[(size_t)i + 1];
+    float* crow = &C[i * n];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      for (int j = j0; j < j1; j++) crow[j] = epi_seed(epi, crow[j]);
+      for (int p = p0; p < p1; p++) {
+        int col = A.colidx[(size_t)p];
+        float a = epi.alpha * A.values[(size_t)p];
+        for (int j = j0; j < j1; j++) {
+          crow[j] += a * getB(col, j);
+        }
+      }
+      for (int j = j0; j < j1; j++) crow[j] = epi_finish(epi, crow[j], i, j);
+    }
+  }
+}
+
+#if defined(__AVX2__)
+// Transpose an 8x8 float block: src rows are 8 B columns (stride lds),
+// dst rows are 8 B rows of the packed panel (stride ldd).
+static inline void transpose8x8_ps(const float* src, size_t lds, float* dst, size_t ldd) {
+  __m256 r0 = _mm256_loadu_ps(src + 0 * lds);
+  __m256 r1 = _mm256_loadu_ps(src + 1 * lds);
+  __m256 r2 = _mm256_loadu_ps(src + 2 * lds);
+  __m256 r3 = _mm256_loadu_ps(src + 3 * lds);
+  __m256 r4 = _mm256_loadu_ps(src + 4 * lds);
+  __m256 r5 = _mm256_loadu_ps(src + 5 * lds);
+  __m256 r6 = _mm256_loadu_ps(src + 6 * lds);
+  __m256 r7 = _mm256_loadu_ps(src + 7 * lds);
+
+  __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+  __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+  __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+  __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+  __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+  __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+  __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+  __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+  __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+  __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+  __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+  _mm256_storeu_ps(dst + 0 * ldd, _mm256_permute2f128_ps(s0, s4, 0x20));
+  _mm256_storeu_ps(dst + 1 * ldd, _mm256_permute2f128_ps(s1, s5, 0x20));
+  _mm256_storeu_ps(dst + 2 * ldd, _mm256_permute2f128_ps(s2, s6, 0x20));
+  _mm256_storeu_ps(dst + 3 * ldd, _mm256_permute2f128_ps(s3, s7, 0x20));
+  _mm256_storeu_ps(dst + 4 * ldd, _mm256_permute2f128_ps(s0, s4, 0x31));
+  _mm256_storeu_ps(dst + 5 * ldd, _mm256_permute2f128_ps(s1, s5, 0x31));
+  _mm256_storeu_ps(dst + 6 * ldd, _mm256_permute2f128_ps(s2, s6, 0x31));
+  _mm256_storeu_ps(dst + 7 * ldd, _mm256_permute2f128_ps(s3, s7, 0x31));
+}
+
+// One C row segment crow[j0, j1) of row i: sum over cnt nonzeros of
+// vals[p] * brow_p[j - boff], brow_p = Bsrc + cols[p] * ldb. The first
+// nonzero seeds from the epilogue and the last applies it, so every C vector
+// is loaded and stored once per nonzero and never zero-filled. A row split
+// into several calls (column panels) passes seed only for its first piece and
+// finish only for its last; cnt == 0 needs both.
+static inline void csr_row_avx2(const int* cols, const float* vals, int cnt,
+                                const float* Bsrc, size_t ldb, int boff,
+                                float* crow, int i, int j0, int j1, const Epilogue& epi,
+                                bool seed = true, bool finish = true) {
+  const int j_vec_end = j0 + ((j1 - j0) / 8) * 8;
+  if (cnt == 0) {
+    for (int j = j0; j < j_vec_end; j += 8) {
+      _mm256_storeu_ps(crow + j, epi_finish8(epi, epi_seed8(epi, crow + j), i, j));
+    }
+    for (int j = j_vec_end; j < j1; j++) crow[j] = epi_finish(epi, epi_seed(epi, crow[j]), i, j);
+    return;
+  }
+
+  for (int p = 0; p < cnt; p++) {
+    const float a = epi.alpha * vals[p];
+    __m256 a8 = _mm256_set1_ps(a);
+    const float* brow = Bsrc + (size_t)cols[p] * ldb;
+
+    if (p != 0 && p != cnt - 1) {
+      for (int j = j0; j < j_vec_end; j += 8) {
+        __m256 bv = _mm256_loadu_ps(brow + (j - boff));
+        __m256 cv = _mm256_loadu_ps(crow + j);
+        cv = _mm256_fmadd_ps(a8, bv, cv);
+        _mm256_storeu_ps(crow + j, cv);
+      }
+      for (int j = j_vec_end; j < j1; j++) {
+        crow[j] += a * brow[j - boff];
+      }
+      continue;
+    }
+
+    const bool first = seed && (p == 0);
+    const bool last = finish && (p == cnt - 1);
+    for (int j = j0; j < j_vec_end; j += 8) {
+      __m256 bv = _mm256_loadu_ps(brow + (j - boff));
+      __m256 cv = first ? epi_seed8(epi, crow + j) : _mm256_loadu_ps(crow + j);
+      cv = _mm256_fmadd_ps(a8, bv, cv);
+      if (last) cv = epi_finish8(epi, cv, i, j);
+      _mm256_storeu_ps(crow + j, cv);
+    }
+    for (int j = j_vec_end; j < j1; j++) {
+      float v = first ? epi_seed(epi, crow[j]) : crow[j];
+      v += a * brow[j - boff];
+      crow[j] = last ? epi_finish(epi, v, i, j) : v;
+    }
+  }
+}
+
+// Column-major B (B[j * k + col]): for each jblock of output columns, transpose
+// the k x jb slab of B into a row-major panel once, then run the same
+// broadcast-FMA inner loop as the row-major path against the panel.
+static void spmm_csr_avx2_colB(const CSR& A, const float* B, float* C, int n, int jblock,
+                               const Epilogue& epi) {
+  const int m = A.m;
+  const int k = A.k;
+
+  const int jb_max = std::max(1, std::min(jblock, n));
+  AlignedBuffer panel = make_aligned_f32((size_t)k * (size_t)jb_max, 64);
+  float* P = panel.ptr;
+
+#pragma omp parallel
+  {
+    for (int j0 = 0; j0 < n; j0 += jb_max) {
+      const int jb = std::min(n, j0 + jb_max) - j0;
+      const int jb_vec = (jb / 8) * 8;
+      const int k_vec = (k / 8) * 8;
+
+      // Pack: P[col * jb + jj] = B[(j0 + jj) * k + col]
+#pragma omp for schedule(static)
+      for (int c0 = 0; c0 < k; c0 += 8) {
+        if (c0 < k_vec) {
+          int jj = 0;
+          for (; jj < jb_vec; jj += 8) {
+            transpose8x8_ps(&B[(size_t)(j0 + jj) * k + c0], (size_t)k,
+                            &P[(size_t)c0 * jb + jj], (size_t)jb);
+          }
+          for (; jj < jb; jj++) {
+            const float* bcol = &B[(size_t)(j0 + jj) * k];
+            for (int c = c0; c < c0 + 8; c++) P[(size_t)c * jb + jj] = bcol[c];
+          }
+        } else {
+          for (int jj = 0; jj < jb; jj++) {
+            const float* bcol = &B[(size_t)(j0 + jj) * k];
+            for (int c = c0; c < k; c++) P[(size_t)c * jb + jj] = bcol[c];
+          }
+        }
+      }
+      // implicit barrier: panel is complete before any row reads it
+
+#pragma omp for schedule(static)
+      for (int i = 0; i < m; i++) {
+        int p0 = A.rowptr[(size_t)i];
+        int p1 = A.rowptr[(size_t)i + 1];
+        csr_row_avx2(A.colidx.data() + p0, A.values.data() + p0, p1 - p0, P, (size_t)jb, j0,
+                     &C[(size_t)i * n], i, j0, j0 + jb, epi);
+      }
+      // implicit barrier: all rows done before the panel is overwritten
+    }
+  }
+
+  free_aligned(panel);
+}
+
+void spmm_csr_avx2(const CSR& A, const float* B, float* C, int n,
+                   int jblock, LayoutB layoutB, const Epilogue& epi) {
+  if (layoutB != LayoutB::RowMajor) {
+    spmm_csr_avx2_colB(A, B, C, n, jblock, epi);
+    return;
+  }
+
+  const int m = A.m;
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < m; i++) {
+    int p0 = A.rowptr[(size_t)i];
+    int p1 = A.rowptr[(size_t)i + 1];
+    float* crow = &C[(size_t)i * n];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      csr_row_avx2(A.colidx.data() + p0, A.values.data() + p0, p1 - p0, B, (size_t)n, 0,
+                   crow, i, j0, j1, epi);
+    }
+  }
+}
+#endif // __AVX2__
+
+// ---------------------------------------------------------------------------
+// 2D-blocked CSR-SpMM: output column blocks x A column panels
+// ---------------------------------------------------------------------------
+
+int csr_panel_k(int k, int jblock, size_t cache_bytes) {
+  if (cache_bytes == 0) cache_bytes = (size_t)1 << 20;
+  const size_t row_bytes = (size_t)std::max(1, jblock) * sizeof(float);
+  int pk = (int)std::min<size_t>((size_t)std::max(1, k), cache_bytes / 2 / row_bytes);
+  if (pk >= 64) pk = pk / 64 * 64;
+  return std::max(1, pk);
+}
+
+// Scalar row segment with the same seed/finish contract as csr_row_avx2.
+static inline void csr_row_scalar(const int* cols, const float* vals, int cnt,
+                                  const float* B, size_t ldb,
+                                  float* crow, int i, int j0, int j1, const Epilogue& epi,
+                                  bool seed, bool finish) {
+  if (seed) {
+    for (int j = j0; j < j1; j++) crow[j] = epi_seed(epi, crow[j]);
+  }
+  for (int p = 0; p < cnt; p++) {
+    const float a = epi.alpha * vals[p];
+    const float* brow = B + (size_t)cols[p] * ldb;
+    for (int j = j0; j < j1; j++) crow[j] += a * brow[j];
+  }
+  if (finish) {
+    for (int j = j0; j < j1; j++) crow[j] = epi_finish(epi, crow[j], i, j);
+  }
+}
+
+// Each thread keeps one cursor per row it owns. For a given jblock the
+// cursors start at the row starts and advance through the sorted column
+// indices one panel at a time, so a panel visit only reads that panel's
+// nonzeros and no split copy of A is built. Every loop is schedule(static)
+// over the same m rows inside one parallel region, so a thread owns the
+// same rows (and their C segments and cursors) in every panel and no
+// barrier is needed between panels.
+template <bool Simd>
+static void spmm_csr_panel_impl(const CSR& A, const float* B, float* C, int n,
+                                int jblock, int panel_k, const Epilogue& epi) {
+  const int m = A.m;
+  const int k = A.k;
+  const int jb = std::max(1, std::min(jblock, n));
+  const int pk = panel_k > 0 ? std::min(panel_k, std::max(1, k)) : std::max(1, k);
+  const int panels = std::max(1, (k + pk - 1) / pk);
+
+  const int* rowptr = A.rowptr.data();
+  const int* cols = A.colidx.data();
+  const float* vals = A.values.data();
+  std::vector<int> cursor((size_t)m);
+
+#pragma omp parallel
+  {
+    for (int j0 = 0; j0 < n; j0 += jb) {
+      const int j1 = std::min(n, j0 + jb);
+
+#pragma omp for schedule(static) nowait
+      for (int i = 0; i < m; i++) cursor[(size_t)i] = rowptr[(size_t)i];
+
+      for (int b = 0; b < panels; b++) {
+        const int c1 = (b == panels - 1) ? std::max(k, 1) : (b + 1) * pk;
+
+#pragma omp for schedule(static) nowait
+        for (int i = 0; i < m; i++) {
+          const int p0 = rowptr[(size_t)i];
+          const int p1 = rowptr[(size_t)i + 1];
+          const int q0 = cursor[(size_t)i];
+          int q1 = q0;
+          while (q1 < p1 && cols[q1] < c1) q1++;
+          cursor[(size_t)i] = q1;
+          // Empty pieces are skipped; an empty row still gets its epilogue once.
+          if (q1 == q0 && !(b == 0 && p0 == p1)) continue;
+
+          float* crow = &C[(size_t)i * n];
+#if defined(__AVX2__)
+          if constexpr (Simd) {
+            csr_row_avx2(cols + q0, vals + q0, q1 - q0, B, (size_t)n, 0, crow, i, j0, j1, epi,
+                         q0 == p0, q1 == p1);
+            continue;
+          }
+#endif
+          csr_row_scalar(cols + q0, vals + q0, q1 - q0, B, (size_t)n, crow, i, j0, j1, epi,
+                         q0 == p0, q1 == p1);
+        }
+      }
+    }
+  }
+}
+
+void spmm_csr_panel_scalar(const CSR& A, const float* B, float* C, int n,
+                           int jblock, int panel_k, const Epilogue& epi) {
+  spmm_csr_panel_impl<false>(A, B, C, n, jblock, panel_k, epi);
+}
+
+#if defined(__AVX2__)
+void spmm_csr_panel_avx2(const CSR& A, const float* B, float* C, int n,
+                         int jblock, int panel_k, const Epilogue& epi) {
+  spmm_csr_panel_impl<true>(A, B, C, n, jblock, panel_k, epi);
+}
+#endif
+
+// Same per-row piece as the panel kernel, for one panel and a row range. B
+// rows are addressed by global column index through Bsrc, which points c0
+// rows before the panel buffer (only rows in [c0, c1) are dereferenced).
+template <bool Simd>
+static void spmm_csr_rows_panel_impl(const CSR& A, int i0, int i1, int c0, int c1,
+                                     const float* Bpanel, float* Cpanel, int n, int jblock,
+                                     int* cursor, const Epilogue& epi) {
+  const int jb = std::max(1, std::min(jblock, n));
+  const int* rowptr = A.rowptr.data();
+  const int* cols = A.colidx.data();
+  const float* vals = A.values.data();
+  const float* Bsrc = Bpanel - (ptrdiff_t)c0 * n;
+
+#pragma omp parallel for schedule(static)
+  for (int i = i0; i < i1; i++) {
+    const int p0 = rowptr[(size_t)i];
+    const int p1 = rowptr[(size_t)i + 1];
+    const int q0 = c0 == 0 ? p0 : cursor[(size_t)i];
+    int q1 = q0;
+    while (q1 < p1 && cols[q1] < c1) q1++;
+    cursor[(size_t)i] = q1;
+    if (q1 == q0 && !(c0 == 0 && p0 == p1)) continue;
+
+    float* crow = Cpanel + (size_t)(i - i0) * n;
+    for (int j0 = 0; j0 < n; j0 += jb) {
+      const int j1 = std::min(n, j0 + jb);
+#if defined(__AVX2__)
+      if constexpr (Simd) {
+        csr_row_avx2(cols + q0, vals + q0, q1 - q0, Bsrc, (size_t)n, 0, crow, i, j0, j1, epi,
+                     q0 == p0, q1 == p1);
+        continue;
+      }
+#endif
+      csr_row_scalar(cols + q0, vals + q0, q1 - q0, Bsrc, (size_t)n, crow, i, j0, j1, epi,
+                     q0 == p0, q1 == p1);
+    }
+  }
+}
+
+void spmm_csr_rows_panel_scalar(const CSR& A, int i0, int i1, int c0, int c1,
+                                const float* Bpanel, float* Cpanel, int n, int jblock,
+                                int* cursor, const Epilogue& epi) {
+  spmm_csr_rows_panel_impl<false>(A, i0, i1, c0, c1, Bpanel, Cpanel, n, jblock, cursor, epi);
+}
+
+#if defined(__AVX2__)
+void spmm_csr_rows_panel_avx2(const CSR& A, int i0, int i1, int c0, int c1,
+                              const float* Bpanel, float* Cpanel, int n, int jblock,
+                              int* cursor, const Epilogue& epi) {
+  spmm_csr_rows_panel_impl<true>(A, i0, i1, c0, c1, Bpanel, Cpanel, n, jblock, cursor, epi);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// SpMM on alternative formats (row-major B)
+// ---------------------------------------------------------------------------
+
+// Column blocks are the CSC kernels' only parallelism: cap jblock at
+// ceil(n / threads), rounded up to 8 columns, so a narrow C still yields a
+// block per thread.
+static int csc_jblock(int n, int jblock) {
+  const int threads = std::max(1, omp_get_max_threads());
+  const int share = ((n + threads - 1) / threads + 7) / 8 * 8;
+  return std::max(1, std::min(jblock, share));
+}
+
+void spmm_csc_scalar(const CSC& A, const float* B, float* C, int n, int jblock) {
+  zero_fill(C, (size_t)A.m * (size_t)n);
+  jblock = csc_jblock(n, jblock);
+
+  // Column-wise traversal scatters into arbitrary C rows, so threads own
+  // disjoint jblock column ranges of C instead of rows.
+#pragma omp parallel for schedule(static)
+  for (int j0 = 0; j0 < n; j0 += jblock) {
+    int j1 = std::min(n, j0 + jblock);
+    for (int c = 0; c < A.k; c++) {
+      const float* brow = &B[(size_t)c * n];
+      for (int p = A.colptr[(size_t)c]; p < A.colptr[(size_t)c + 1]; p++) {
+        float a = A.values[(size_t)p];
+        float* crow = &C[(size_t)A.rowidx[(size_t)p] * n];
+        for (int j = j0; j < j1; j++) {
+          crow[j] += a * brow[j];
+        }
+      }
+    }
+  }
+}
+
+void spmm_ell_scalar(const ELL& A, const float* B, float* C, int n, int jblock,
+                     const Epilogue& epi) {
+  const int w = A.width;
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < A.m; i++) {
+    const int* ci = &A.colidx[(size_t)i * w];
+    const float* vi = &A.values[(size_t)i * w];
+    float* crow = &C[(size_t)i * n];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      for (int j = j0; j < j1; j++) crow[j] = epi_seed(epi, crow[j]);
+      for (int t = 0; t < w; t++) {
+        float a = epi.alpha * vi[t];
+        const float* brow = &B[(size_t)ci[t] * n];
+        for (int j = j0; j < j1; j++) {
+          crow[j] += a * brow[j];
+        }
+      }
+      for (int j = j0; j < j1; j++) crow[j] = epi_finish(epi, crow[j], i, j);
+    }
+  }
+}
+
+void spmm_sell_scalar(const SELL& A, const float* B, float* C, int n, int jblock,
+                      const Epilogue& epi) {
+  const int S = A.C;
+  const int slices = (int)A.slicelen.size();
+
+#pragma omp parallel for schedule(static)
+  for (int s = 0; s < slices; s++) {
+    const int base = A.sliceptr[(size_t)s];
+    const int len = A.slicelen[(size_t)s];
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      for (int r = 0; r < S; r++) {
+        int row = A.perm[(size_t)s * S + r];
+        if (row < 0) continue;
+        float* crow = &C[(size_t)row * n];
+        for (int j = j0; j < j1; j++) crow[j] = epi_seed(epi, crow[j]);
+        for (int t = 0; t < len; t++) {
+          size_t d = (size_t)base + (size_t)t * S + r;
+          float a = epi.alpha * A.values[d];
+          const float* brow = &B[(size_t)A.colidx[d] * n];
+          for (int j = j0; j < j1; j++) {
+            crow[j] += a * brow[j];
+          }
+        }
+        for (int j = j0; j < j1; j++) crow[j] = epi_finish(epi, crow[j], row, j);
+      }
+    }
+  }
+}
+
+void spmm_bsr_scalar(const BSR& A, const float* B, float* C, int n, int jblock,
+                     const Epilogue& epi) {
+  const int b = A.bs;
+
+#pragma omp parallel for schedule(static)
+  for (int bi = 0; bi < A.mb; bi++) {
+    int r0 = bi * b;
+    int rmax = std::min(b, A.m - r0);
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      for (int r = 0; r < rmax; r++) {
+        float* crow = &C[(size_t)(r0 + r) * n];
+        for (int j = j0; j < j1; j++) crow[j] = epi_seed(epi, crow[j]);
+      }
+      for (int q = A.browptr[(size_t)bi]; q < A.browptr[(size_t)bi + 1]; q++) {
+        int c0 = A.bcolidx[(size_t)q] * b;
+        int cmax = std::min(b, A.k - c0);
+        const float* blk = &A.values[(size_t)q * b * b];
+        for (int r = 0; r < rmax; r++) {
+          float* crow = &C[(size_t)(r0 + r) * n];
+          for (int c = 0; c < cmax; c++) {
+            float a = epi.alpha * blk[r * b + c];
+            const float* brow = &B[(size_t)(c0 + c) * n];
+            for (int j = j0; j < j1; j++) {
+              crow[j] += a * brow[j];
+            }
+          }
+        }
+      }
+      for (int r = 0; r < rmax; r++) {
+        float* crow = &C[(size_t)(r0 + r) * n];
+        for (int j = j0; j < j1; j++) crow[j] = epi_finish(epi, crow[j], r0 + r, j);
+      }
+    }
+  }
+}
+
+#if defined(__AVX2__)
+void spmm_csc_avx2(const CSC& A, const float* B, float* C, int n, int jblock) {
+  zero_fill(C, (size_t)A.m * (size_t)n);
+  jblock = csc_jblock(n, jblock);
+
+#pragma omp parallel for schedule(static)
+  for (int j0 = 0; j0 < n; j0 += jblock) {
+    int j1 = std::min(n, j0 + jblock);
+    int j_vec_end = j0 + ((j1 - j0) / 8) * 8;
+    for (int c = 0; c < A.k; c++) {
+      const float* brow = &B[(size_t)c * n];
+      for (int p = A.colptr[(size_t)c]; p < A.colptr[(size_t)c + 1]; p++) {
+        float a = A.values[(size_t)p];
+        __m256 a8 = _mm256_set1_ps(a);
+        float* crow = &C[(size_t)A.rowidx[(size_t)p] * n];
+        for (int j = j0; j < j_vec_end; j += 8) {
+          __m256 bv = _mm256_loadu_ps(brow + j);
+          __m256 cv = _mm256_loadu_ps(crow + j);
+          cv = _mm256_fmadd_ps(a8, bv, cv);
+          _mm256_storeu_ps(crow + j, cv);
+        }
+        for (int j = j_vec_end; j < j1; j++) {
+          crow[j] += a * brow[j];
+        }
+      }
+    }
+  }
+}
+
+void spmm_ell_avx2(const ELL& A, const float* B, float* C, int n, int jblock,
+                   const Epilogue& epi) {
+  const int w = A.width;
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < A.m; i++) {
+    const int* ci = A.colidx.data() + (size_t)i * w;
+    const float* vi = A.values.data() + (size_t)i * w;
+    float* crow = &C[(size_t)i * n];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      csr_row_avx2(ci, vi, w, B, (size_t)n, 0, crow, i, j0, j1, epi);
+    }
+  }
+}
+
+// SELL-8: one slice = 8 rows; an 8x8 (rows x columns) C tile lives in eight
+// ymm accumulators while the slice's padded slots stream through, and the
+// epilogue is applied to the tile before its single store. Every row belongs
+// to exactly one slice lane, so C needs no zeroing. Plain instantiates the
+// bare-store variant: the epilogue code otherwise costs the accumulator loop
+// registers even when it is the identity.
+template <bool Plain>
+static void spmm_sell8_avx2(const SELL& A, const float* B, float* C, int n, int jblock,
+                            const Epilogue& epi) {
+  const int slices = (int)A.slicelen.size();
+  const __m256 alpha8 = _mm256_set1_ps(epi.alpha);
+
+#pragma omp parallel for schedule(static)
+  for (int s = 0; s < slices; s++) {
+    const int base = A.sliceptr[(size_t)s];
+    const int len = A.slicelen[(size_t)s];
+    const int* rows = &A.perm[(size_t)s * 8];
+    const int* ci = &A.colidx[(size_t)base];
+    const float* vi = &A.values[(size_t)base];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      int j_vec_end = j0 + ((j1 - j0) / 8) * 8;
+
+      for (int j = j0; j < j_vec_end; j += 8) {
+        __m256 acc[8];
+        for (int r = 0; r < 8; r++) acc[r] = _mm256_setzero_ps();
+        for (int t = 0; t < len; t++) {
+          for (int r = 0; r < 8; r++) {
+            __m256 a8 = _mm256_set1_ps(vi[t * 8 + r]);
+            __m256 bv = _mm256_loadu_ps(&B[(size_t)ci[t * 8 + r] * n + j]);
+            acc[r] = _mm256_fmadd_ps(a8, bv, acc[r]);
+          }
+        }
+        for (int r = 0; r < 8; r++) {
+          if (rows[r] < 0) continue;
+          float* c = &C[(size_t)rows[r] * n + j];
+          if (Plain) { _mm256_storeu_ps(c, acc[r]); continue; }
+          __m256 v = _mm256_fmadd_ps(alpha8, acc[r], epi_seed8(epi, c));
+          _mm256_storeu_ps(c, epi_finish8(epi, v, rows[r], j));
+        }
+      }
+      for (int j = j_vec_end; j < j1; j++) {
+        for (int r = 0; r < 8; r++) {
+          if (rows[r] < 0) continue;
+          float sum = 0.0f;
+          for (int t = 0; t < len; t++) {
+            sum += vi[t * 8 + r] * B[(size_t)ci[t * 8 + r] * n + j];
+          }
+          float* c = &C[(size_t)rows[r] * n + j];
+          *c = Plain ? sum : epi_finish(epi, epi.alpha * sum + epi_seed(epi, *c), rows[r], j);
+        }
+      }
+    }
+  }
+}
+
+void spmm_sell_avx2(const SELL& A, const float* B, float* C, int n, int jblock,
+                    const Epilogue& epi) {
+  if (A.C != 8) spmm_sell_scalar(A, B, C, n, jblock, epi);
+  else if (epi_is_plain(epi)) spmm_sell8_avx2<true>(A, B, C, n, jblock, epi);
+  else spmm_sell8_avx2<false>(A, B, C, n, jblock, epi);
+}
+
+// BS x 8 register tile per block row; each nonzero block contributes BS
+// broadcast-FMAs per B row it touches. Block rows own their C rows outright,
+// so the epilogue is applied to the tile right before its store.
+template <int BS>
+static void spmm_bsr_avx2_bs(const BSR& A, const float* B, float* C, int n, int jblock,
+                             const Epilogue& epi) {
+  const __m256 alpha8 = _mm256_set1_ps(epi.alpha);
+  const bool plain = epi_is_plain(epi);
+
+#pragma omp parallel for schedule(static)
+  for (int bi = 0; bi < A.mb; bi++) {
+    const int r0 = bi * BS;
+    const int rmax = std::min(BS, A.m - r0);
+    const int q0 = A.browptr[(size_t)bi];
+    const int q1 = A.browptr[(size_t)bi + 1];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      int j_vec_end = j0 + ((j1 - j0) / 8) * 8;
+
+      for (int j = j0; j < j_vec_end; j += 8) {
+        __m256 acc[BS];
+        for (int r = 0; r < BS; r++) acc[r] = _mm256_setzero_ps();
+        for (int q = q0; q < q1; q++) {
+          const int c0 = A.bcolidx[(size_t)q] * BS;
+          const int cmax = std::min(BS, A.k - c0);
+          const float* blk = &A.values[(size_t)q * BS * BS];
+          for (int c = 0; c < cmax; c++) {
+            __m256 bv = _mm256_loadu_ps(&B[(size_t)(c0 + c) * n + j]);
+            for (int r = 0; r < BS; r++) {
+              acc[r] = _mm256_fmadd_ps(_mm256_set1_ps(blk[r * BS + c]), bv, acc[r]);
+            }
+          }
+        }
+        for (int r = 0; r < rmax; r++) {
+          float* c = &C[(size_t)(r0 + r) * n + j];
+          if (plain) { _mm256_storeu_ps(c, acc[r]); continue; }
+          __m256 v = _mm256_fmadd_ps(alpha8, acc[r], epi_seed8(epi, c));
+          _mm256_storeu_ps(c, epi_finish8(epi, v, r0 + r, j));
+        }
+      }
+      for (int j = j_vec_end; j < j1; j++) {
+        float sum[BS] = {};
+        for (int q = q0; q < q1; q++) {
+          const int c0 = A.bcolidx[(size_t)q] * BS;
+          const int cmax = std::min(BS, A.k - c0);
+          const float* blk = &A.values[(size_t)q * BS * BS];
+          for (int c = 0; c < cmax; c++) {
+            float bval = B[(size_t)(c0 + c) * n + j];
+            for (int r = 0; r < BS; r++) sum[r] += blk[r * BS + c] * bval;
+          }
+        }
+        for (int r = 0; r < rmax; r++) {
+          float* c = &C[(size_t)(r0 + r) * n + j];
+          *c = epi_finish(epi, epi.alpha * sum[r] + epi_seed(epi, *c), r0 + r, j);
+        }
+      }
+    }
+  }
+}
+
+void spmm_bsr_avx2(const BSR& A, const float* B, float* C, int n, int jblock,
+                   const Epilogue& epi) {
+  switch (A.bs) {
+    case 2: spmm_bsr_avx2_bs<2>(A, B, C, n, jblock, epi); break;
+    case 4: spmm_bsr_avx2_bs<4>(A, B, C, n, jblock, epi); break;
+    case 8: spmm_bsr_avx2_bs<8>(A, B, C, n, jblock, epi); break;
+    default: spmm_bsr_scalar(A, B, C, n, jblock, epi); break;
+  }
+}
+#endif // __AVX2__
+
+// ---------------------------------------------------------------------------
+// SpGEMM (CSR x CSR)
+// ---------------------------------------------------------------------------
+
+const char* spgemm_accum_name(SpgemmAccum a) {
+  switch (a) {
+    case SpgemmAccum::Auto:  return "auto";
+    case SpgemmAccum::Hash:  return "hash";
+    case SpgemmAccum::Dense: return "dense";
+  }
+  return "?";
+}
+
+bool parse_spgemm_accum(const std::string& s, SpgemmAccum& out) {
+  if (s == "auto")  { out = SpgemmAccum::Auto;  return true; }
+  if (s == "hash")  { out = SpgemmAccum::Hash;  return true; }
+  if (s == "dense") { out = SpgemmAccum::Dense; return true; }
+  return false;
+}
+
+// Auto picks the dense SPA when its scratch (8 bytes per output column)
+// stays cache-resident or the row's products reach n / kSpgemmDenseRatio;
+// hashing only pays off for short rows against very wide B.
+static const size_t kSpgemmDenseRatio = 16;
+static const size_t kSpgemmDenseBytes = (size_t)1 << 20;
+
+// Per-thread accumulator scratch, grown on demand and reused across rows.
+// Dense SPA: mark[j] holds the stamp of the last row that touched column j,
+// so it is never cleared; touched lists the row's columns. Hash: power-of-two
+// open-addressing table, linear probing, keys = -1 when empty; only the used
+// slots (touched) are reset after a row.
+struct SpgemmScratch {
+  std::vector<int> mark;
+  std::vector<float> dense;
+  std::vector<int> touched;
+  std::vector<int> keys;
+  std::vector<float> hvals;
+  std::vector<std::pair<int, float>> pairs;
+};
+
+static inline size_t spgemm_row_products(const CSR& A, const CSR& B, int i) {
+  size_t p = 0;
+  for (int a = A.rowptr[(size_t)i]; a < A.rowptr[(size_t)i + 1]; a++) {
+    const int t = A.colidx[(size_t)a];
+    p += (size_t)(B.rowptr[(size_t)t + 1] - B.rowptr[(size_t)t]);
+  }
+  return p;
+}
+
+// Row i of A*B through the dense SPA. Symbolic (out_c == nullptr) only counts;
+// numeric writes the sorted row to out_c/out_v. stamp must differ between
+// the symbolic and numeric visit of the same row.
+static int spgemm_row_dense(const CSR& A, const CSR& B, int i, int stamp, SpgemmScratch& s,
+                            int* out_c, float* out_v) {
+  if (s.mark.size() < (size_t)B.k) {
+    s.mark.assign((size_t)B.k, -1);
+    s.dense.assign((size_t)B.k, 0.0f);
+  }
+  s.touched.clear();
+  for (int a = A.rowptr[(size_t)i]; a < A.rowptr[(size_t)i + 1]; a++) {
+    const int t = A.colidx[(size_t)a];
+    const float av = A.values[(size_t)a];
+    for (int b = B.rowptr[(size_t)t]; b < B.rowptr[(size_t)t + 1]; b++) {
+      const int j = B.colidx[(size_t)b];
+      if (s.mark[(size_t)j] != stamp) {
+        s.mark[(size_t)j] = stamp;
+        s.dense[(size_t)j] = av * B.values[(size_t)b];
+        s.touched.push_back(j);
+      } else {
+        s.dense[(size_t)j] += av * B.values[(size_t)b];
+      }
+    }
+  }
+  const int cnt = (int)s.touched.size();
+  if (!out_c) return cnt;
+  std::sort(s.touched.begin(), s.touched.end());
+  for (int q = 0; q < cnt; q++) {
+    const int j = s.touched[(size_t)q];
+    out_c[q] = j;
+    out_v[q] = s.dense[(size_t)j];
+  }
+  return cnt;
+}
+
+// Same contract through a hash table of at least 2 * products slots.
+static int spgemm_row_hash(const CSR& A, const CSR& B, int i, size_t products, SpgemmScratch& s,
+                           int* out_c, float* out_v) {
+  size_t cap = 16;
+  while (cap < 2 * products) cap <<= 1;
+  const size_t mask = cap - 1;
+  if (s.keys.size() < cap) {
+    s.keys.assign(cap, -1);
+    s.hvals.assign(cap, 0.0f);
+  }
+  s.touched.clear();
+
+  int cnt = 0;
+  for (int a = A.rowptr[(size_t)i]; a < A.rowptr[(size_t)i + 1]; a++) {
+    const int t = A.colidx[(size_t)a];
+    const float av = A.values[(size_t)a];
+    for (int b = B.rowptr[(size_t)t]; b < B.rowptr[(size_t)t + 1]; b++) {
+      const int j = B.colidx[(size_t)b];
+      size_t h = ((uint32_t)j * 2654435761u) & mask;
+      while (s.keys[h] != -1 && s.keys[h] != j) h = (h + 1) & mask;
+      if (s.keys[h] == -1) {
+        s.keys[h] = j;
+        s.hvals[h] = 0.0f;
+        s.touched.push_back((int)h);
+        cnt++;
+      }
+      if (out_c) s.hvals[h] += av * B.values[(size_t)b];
+    }
+  }
+  s.pairs.clear();
+  for (int h : s.touched) {
+    if (out_c) s.pairs.push_back({s.keys[(size_t)h], s.hvals[(size_t)h]});
+    s.keys[(size_t)h] = -1;
+  }
+  if (!out_c) return cnt;
+  std::sort(s.pairs.begin(), s.pairs.end(),
+            [](const std::pair<int, float>& x, const std::pair<int, float>& y){ return x.first < y.first; });
+  for (int q = 0; q < cnt; q++) {
+    out_c[q] = s.pairs[(size_t)q].first;
+    out_v[q] = s.pairs[(size_t)q].second;
+  }
+  return cnt;
+}
+
+size_t spgemm_products(const CSR& A, const CSR& B) {
+  size_t p = 0;
+#pragma omp parallel for schedule(static) reduction(+:p)
+  for (int i = 0; i < A.m; i++) p += spgemm_row_products(A, B, i);
+  return p;
+}
+
+CSR spgemm_csr(const CSR& A, const CSR& B, SpgemmAccum acc) {
+  if (A.k != B.m) std::abort();
+  CSR C;
+  C.m = A.m; C.k = B.k;
+  C.rowptr.assign((size_t)A.m + 1, 0);
+  std::vector<size_t> products((size_t)A.m);
+  std::vector<char> dense_row((size_t)A.m);
+
+#pragma omp parallel
+  {
+    SpgemmScratch s;
+    // Symbolic: products bound the row, the accumulator gives the exact count.
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < A.m; i++) {
+      const size_t p = spgemm_row_products(A, B, i);
+      const bool dense = acc == SpgemmAccum::Dense ||
+                         (acc == SpgemmAccum::Auto && (8 * (size_t)B.k <= kSpgemmDenseBytes ||
+                                                       p * kSpgemmDenseRatio >= (size_t)B.k));
+      products[(size_t)i] = p;
+      dense_row[(size_t)i] = dense;
+      int cnt = 0;
+      if (p > 0) {
+        cnt = dense ? spgemm_row_dense(A, B, i, 2 * i, s, nullptr, nullptr)
+                    : spgemm_row_hash(A, B, i, p, s, nullptr, nullptr);
+      }
+      C.rowptr[(size_t)i + 1] = cnt;
+    }
+
+#pragma omp single
+    {
+      for (int i = 0; i < A.m; i++) C.rowptr[(size_t)i + 1] += C.rowptr[(size_t)i];
+      C.colidx.resize((size_t)C.rowptr[(size_t)A.m]);
+      C.values.resize((size_t)C.rowptr[(size_t)A.m]);
+    }
+
+    // Numeric: each row lands in its final slice of C.
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < A.m; i++) {
+      const size_t p = products[(size_t)i];
+      if (p == 0) continue;
+      int* c = C.colidx.data() + C.rowptr[(size_t)i];
+      float* v = C.values.data() + C.rowptr[(size_t)i];
+      if (dense_row[(size_t)i]) spgemm_row_dense(A, B, i, 2 * i + 1, s, c, v);
+      else                      spgemm_row_hash(A, B, i, p, s, c, v);
+    }
+  }
+  return C;
+}
+
+// ---------------------------------------------------------------------------
+// SpMV
+// ---------------------------------------------------------------------------
+
+// Rows shorter than kSpmvGatherRow use the scalar dot even in the AVX2 path
+// (8-wide gathers plus a horizontal sum do not pay off below that); a row is
+// long when it holds at least a quarter of a thread's share (and at least
+// kSpmvLongMin entries).
+static const int kSpmvGatherRow = 32;
+static const int kSpmvLongMin = 4096;
+// Prefetch distance (elements) for colidx/values.
+static const int kSpmvPrefetch = 64;
+
+SpmvPlan make_spmv_plan(const CSR& A, int threads) {
+  SpmvPlan p;
+  p.threads = std::max(1, threads);
+  const size_t nnz = csr_nnz(A);
+  p.long_len = (int)std::max<size_t>(kSpmvLongMin, nnz / (size_t)p.threads / 4);
+
+  // Cost of a row = entries + 1 (the y store and row overhead); long rows
+  // cost 1 here, their entries are shared by everyone.
+  p.long_off.push_back(0);
+  std::vector<size_t> cost((size_t)A.m + 1, 0);
+  for (int i = 0; i < A.m; i++) {
+    const int len = A.rowptr[(size_t)i + 1] - A.rowptr[(size_t)i];
+    const bool is_long = len >= p.long_len;
+    if (is_long) {
+      p.long_rows.push_back(i);
+      p.long_off.push_back(p.long_off.back() + (size_t)len);
+    }
+    cost[(size_t)i + 1] = cost[(size_t)i] + (is_long ? 1 : (size_t)len + 1);
+  }
+  p.row_split.assign((size_t)p.threads + 1, A.m);
+  p.row_split[0] = 0;
+  for (int t = 1; t < p.threads; t++) {
+    const size_t target = cost[(size_t)A.m] * (size_t)t / (size_t)p.threads;
+    p.row_split[(size_t)t] = (int)(std::lower_bound(cost.begin(), cost.end(), target) - cost.begin());
+    p.row_split[(size_t)t] = std::max(p.row_split[(size_t)t - 1], std::min(A.m, p.row_split[(size_t)t]));
+  }
+  return p;
+}
+
+// Two chains so consecutive x loads overlap.
+static float spmv_dot_scalar(const int* c, const float* v, int len, const float* x) {
+  float s0 = 0.0f, s1 = 0.0f;
+  int q = 0;
+  for (; q + 2 <= len; q += 2) {
+    s0 += v[q] * x[c[q]];
+    s1 += v[q + 1] * x[c[q + 1]];
+  }
+  if (q < len) s0 += v[q] * x[c[q]];
+  return s0 + s1;
+}
+
+#if defined(__AVX2__)
+static inline float hsum256(__m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+// Dot product of one row slice with x: two 8-wide gather/FMA chains.
+static float spmv_dot_avx2(const int* c, const float* v, int len, const float* x) {
+  __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+  int q = 0;
+  for (; q + 16 <= len; q += 16) {
+    _mm_prefetch((const char*)(c + q + kSpmvPrefetch), _MM_HINT_T0);
+    _mm_prefetch((const char*)(v + q + kSpmvPrefetch), _MM_HINT_T0);
+    const __m256i i0 = _mm256_loadu_si256((const __m256i*)(c + q));
+    const __m256i i1 = _mm256_loadu_si256((const __m256i*)(c + q + 8));
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(v + q), _mm256_i32gather_ps(x, i0, 4), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(v + q + 8), _mm256_i32gather_ps(x, i1, 4), acc1);
+  }
+  for (; q + 8 <= len; q += 8) {
+    const __m256i i0 = _mm256_loadu_si256((const __m256i*)(c + q));
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(v + q), _mm256_i32gather_ps(x, i0, 4), acc0);
+  }
+  float s = hsum256(_mm256_add_ps(acc0, acc1));
+  for (; q < len; q++) s += v[q] * x[c[q]];
+  return s;
+}
+
+#endif // __AVX2__
+
+// Long rows: their concatenated entries are cut into `threads` equal slices;
+// each thread adds its slice of every row it overlaps into y (zeroed before
+// the barrier), so at most two additions per thread are shared.
+template <bool Simd>
+static void spmv_long_rows(const CSR& A, const SpmvPlan& plan, const float* x, float* y, int t) {
+  const size_t total = plan.long_off.back();
+  const size_t lo = total * (size_t)t / (size_t)plan.threads;
+  const size_t hi = total * (size_t)(t + 1) / (size_t)plan.threads;
+  if (lo >= hi) return;
+  size_t l = (size_t)(std::upper_bound(plan.long_off.begin(), plan.long_off.end(), lo) - plan.long_off.begin()) - 1;
+  for (size_t pos = lo; pos < hi; l++) {
+    const int row = plan.long_rows[l];
+    const size_t end = std::min(hi, plan.long_off[l + 1]);
+    const size_t base = (size_t)A.rowptr[(size_t)row] + (pos - plan.long_off[l]);
+    const int len = (int)(end - pos);
+    const int* c = A.colidx.data() + base;
+    const float* v = A.values.data() + base;
+    float s;
+#if defined(__AVX2__)
+    s = Simd ? spmv_dot_avx2(c, v, len, x) : spmv_dot_scalar(c, v, len, x);
+#else
+    s = spmv_dot_scalar(c, v, len, x);
+#endif
+#pragma omp atomic
+    y[row] += s;
+    pos = end;
+  }
+}
+
+// The plan's ranges are walked strided by the actual team size: a smaller
+// team (OMP_THREAD_LIMIT, OMP_DYNAMIC, nesting) must still cover all of y.
+template <bool Simd>
+static void spmv_csr_impl(const CSR& A, const SpmvPlan& plan, const float* x, float* y) {
+  const bool has_long = !plan.long_rows.empty();
+#pragma omp parallel num_threads(plan.threads)
+  {
+    const int tid = omp_get_thread_num(), nt = omp_get_num_threads();
+    // Raw pointers: y stores would otherwise force reloads of the CSR arrays.
+    const int* rowptr = A.rowptr.data();
+    const int* col = A.colidx.data();
+    const float* val = A.values.data();
+    const int long_len = plan.long_len;
+    for (int t = tid; t < plan.threads; t += nt) {
+      const int r0 = plan.row_split[(size_t)t], r1 = plan.row_split[(size_t)t + 1];
+      for (int i = r0; i < r1; i++) {
+        const int len = rowptr[i + 1] - rowptr[i];
+        if (len >= long_len) {
+          y[i] = 0.0f;
+          continue;
+        }
+        const int p0 = rowptr[i];
+#if defined(__AVX2__)
+        y[i] = (Simd && len >= kSpmvGatherRow) ? spmv_dot_avx2(col + p0, val + p0, len, x) : spmv_dot_scalar(col + p0, val + p0, len, x);
+#else
+        y[i] = spmv_dot_scalar(col + p0, val + p0, len, x);
+#endif
+      }
+    }
+    if (has_long) {
+#pragma omp barrier
+      for (int t = tid; t < plan.threads; t += nt) spmv_long_rows<Simd>(A, plan, x, y, t);
+    }
+  }
+}
+
+void spmv_csr_scalar(const CSR& A, const SpmvPlan& plan, const float* x, float* y) {
+  spmv_csr_impl<false>(A, plan, x, y);
+}
+
+#if defined(__AVX2__)
+void spmv_csr_avx2(const CSR& A, const SpmvPlan& plan, const float* x, float* y) {
+  spmv_csr_impl<true>(A, plan, x, y);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// Format auto-selection
+// ---------------------------------------------------------------------------
+
+const char* spmm_path_name(SpmmPath p) {
+  switch (p) {
+    case SpmmPath::Gemm: return "gemm";
+    case SpmmPath::Csr:  return "csr";
+    case SpmmPath::Sell: return "sell";
+    case SpmmPath::Bsr:  return "bsr";
+  }
+  return "?";
+}
+
+SparseStats analyze_sparsity(const CSR& A, int sell_c, int sell_sigma, int bsr_block) {
+  SparseStats st;
+  st.m = A.m; st.k = A.k;
+  st.nnz = csr_nnz(A);
+  st.density = (double)st.nnz / std::max(1.0, (double)A.m * (double)A.k);
+
+  std::vector<int> len((size_t)A.m);
+  double sum = 0.0, sum2 = 0.0;
+  st.row_hist.assign(33, 0);
+  for (int i = 0; i < A.m; i++) {
+    int l = A.rowptr[(size_t)i + 1] - A.rowptr[(size_t)i];
+    len[(size_t)i] = l;
+    sum += l; sum2 += (double)l * l;
+    st.row_max = std::max(st.row_max, l);
+    int b = 0;
+    while ((1 << b) <= l && b < 32) b++;
+    st.row_hist[(size_t)b]++;
+  }
+  while (st.row_hist.size() > 1 && st.row_hist.back() == 0) st.row_hist.pop_back();
+  st.row_mean = sum / std::max(1, A.m);
+  double var = sum2 / std::max(1, A.m) - st.row_mean * st.row_mean;
+  st.row_cv = (st.row_mean > 0.0) ? std::sqrt(std::max(0.0, var)) / st.row_mean : 0.0;
+
+  // SELL padding: same window sort as csr_to_sell, lengths only.
+  const int C = std::max(1, sell_c);
+  const int sigma = std::max(1, sell_sigma);
+  for (int w0 = 0; w0 < A.m; w0 += sigma) {
+    int w1 = std::min(A.m, w0 + sigma);
+    std::sort(len.begin() + w0, len.begin() + w1, std::greater<int>());
+  }
+  for (int s0 = 0; s0 < A.m; s0 += C) {
+    int smax = 0;
+    for (int i = s0; i < std::min(A.m, s0 + C); i++) smax = std::max(smax, len[(size_t)i]);
+    st.sell_stored += (size_t)smax * (size_t)C;
+  }
+
+  // BSR block count: one stamp pass, no values touched.
+  const int b = std::max(1, bsr_block);
+  std::vector<int> stamp((size_t)(A.k + b - 1) / b, -1);
+  for (int i = 0; i < A.m; i++) {
+    int bi = i / b;
+    for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+      int bc = A.colidx[(size_t)p] / b;
+      if (stamp[(size_t)bc] != bi) { stamp[(size_t)bc] = bi; st.bsr_blocks++; }
+    }
+  }
+  return st;
+}
+
+// Densify CSR into a row-major m x k buffer.
+static AlignedBuffer csr_to_dense(const CSR& A) {
+  AlignedBuffer D = make_aligned_f32((size_t)A.m * (size_t)A.k, 64);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < A.m; i++) {
+    float* row = &D.ptr[(size_t)i * A.k];
+    std::memset(row, 0, (size_t)A.k * sizeof(float));
+    for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+      row[A.colidx[(size_t)p]] = A.values[(size_t)p];
+    }
+  }
+  return D;
+}
+
+static void run_gemm_default(const float* A, const float* B, float* C, int m, int k, int n) {
+#if defined(__AVX2__)
+  gemm_tiled_avx2(A, B, C, m, k, n, 64, 64, 128);
+#else
+  gemm_tiled_scalar(A, B, C, m, k, n, 64, 64, 128);
+#endif
+}
+
+template <typename F>
+static double best_of(int reps, F&& f) {
+  double best = 1e30;
+  for (int r = 0; r < reps; r++) {
+    double t0 = now_seconds();
+    f();
+    double t1 = now_seconds();
+    best = std::min(best, t1 - t0);
+  }
+  return std::max(1e-9, best);
+}
+
+SpmmCostModel calibrate_spmm_cost_model(int n, uint64_t seed) {
+  SpmmCostModel M;
+  const int jblock = 128;
+  n = std::max(1, n);
+
+  // Dense GEMM: 256 x 256 A.
+  {
+    const int d = 256;
+    AlignedBuffer A = make_aligned_f32((size_t)d * d, 64);
+    AlignedBuffer B = make_aligned_f32((size_t)d * n, 64);
+    AlignedBuffer C = make_aligned_f32((size_t)d * n, 64);
+    fill_random(A.ptr, A.count, seed);
+    fill_random(B.ptr, B.count, seed + 1);
+    double s = best_of(3, [&]{ run_gemm_default(A.ptr, B.ptr, C.ptr, d, d, n); });
+    M.gemm_s_per_fma = s / ((double)d * d * n);
+    free_aligned(A); free_aligned(B); free_aligned(C);
+  }
+
+  // Sparse paths: uniform CSR (worst-case B locality) and blockdiag for the
+  // blocked formats, 1024 x 1024.
+  {
+    const int d = 1024;
+    AlignedBuffer B = make_aligned_f32((size_t)d * n, 64);
+    AlignedBuffer C = make_aligned_f32((size_t)d * n, 64);
+    fill_random(B.ptr, B.count, seed + 2);
+
+    CSR U = make_random_csr(d, d, 0.01, "uniform", seed + 3);
+    double s = best_of(3, [&]{
+#if defined(__AVX2__)
+      spmm_csr_avx2(U, B.ptr, C.ptr, n, jblock, LayoutB::RowMajor);
+#else
+      spmm_csr_scalar(U, B.ptr, C.ptr, n, jblock, LayoutB::RowMajor);
+#endif
+    });
+    M.csr_s_per_fma = s / ((double)csr_nnz(U) * n);
+
+    CSR D = make_random_csr(d, d, 0.05, "blockdiag", seed + 4);
+    double tc0 = now_seconds();
+    SELL S = csr_to_sell(D, M.sell_c, M.sell_sigma);
+    BSR R = csr_to_bsr(D, M.bsr_block);
+    double tc1 = now_seconds();
+    M.conv_s_per_nnz = (tc1 - tc0) / (2.0 * std::max<size_t>(1, csr_nnz(D)));
+
+    s = best_of(3, [&]{
+#if defined(__AVX2__)
+      spmm_sell_avx2(S, B.ptr, C.ptr, n, jblock);
+#else
+      spmm_sell_scalar(S, B.ptr, C.ptr, n, jblock);
+#endif
+    });
+    M.sell_s_per_fma = s / ((double)sell_stored(S) * n);
+
+    s = best_of(3, [&]{
+#if defined(__AVX2__)
+      spmm_bsr_avx2(R, B.ptr, C.ptr, n, jblock);
+#else
+      spmm_bsr_scalar(R, B.ptr, C.ptr, n, jblock);
+#endif
+    });
+    M.bsr_s_per_fma = s / ((double)bsr_stored(R) * n);
+
+    s = best_of(3, [&]{ AlignedBuffer T = csr_to_dense(D); free_aligned(T); });
+    M.densify_s_per_elem = s / ((double)d * d);
+
+    free_aligned(B); free_aligned(C);
+  }
+
+  M.calibrated = true;
+  return M;
+}
+
+SpmmAutoPlan spmm_auto_plan(const CSR& A, int n, const SpmmCostModel& model,
+                            int amortize_calls, bool log) {
+  SpmmAutoPlan plan;
+  plan.stats = analyze_sparsity(A, model.sell_c, model.sell_sigma, model.bsr_block);
+  const SparseStats& st = plan.stats;
+  const double calls = (double)std::max(1, amortize_calls);
+  const double bs = (double)std::max(1, model.bsr_block);
+
+  double* P = plan.pred_seconds;
+  P[(int)SpmmPath::Gemm] = (double)A.m * A.k * n * model.gemm_s_per_fma
+                         + (double)A.m * A.k * model.densify_s_per_elem / calls;
+  P[(int)SpmmPath::Csr]  = (double)st.nnz * n * model.csr_s_per_fma;
+  P[(int)SpmmPath::Sell] = (double)st.sell_stored * n * model.sell_s_per_fma
+                         + (double)st.nnz * model.conv_s_per_nnz / calls;
+  P[(int)SpmmPath::Bsr]  = (double)st.bsr_blocks * bs * bs * n * model.bsr_s_per_fma
+                         + (double)st.nnz * model.conv_s_per_nnz / calls;
+
+  int best = (int)SpmmPath::Csr;
+  for (int p = 0; p < 4; p++) if (P[p] < P[best]) best = p;
+  plan.path = (SpmmPath)best;
+
+  if (plan.path == SpmmPath::Gemm)      plan.dense = csr_to_dense(A);
+  else if (plan.path == SpmmPath::Sell) plan.sell = csr_to_sell(A, model.sell_c, model.sell_sigma);
+  else if (plan.path == SpmmPath::Bsr)  plan.bsr = csr_to_bsr(A, model.bsr_block);
+
+  if (log) {
+    std::fprintf(stderr,
+                 "[spmm_auto] m=%d k=%d n=%d nnz=%zu density=%.4g rowlen mean=%.1f max=%d cv=%.2f "
+                 "sell_fill=%.2f bsr_fill=%.2f%s\n",
+                 A.m, A.k, n, st.nnz, st.density, st.row_mean, st.row_max, st.row_cv,
+                 (double)st.nnz / std::max<size_t>(1, st.sell_stored),
+                 (double)st.nnz / std::max(1.0, (double)st.bsr_blocks * bs * bs),
+                 model.calibrated ? "" : " (uncalibrated model)");
+    std::fprintf(stderr, "[spmm_auto] rowlen hist:");
+    for (size_t b = 0; b < st.row_hist.size(); b++) {
+      if (b == 0) std::fprintf(stderr, " 0:%zu", st.row_hist[b]);
+      else        std::fprintf(stderr, " <%d:%zu", 1 << b, st.row_hist[b]);
+    }
+    std::fprintf(stderr, "\n[spmm_auto] predicted ms: gemm=%.3f csr=%.3f sell=%.3f bsr=%.3f -> %s\n",
+                 P[0] * 1e3, P[1] * 1e3, P[2] * 1e3, P[3] * 1e3, spmm_path_name(plan.path));
+  }
+  return plan;
+}
+
+void spmm_auto_run(const SpmmAutoPlan& plan, const CSR& A, const float* B, float* C,
+                   int n, int jblock) {
+  switch (plan.path) {
+    case SpmmPath::Gemm:
+      run_gemm_default(plan.dense.ptr, B, C, A.m, A.k, n);
+      break;
+#if defined(__AVX2__)
+    case SpmmPath::Sell: spmm_sell_avx2(plan.sell, B, C, n, jblock); break;
+    case SpmmPath::Bsr:  spmm_bsr_avx2(plan.bsr, B, C, n, jblock); break;
+    case SpmmPath::Csr:  spmm_csr_avx2(A, B, C, n, jblock, LayoutB::RowMajor); break;
+#else
+    case SpmmPath::Sell: spmm_sell_scalar(plan.sell, B, C, n, jblock); break;
+    case SpmmPath::Bsr:  spmm_bsr_scalar(plan.bsr, B, C, n, jblock); break;
+    case SpmmPath::Csr:  spmm_csr_scalar(A, B, C, n, jblock, LayoutB::RowMajor); break;
+#endif
+  }
+}
+
+void free_spmm_auto_plan(SpmmAutoPlan& plan) {
+  if (plan.dense.ptr) free_aligned(plan.dense);
+  plan.sell = SELL();
+  plan.bsr = BSR();
+}
+
+SpmmPath spmm_auto(const CSR& A, const float* B, float* C, int n, int jblock,
+                   const SpmmCostModel& model) {
+  SpmmAutoPlan plan = spmm_auto_plan(A, n, model, 1, true);
+  spmm_auto_run(plan, A, B, C, n, jblock);
+  SpmmPath path = plan.path;
+  free_spmm_auto_plan(plan);
+  return path;
+}
+
+// ---------------------------------------------------------------------------
+// STREAM-style bandwidth suite
+// ---------------------------------------------------------------------------
+
+const char* stream_op_name(StreamOp op) {
+  switch (op) {
+    case StreamOp::Copy:  return "copy";
+    case StreamOp::Scale: return "scale";
+    case StreamOp::Add:   return "add";
+    case StreamOp::Triad: return "triad";
+  }
+  return "?";
+}
+
+bool parse_stream_op(const std::string& s, StreamOp& out) {
+  if (s == "copy")  { out = StreamOp::Copy;  return true; }
+  if (s == "scale") { out = StreamOp::Scale; return true; }
+  if (s == "add")   { out = StreamOp::Add;   return true; }
+  if (s == "triad") { out = StreamOp::Triad; return true; }
+  return false;
+}
+
+int stream_op_arrays(StreamOp op) {
+  return (op == StreamOp::Copy || op == StreamOp::Scale) ? 2 : 3;
+}
+
+// Thread t's share [lo, hi): whole 64-byte lines, so every thread's first
+// vector is aligned for streaming stores and no line is split across threads.
+static void stream_chunk(size_t N, int t, int T, size_t& lo, size_t& hi) {
+  const size_t lines = (N + 15) / 16;
+  lo = std::min(N, lines * (size_t)t / (size_t)T * 16);
+  hi = std::min(N, lines * (size_t)(t + 1) / (size_t)T * 16);
+}
+
+StreamArrays make_stream_arrays(size_t N) {
+  StreamArrays s;
+  s.N = N;
+  s.a = make_aligned_f32(N, 64);
+  s.b = make_aligned_f32(N, 64);
+  s.c = make_aligned_f32(N, 64);
+#pragma omp parallel
+  {
+    size_t lo = 0, hi = 0;
+    stream_chunk(N, omp_get_thread_num(), omp_get_num_threads(), lo, hi);
+    for (size_t i = lo; i < hi; i++) {
+      s.a.ptr[i] = 1.0f;
+      s.b.ptr[i] = 2.0f;
+      s.c.ptr[i] = 0.0f;
+    }
+  }
+  return s;
+}
+
+void free_stream_arrays(StreamArrays& s) {
+  free_aligned(s.a); free_aligned(s.b); free_aligned(s.c);
+  s.N = 0;
+}
+
+template <StreamOp OP, bool NT>
+static void stream_range(float* a, float* b, float* c, float q, size_t lo, size_t hi) {
+  size_t i = lo;
+#if defined(__AVX2__)
+  const __m256 q8 = _mm256_set1_ps(q);
+  const size_t vend = lo + ((hi - lo) / 8) * 8;
+  for (; i < vend; i += 8) {
+    __m256 v;
+    float* dst;
+    switch (OP) {
+      case StreamOp::Copy:  v = _mm256_load_ps(a + i); dst = c; break;
+      case StreamOp::Scale: v = _mm256_mul_ps(q8, _mm256_load_ps(c + i)); dst = b; break;
+      case StreamOp::Add:   v = _mm256_add_ps(_mm256_load_ps(a + i), _mm256_load_ps(b + i)); dst = c; break;
+      default:              v = _mm256_fmadd_ps(q8, _mm256_load_ps(c + i), _mm256_load_ps(b + i)); dst = a; break;
+    }
+    if (NT) _mm256_stream_ps(dst + i, v);
+    else    _mm256_store_ps(dst + i, v);
+  }
+#endif
+  for (; i < hi; i++) {
+    switch (OP) {
+      case StreamOp::Copy:  c[i] = a[i]; break;
+      case StreamOp::Scale: b[i] = q * c[i]; break;
+      case StreamOp::Add:   c[i] = a[i] + b[i]; break;
+      default:              a[i] = b[i] + q * c[i]; break;
+    }
+  }
+}
+
+// Seconds for one parallel region running `passes` passes over each
+// thread's own chunk.
+template <StreamOp OP, bool NT>
+static double stream_sample(StreamArrays& s, int passes) {
+  const float q = 3.0f;
+  double t0 = now_seconds();
+#pragma omp parallel
+  {
+    size_t lo = 0, hi = 0;
+    stream_chunk(s.N, omp_get_thread_num(), omp_get_num_threads(), lo, hi);
+    for (int p = 0; p < passes; p++) {
+      stream_range<OP, NT>(s.a.ptr, s.b.ptr, s.c.ptr, q, lo, hi);
+    }
+#if defined(__AVX2__)
+    if (NT) _mm_sfence();
+#endif
+  }
+  return now_seconds() - t0;
+}
+
+template <StreamOp OP, bool NT>
+static StreamResult run_stream_t(StreamArrays& s, int iters) {
+  StreamResult r;
+  const double bytes = (double)stream_op_arrays(OP) * (double)s.N * sizeof(float);
+
+  // Untimed warm-up pass, which also sizes the samples to ~1 ms.
+  const double one = std::max(1e-9, stream_sample<OP, NT>(s, 1));
+  r.passes = (int)std::min(1 << 20, std::max(1, (int)(1e-3 / one)));
+
+  double best = 1e30, sum = 0.0;
+  const int samples = std::max(1, iters);
+  for (int it = 0; it < samples; it++) {
+    double t = stream_sample<OP, NT>(s, r.passes) / r.passes;
+    best = std::min(best, t);
+    sum += t;
+  }
+  r.best_seconds = best;
+  r.best_gbps = bytes / best / 1e9;
+  r.avg_gbps = bytes / (sum / samples) / 1e9;
+  return r;
+}
+
+StreamResult run_stream(StreamOp op, StreamArrays& s, int iters, bool nt) {
+  switch (op) {
+    case StreamOp::Copy:  return nt ? run_stream_t<StreamOp::Copy, true>(s, iters)  : run_stream_t<StreamOp::Copy, false>(s, iters);
+    case StreamOp::Scale: return nt ? run_stream_t<StreamOp::Scale, true>(s, iters) : run_stream_t<StreamOp::Scale, false>(s, iters);
+    case StreamOp::Add:   return nt ? run_stream_t<StreamOp::Add, true>(s, iters)   : run_stream_t<StreamOp::Add, false>(s, iters);
+    case StreamOp::Triad: return nt ? run_stream_t<StreamOp::Triad, true>(s, iters) : run_stream_t<StreamOp::Triad, false>(s, iters);
+  }
+  return StreamResult();
+}
+
+// Chains are x = x * m + a with m just below 1, so values settle instead of
+// overflowing; the sum goes to a volatile so the loop is kept.
+static constexpr int kFmaChains = 12;
+
+static double fma_sample(long rounds) {
+  volatile float sink = 0.0f;
+  double t0 = now_seconds();
+#pragma omp parallel
+  {
+    float acc = 0.0f;
+#if defined(__AVX2__)
+    const __m256 mul = _mm256_set1_ps(0.999999f);
+    const __m256 add = _mm256_set1_ps(1e-6f * (float)(omp_get_thread_num() + 1));
+    __m256 x[kFmaChains];
+    for (int c = 0; c < kFmaChains; c++) x[c] = _mm256_set1_ps((float)c);
+    for (long r = 0; r < rounds; r++) {
+      for (int c = 0; c < kFmaChains; c++) x[c] = _mm256_fmadd_ps(x[c], mul, add);
+    }
+    __m256 s8 = x[0];
+    for (int c = 1; c < kFmaChains; c++) s8 = _mm256_add_ps(s8, x[c]);
+    alignas(32) float lanes[8];
+    _mm256_store_ps(lanes, s8);
+    for (float v : lanes) acc += v;
+#else
+    const float mul = 0.999999f;
+    const float add = 1e-6f * (float)(omp_get_thread_num() + 1);
+    float x[kFmaChains];
+    for (int c = 0; c < kFmaChains; c++) x[c] = (float)c;
+    for (long r = 0; r < rounds; r++) {
+      for (int c = 0; c < kFmaChains; c++) x[c] = std::fma(x[c], mul, add);
+    }
+    for (int c = 0; c < kFmaChains; c++) acc += x[c];
+#endif
+#pragma omp critical
+    sink = sink + acc;
+  }
+  return now_seconds() - t0;
+}
+
+double fma_peak_gflops(int iters) {
+#if defined(__AVX2__)
+  const double lanes = 8.0;
+#else
+  const double lanes = 1.0;
+#endif
+  // Untimed warm-up, which also sizes the samples to ~10 ms.
+  long rounds = 1 << 14;
+  const double one = std::max(1e-9, fma_sample(rounds));
+  rounds = std::max(rounds, (long)((double)rounds * 1e-2 / one));
+
+  double best = 1e30;
+  for (int it = 0; it < std::max(1, iters); it++) best = std::min(best, fma_sample(rounds));
+  const double flops = 2.0 * lanes * kFmaChains * (double)rounds * (double)omp_get_max_threads();
+  return flops / best / 1e9;
+}
@@ -1,46 +1,597 @@
 #pragma once
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
-struct AlignedBuffer {
-  float* ptr = nullptr;
+template <typename T>
+struct AlignedBufferT {
+  T* ptr = nullptr;
   size_t count = 0;
 };
+using AlignedBuffer = AlignedBufferT<float>;
+
+// Page policy for aligned allocations of at least half a huge page:
+//   Small: posix_memalign, 4 KiB pages.
+//   THP:   2 MiB-aligned, madvise(MADV_HUGEPAGE); khugepaged/fault-time THP
+//          decides, so the effective size is reported by buffer_page_kib.
+//   Huge2M / Huge1G: mmap(MAP_HUGETLB) from the reserved pool
+//          (vm.nr_hugepages / hugepages-1048576kB); when the pool is empty
+//          it falls back to THP, with one warning on stderr (on a kernel
+//          without THP that buffer ends up on 4 KiB pages).
+// Smaller allocations always use Small. Process-wide; set before allocating.
+enum class PagePolicy { Small, THP, Huge2M, Huge1G };
+const char* page_policy_name(PagePolicy p);
+bool parse_page_policy(const std::string& s, PagePolicy& out);
+void set_page_policy(PagePolicy p);
+PagePolicy page_policy();
+
+// Page size backing [p, p + bytes) in KiB from /proc/self/smaps: the hugetlb
+// page size, 2048 when at least half of it is THP-backed, else 4; 0 if
+// unknown. Touch the buffer first.
+size_t buffer_page_kib(const void* p, size_t bytes);
+
+// Raw aligned allocation under the page policy; aborts on failure.
+void* alloc_aligned_bytes(size_t bytes, size_t alignment);
+void free_aligned_bytes(void* p);
+
+template <typename T>
+AlignedBufferT<T> make_aligned(size_t count, size_t alignment) {
+  AlignedBufferT<T> b;
+  b.count = count;
+  b.ptr = (T*)alloc_aligned_bytes(count * sizeof(T), alignment);
+  return b;
+}
+
+template <typename T>
+void free_aligned(AlignedBufferT<T>& b) {
+  free_aligned_bytes(b.ptr);
+  b.ptr = nullptr;
+  b.count = 0;
+}
 
 AlignedBuffer make_aligned_f32(size_t count, size_t alignment);
-void free_aligned(AlignedBuffer& b);
 
 void fill_random(float* x, size_t n, uint64_t seed);
 void zero_fill(float* x, size_t n);
 
+// Contiguous array for CSR storage: either owns a std::vector or views
+// external memory (an mmap'd file) kept alive by a shared handle, so large
+// matrices can be used zero-copy. Exposes the std::vector subset CSR code uses;
+// resize/assign on a view copies it into owned storage first.
+template <typename T>
+class CsrArray {
+ public:
+  CsrArray() = default;
+  CsrArray(const CsrArray& o) { *this = o; }
+  CsrArray(CsrArray&& o) noexcept { *this = std::move(o); }
+  CsrArray& operator=(const CsrArray& o) {
+    if (this == &o) return *this;
+    keep_ = o.keep_;
+    if (keep_) { own_.clear(); p_ = o.p_; n_ = o.n_; }
+    else       { own_ = o.own_; sync(); }
+    return *this;
+  }
+  CsrArray& operator=(CsrArray&& o) noexcept {
+    keep_ = std::move(o.keep_);
+    own_ = std::move(o.own_);
+    if (keep_) { p_ = o.p_; n_ = o.n_; } else { sync(); }
+    o.p_ = nullptr; o.n_ = 0;
+    return *this;
+  }
+
+  T& operator[](size_t i) { return p_[i]; }
+  const T& operator[](size_t i) const { return p_[i]; }
+  size_t size() const { return n_; }
+  bool empty() const { return n_ == 0; }
+  T* data() { return p_; }
+  const T* data() const { return p_; }
+  T* begin() { return p_; }
+  T* end() { return p_ + n_; }
+  const T* begin() const { return p_; }
+  const T* end() const { return p_ + n_; }
+
+  void resize(size_t n) { own(); own_.resize(n); sync(); }
+  void assign(size_t n, const T& v) { keep_.reset(); own_.assign(n, v); sync(); }
+
+  // Point at external memory; `keep` owns the mapping.
+  void view(T* p, size_t n, std::shared_ptr<void> keep) {
+    own_.clear(); own_.shrink_to_fit();
+    keep_ = std::move(keep); p_ = p; n_ = n;
+  }
+  bool is_view() const { return (bool)keep_; }
+
+ private:
+  void own() {
+    if (!keep_) return;
+    own_.assign(p_, p_ + n_);
+    keep_.reset();
+  }
+  void sync() { p_ = own_.data(); n_ = own_.size(); }
+
+  std::vector<T> own_;
+  T* p_ = nullptr;
+  size_t n_ = 0;
+  std::shared_ptr<void> keep_;
+};
+
 struct CSR {
   int m = 0;
   int k = 0;
-  std::vector<int> rowptr;
-  std::vector<int> colidx;
-  std::vector<float> values;
+  CsrArray<int> rowptr;
+  CsrArray<int> colidx;
+  CsrArray<float> values;
 };
 
 CSR make_random_csr(int m, int k, double density, const std::string& pattern, uint64_t seed);
+// Build CSR from COO triplets (any order; duplicates summed in input order, so
+// the result does not depend on the thread count). vals may be null (all ones).
+CSR csr_from_coo(int m, int k, size_t count, const int* rows, const int* cols, const float* vals);
 size_t csr_nnz(const CSR& A);
 
+// Alternative sparse formats, all built from CSR. Padding slots (ELL/SELL/BSR)
+// carry value 0 and a valid column index so kernels never branch on them.
+struct CSC {
+  int m = 0;
+  int k = 0;
+  std::vector<int> colptr;
+  std::vector<int> rowidx;
+  std::vector<float> values;
+};
+
+struct ELL {
+  int m = 0;
+  int k = 0;
+  int width = 0;               // max row length
+  std::vector<int> colidx;     // m * width, row-major
+  std::vector<float> values;   // m * width, row-major
+};
+
+struct SELL {
+  int m = 0;
+  int k = 0;
+  int C = 8;                   // rows per slice
+  int sigma = 1;               // sort window (rows)
+  std::vector<int> perm;       // slice lane -> original row (padded to slices*C, -1 = empty)
+  std::vector<int> sliceptr;   // slices + 1, offsets into colidx/values
+  std::vector<int> slicelen;   // padded row length per slice
+  std::vector<int> colidx;     // per slice: [slot][lane]
+  std::vector<float> values;
+};
+
+struct BSR {
+  int m = 0;
+  int k = 0;
+  int bs = 4;                  // square block size
+  int mb = 0;                  // block rows = ceil(m / bs)
+  std::vector<int> browptr;
+  std::vector<int> bcolidx;
+  std::vector<float> values;   // bs * bs per block, row-major
+};
+
+CSC csr_to_csc(const CSR& A);
+ELL csr_to_ell(const CSR& A);
+SELL csr_to_sell(const CSR& A, int C, int sigma);
+BSR csr_to_bsr(const CSR& A, int bs);
+
+size_t ell_stored(const ELL& A);
+size_t sell_stored(const SELL& A);
+size_t bsr_stored(const BSR& A);
+
+// Reordering for B locality in SpMM/SpMV. A' = P A Q^T with row order
+// row_perm (new -> old) and column order col_perm (new -> old); then
+// A' (Q B) = P (A B), so B's rows are permuted by col_perm and C comes out
+// in row_perm order.
+//   Rcm:    reverse Cuthill-McKee on the pattern of A + A^T (square A only),
+//           same order for rows and columns; narrows the band so nearby rows
+//           reuse nearby B rows.
+//   Degree: rows by descending length, columns by descending count, so the
+//           most reused B rows sit together (any shape).
+enum class Reorder { None, Rcm, Degree };
+
+const char* reorder_name(Reorder r);
+bool parse_reorder(const std::string& s, Reorder& out);
+
+// Identity for None; false (and no permutation) for Rcm on non-square A.
+bool reorder_perm(const CSR& A, Reorder r, std::vector<int>& row_perm, std::vector<int>& col_perm);
+CSR permute_csr(const CSR& A, const std::vector<int>& row_perm, const std::vector<int>& col_perm);
+// dst row i = src row perm[i], n floats per row.
+void permute_rows(const float* src, float* dst, const std::vector<int>& perm, int n);
+// max |i - j| over the stored entries, and its mean (profile / nnz).
+int csr_bandwidth(const CSR& A, double* mean = nullptr);
+
 enum class LayoutB { RowMajor, ColMajor };
 
+// Fused epilogue for the f32 GEMM/SpMM kernels:
+//   C = act(alpha * A*B + beta * C + row_bias[i] + col_bias[j])
+// Applied as each C element is first and last produced, so there is no
+// separate zero-fill or post-pass over C. beta == 0 never reads C (stale or
+// NaN contents are fine); beta == 1 accumulates into C. Bias pointers are
+// optional (length m and n).
+enum class Activation { None, ReLU, GELU };
+
+struct Epilogue {
+  float alpha = 1.0f;
+  float beta = 0.0f;
+  const float* row_bias = nullptr;
+  const float* col_bias = nullptr;
+  Activation act = Activation::None;
+};
+
+const char* activation_name(Activation a);
+bool parse_activation(const std::string& s, Activation& out);
+
 void gemm_tiled_scalar(const float* A, const float* B, float* C, int m, int k, int n,
-                       int tileM, int tileK, int tileN);
+                       int tileM, int tileK, int tileN, const Epilogue& epi = Epilogue());
 
 #if defined(__AVX2__)
 void gemm_tiled_avx2(const float* A, const float* B, float* C, int m, int k, int n,
-                     int tileM, int tileK, int tileN);
+                     int tileM, int tileK, int tileN, const Epilogue& epi = Epilogue());
+#endif
+
+// BLAS-style form of the tiled GEMM: C (m x n, row stride ldc) =
+// epilogue(op(A) * op(B)) with op(A) m x k and op(B) k x n. Trans::N reads A
+// as m x k rows of stride lda (>= k); Trans::T reads it as stored k x m
+// (lda >= m), i.e. uses A^T. Same for B. Strided sub-blocks of larger
+// matrices are used in place; a transposed operand is packed tile by tile
+// (transposing as it is copied) into a per-thread buffer, never as a whole.
+// gemm_tiled_* above are the N, N, lda = k, ldb = ldc = n case.
+enum class Trans { N, T };
+
+void gemm_tiled_op_scalar(Trans transA, Trans transB, const float* A, int lda,
+                          const float* B, int ldb, float* C, int ldc, int m, int k, int n,
+                          int tileM, int tileK, int tileN, const Epilogue& epi = Epilogue());
+#if defined(__AVX2__)
+void gemm_tiled_op_avx2(Trans transA, Trans transB, const float* A, int lda,
+                        const float* B, int ldb, float* C, int ldc, int m, int k, int n,
+                        int tileM, int tileK, int tileN, const Epilogue& epi = Epilogue());
+#endif
 
+#if defined(__AVX2__)
 void spmm_csr_avx2(const CSR& A, const float* B, float* C, int n,
-                   int jblock, LayoutB layoutB);
+                   int jblock, LayoutB layoutB, const Epilogue& epi = Epilogue());
 #endif
 
 void spmm_csr_scalar(const CSR& A, const float* B, float* C, int n,
-                     int jblock, LayoutB layoutB);
+                     int jblock, LayoutB layoutB, const Epilogue& epi = Epilogue());
+
+// 2D-blocked CSR-SpMM for B larger than the cache (row-major B only). The
+// 1D kernels sweep all of B for every row; here the loop order is jblock ->
+// panel of panel_k A columns -> rows, so each pass over the rows reuses one
+// panel_k x jblock slab of B. Column indices must be sorted within rows (all
+// CSR builders here produce them that way). panel_k <= 0 means one panel.
+void spmm_csr_panel_scalar(const CSR& A, const float* B, float* C, int n,
+                           int jblock, int panel_k, const Epilogue& epi = Epilogue());
+#if defined(__AVX2__)
+void spmm_csr_panel_avx2(const CSR& A, const float* B, float* C, int n,
+                         int jblock, int panel_k, const Epilogue& epi = Epilogue());
+#endif
+// Panel rows so that a panel x jblock f32 slab of B takes half of cache_bytes
+// (1 MiB when 0), a multiple of 64 when that large, capped at k.
+int csr_panel_k(int k, int jblock, size_t cache_bytes);
+
+// One panel step of the panel kernel over A rows [i0, i1), for callers that
+// hold only B rows [c0, c1) (Bpanel, row stride n) and C rows from i0 (Cpanel)
+// in memory, e.g. out-of-core SpMM. cursor (length A.m) carries each row's
+// position from panel to panel; c0 == 0 starts the rows over. Panels must be
+// visited in increasing c0 up to k for the epilogue to be complete.
+void spmm_csr_rows_panel_scalar(const CSR& A, int i0, int i1, int c0, int c1,
+                                const float* Bpanel, float* Cpanel, int n, int jblock,
+                                int* cursor, const Epilogue& epi = Epilogue());
+#if defined(__AVX2__)
+void spmm_csr_rows_panel_avx2(const CSR& A, int i0, int i1, int c0, int c1,
+                              const float* Bpanel, float* Cpanel, int n, int jblock,
+                              int* cursor, const Epilogue& epi = Epilogue());
+#endif
+
+// Cache-oblivious GEMM: recursively halves the largest of m, k, n until the
+// block is at most 64 on every side, then runs a 4 x 16 register tile. No
+// tile sizes to tune; every cache level sees blocks that fit it somewhere in
+// the recursion. m/n halves run as OpenMP tasks, k halves in order.
+void gemm_recursive_scalar(const float* A, const float* B, float* C, int m, int k, int n,
+                           const Epilogue& epi = Epilogue());
+#if defined(__AVX2__)
+void gemm_recursive_avx2(const float* A, const float* B, float* C, int m, int k, int n,
+                         const Epilogue& epi = Epilogue());
+#endif
+
+// Morton (Z-order) packed matrix: tile x tile row-major tiles, zero padded at
+// the edges, stored in the order the recursion visits them (halve the longer
+// side of the tile grid; plain Z-order on square power-of-two grids). A
+// recursive sub-block is then a contiguous run of memory at every level.
+struct MortonMatrix {
+  int rows = 0;
+  int cols = 0;
+  int tile = 64;
+  int row_tiles = 0;
+  int col_tiles = 0;
+  std::vector<int> slot;  // ti * col_tiles + tj -> position in data (in tiles)
+  AlignedBuffer data;
+};
+
+MortonMatrix make_morton(const float* X, int rows, int cols, int tile = 64);
+void free_morton(MortonMatrix& M);
+
+// Same recursion over tiles of Morton-packed A (m x k) and B (k x n), same
+// tile size; C stays row-major.
+void gemm_morton_scalar(const MortonMatrix& A, const MortonMatrix& B, float* C,
+                        const Epilogue& epi = Epilogue());
+#if defined(__AVX2__)
+void gemm_morton_avx2(const MortonMatrix& A, const MortonMatrix& B, float* C,
+                      const Epilogue& epi = Epilogue());
+#endif
+
+// Bump allocator for kernel temporaries: reserve once, then calls take and
+// release stack-ordered slices without touching the heap.
+struct GemmArena {
+  AlignedBuffer buf;
+  size_t top = 0;  // floats in use
+};
+
+// Grows (never shrinks) the arena to at least floats; not while in use.
+void reserve_arena(GemmArena& a, size_t floats);
+void free_arena(GemmArena& a);
+
+// Strassen-Winograd GEMM (7 products, 15 additions per level). Recurses while
+// min(m, k, n) > cutoff, halving the even part of each dimension (odd edges
+// are peeled and finished with plain dot products), then runs gemm_tiled on
+// the leaves. Temporaries are three quarter-size blocks per level taken from
+// the arena; size it with strassen_arena_floats() before timing, or the
+// first call grows it. The epilogue is applied in one pass after the
+// product (beta != 0 stages the product in the arena).
+int strassen_levels(int m, int k, int n, int cutoff);
+// Higham's normwise bound for Winograd's variant over l levels with leaves of
+// side n0, (18^l (n0^2 + 6 n0) - 6 n) u: max |C - AB| <= bound max|A| max|B|.
+double strassen_error_bound(int m, int k, int n, int cutoff);
+size_t strassen_arena_floats(int m, int k, int n, int cutoff);
+void gemm_strassen_scalar(const float* A, const float* B, float* C, int m, int k, int n,
+                          int cutoff, int tileM, int tileK, int tileN, GemmArena& arena,
+                          const Epilogue& epi = Epilogue());
+#if defined(__AVX2__)
+void gemm_strassen_avx2(const float* A, const float* B, float* C, int m, int k, int n,
+                        int cutoff, int tileM, int tileK, int tileN, GemmArena& arena,
+                        const Epilogue& epi = Epilogue());
+#endif
+
+// Batched small GEMM: C[i] = A[i] * B[i] (overwritten, row-major, packed) for
+// many independent problems. Parallel across the batch, one thread per matrix;
+// square 16/32/64/128 use compile-time-sized fully unrolled kernels.
+// seconds (optional, count entries) receives each matrix's own wall time,
+// read by the thread that computed it.
+struct GemmShape {
+  int m = 0;
+  int k = 0;
+  int n = 0;
+};
+
+void gemm_batched_scalar(const float* const* A, const float* const* B, float* const* C,
+                         const GemmShape* shapes, int count, double* seconds = nullptr);
+#if defined(__AVX2__)
+void gemm_batched_avx2(const float* const* A, const float* const* B, float* const* C,
+                       const GemmShape* shapes, int count, double* seconds = nullptr);
+#endif
+// Dispatches to the widest variant compiled in.
+void gemm_batched(const float* const* A, const float* const* B, float* const* C,
+                  const GemmShape* shapes, int count, double* seconds = nullptr);
+
+// Alternative-format SpMM kernels take row-major B only. CSC scatters into
+// arbitrary C rows, so it has no epilogue and always overwrites C.
+void spmm_csc_scalar(const CSC& A, const float* B, float* C, int n, int jblock);
+void spmm_ell_scalar(const ELL& A, const float* B, float* C, int n, int jblock,
+                     const Epilogue& epi = Epilogue());
+void spmm_sell_scalar(const SELL& A, const float* B, float* C, int n, int jblock,
+                      const Epilogue& epi = Epilogue());
+void spmm_bsr_scalar(const BSR& A, const float* B, float* C, int n, int jblock,
+                     const Epilogue& epi = Epilogue());
+
+#if defined(__AVX2__)
+void spmm_csc_avx2(const CSC& A, const float* B, float* C, int n, int jblock);
+void spmm_ell_avx2(const ELL& A, const float* B, float* C, int n, int jblock,
+                   const Epilogue& epi = Epilogue());
+void spmm_sell_avx2(const SELL& A, const float* B, float* C, int n, int jblock,
+                    const Epilogue& epi = Epilogue());
+void spmm_bsr_avx2(const BSR& A, const float* B, float* C, int n, int jblock,
+                   const Epilogue& epi = Epilogue());
+#endif
+
+// Sparse x sparse: C = A * B for CSR A (m x k) and B (k x n), C as a CSR
+// with sorted, duplicate-free rows (explicit zeros from cancellation are
+// kept). A symbolic pass counts each output row, a prefix sum sizes C once,
+// and the numeric pass writes straight into the final arrays. Each row uses
+// a per-thread accumulator: a dense SPA (O(n) scratch, no hashing) when that
+// scratch is cache-sized or the row's product count is at least n / 16,
+// else a hash table sized to the row.
+enum class SpgemmAccum { Auto, Hash, Dense };
+
+const char* spgemm_accum_name(SpgemmAccum a);
+bool parse_spgemm_accum(const std::string& s, SpgemmAccum& out);
+
+CSR spgemm_csr(const CSR& A, const CSR& B, SpgemmAccum acc = SpgemmAccum::Auto);
+// Scalar multiply-adds SpGEMM performs: sum over A's entries of B row lengths.
+size_t spgemm_products(const CSR& A, const CSR& B);
+
+// SpMV y = A x (n == 1). Rows are split into contiguous per-thread ranges
+// balanced on nonzeros; rows at least long_len long are taken out of those
+// ranges and their nonzeros are split evenly across all threads instead.
+// The AVX2 path runs rows of 32+ entries as two 8-wide gather/FMA chains on
+// x with colidx/values prefetched ahead, shorter rows as a scalar dot. Build
+// the plan once per matrix and thread count; y is overwritten.
+struct SpmvPlan {
+  int threads = 1;
+  int long_len = 0;
+  std::vector<int> row_split;   // threads + 1 row boundaries
+  std::vector<int> long_rows;   // ascending
+  std::vector<size_t> long_off; // long_rows.size() + 1 prefix of their lengths
+};
+
+SpmvPlan make_spmv_plan(const CSR& A, int threads);
+
+void spmv_csr_scalar(const CSR& A, const SpmvPlan& plan, const float* x, float* y);
+#if defined(__AVX2__)
+void spmv_csr_avx2(const CSR& A, const SpmvPlan& plan, const float* x, float* y);
+#endif
+
+// ---------------------------------------------------------------------------
+// Mixed precision (a2_mixed.cpp): bf16/fp16 storage with fp32 accumulation,
+// int8 x int8 -> int32. Same loop structure as the f32 kernels; the storage
+// type selects the overload. SpMM takes structure from a CSR and values from a
+// separate typed array; B is row-major. Every kernel overwrites C (C = A*B),
+// like the f32 ones.
+// ---------------------------------------------------------------------------
+
+struct bf16_t { uint16_t bits; };
+struct fp16_t { uint16_t bits; };
+
+enum class DType { F32, BF16, F16, I8 };
+const char* dtype_name(DType t);
+bool parse_dtype(const std::string& s, DType& out);
+size_t dtype_bytes(DType t);
+
+// Storage conversion (round to nearest even). Values in [-1, 1) quantize to
+// int8 as round(x * scale).
+void convert_f32(const float* src, bf16_t* dst, size_t n);
+void convert_f32(const float* src, fp16_t* dst, size_t n);
+void quantize_i8(const float* src, int8_t* dst, size_t n, float scale);
+
+void gemm_tiled_scalar(const bf16_t* A, const bf16_t* B, float* C, int m, int k, int n,
+                       int tileM, int tileK, int tileN);
+void gemm_tiled_scalar(const fp16_t* A, const fp16_t* B, float* C, int m, int k, int n,
+                       int tileM, int tileK, int tileN);
+void gemm_tiled_scalar(const int8_t* A, const int8_t* B, int32_t* C, int m, int k, int n,
+                       int tileM, int tileK, int tileN);
+
+void spmm_csr_scalar(const CSR& A, const bf16_t* values, const bf16_t* B, float* C, int n, int jblock);
+void spmm_csr_scalar(const CSR& A, const fp16_t* values, const fp16_t* B, float* C, int n, int jblock);
+void spmm_csr_scalar(const CSR& A, const int8_t* values, const int8_t* B, int32_t* C, int n, int jblock);
+
+#if defined(__AVX2__)
+void gemm_tiled_avx2(const bf16_t* A, const bf16_t* B, float* C, int m, int k, int n,
+                     int tileM, int tileK, int tileN);
+void gemm_tiled_avx2(const fp16_t* A, const fp16_t* B, float* C, int m, int k, int n,
+                     int tileM, int tileK, int tileN);
+void gemm_tiled_avx2(const int8_t* A, const int8_t* B, int32_t* C, int m, int k, int n,
+                     int tileM, int tileK, int tileN);
+
+// int8 B in the dot-product layout: [t4][j][4] (4 consecutive k per output
+// column), biased to u8 by +128. Pack once per B and reuse it; the int8_t* B
+// overload above packs on every call.
+struct PackedBI8 {
+  int k = 0;
+  int n = 0;
+  AlignedBufferT<uint8_t> data;
+};
+PackedBI8 pack_b_i8(const int8_t* B, int k, int n);
+void free_packed_b_i8(PackedBI8& p);
+void gemm_tiled_avx2(const int8_t* A, const PackedBI8& B, int32_t* C, int m,
+                     int tileM, int tileK, int tileN);
+
+void spmm_csr_avx2(const CSR& A, const bf16_t* values, const bf16_t* B, float* C, int n, int jblock);
+void spmm_csr_avx2(const CSR& A, const fp16_t* values, const fp16_t* B, float* C, int n, int jblock);
+void spmm_csr_avx2(const CSR& A, const int8_t* values, const int8_t* B, int32_t* C, int n, int jblock);
+#endif
+
+// ---------------------------------------------------------------------------
+// Format auto-selection: predict dense GEMM / CSR / SELL / BSR cost from the
+// sparsity structure and a calibrated per-kernel cost model, run the cheapest.
+// ---------------------------------------------------------------------------
+
+enum class SpmmPath { Gemm, Csr, Sell, Bsr };
+const char* spmm_path_name(SpmmPath p);
+
+struct SparseStats {
+  int m = 0;
+  int k = 0;
+  size_t nnz = 0;
+  double density = 0.0;
+  double row_mean = 0.0;
+  double row_cv = 0.0;            // stddev / mean of row lengths
+  int row_max = 0;
+  std::vector<size_t> row_hist;   // [0] empty rows, [b] lengths in [2^(b-1), 2^b)
+  size_t sell_stored = 0;         // padded entries for SELL-C-sigma
+  size_t bsr_blocks = 0;          // nonzero bs x bs blocks
+};
+
+SparseStats analyze_sparsity(const CSR& A, int sell_c, int sell_sigma, int bsr_block);
+
+// Seconds per unit of work for each path at the current thread count.
+// Defaults are rough single-socket AVX2 numbers; calibrate for real use.
+struct SpmmCostModel {
+  bool calibrated = false;
+  int sell_c = 8;
+  int sell_sigma = 256;
+  int bsr_block = 4;
+  double gemm_s_per_fma = 1.0 / 15e9;     // per m*k*n
+  double csr_s_per_fma = 1.0 / 5e9;       // per nnz*n
+  double sell_s_per_fma = 1.0 / 6e9;      // per sell_stored*n
+  double bsr_s_per_fma = 1.0 / 8e9;       // per bsr_blocks*bs*bs*n
+  double densify_s_per_elem = 1.0 / 2e9;  // per m*k (zero + scatter)
+  double conv_s_per_nnz = 1.0 / 1e8;      // CSR -> SELL/BSR, per nnz
+};
+
+SpmmCostModel calibrate_spmm_cost_model(int n, uint64_t seed);
+
+struct SpmmAutoPlan {
+  SpmmPath path = SpmmPath::Csr;
+  SparseStats stats;
+  double pred_seconds[4] = {0.0, 0.0, 0.0, 0.0};  // indexed by SpmmPath, incl. amortized prep
+  SELL sell;
+  BSR bsr;
+  AlignedBuffer dense;  // densified A for SpmmPath::Gemm
+};
+
+// amortize_calls: how many multiplies will reuse the plan (spreads prep cost).
+SpmmAutoPlan spmm_auto_plan(const CSR& A, int n, const SpmmCostModel& model,
+                            int amortize_calls, bool log);
+void spmm_auto_run(const SpmmAutoPlan& plan, const CSR& A, const float* B, float* C,
+                   int n, int jblock);
+void free_spmm_auto_plan(SpmmAutoPlan& plan);
+
+// One-shot convenience: plan (logged to stderr), run, free.
+SpmmPath spmm_auto(const CSR& A, const float* B, float* C, int n, int jblock,
+                   const SpmmCostModel& model);
+
+// ---------------------------------------------------------------------------
+// STREAM-style bandwidth suite
+// ---------------------------------------------------------------------------
+// copy c = a, scale b = s*c, add c = a + b, triad a = b + s*c. Bytes are
+// counted the STREAM way (2 or 3 arrays per element); with nt the stores are
+// non-temporal, so no write-allocate read rides on top of that count.
+enum class StreamOp { Copy, Scale, Add, Triad };
+
+const char* stream_op_name(StreamOp op);
+bool parse_stream_op(const std::string& s, StreamOp& out);
+int stream_op_arrays(StreamOp op);
+
+// Three N-float arrays, initialized in parallel by the current OpenMP team
+// with the same static split the kernels use (first touch by the consumer).
+struct StreamArrays {
+  AlignedBuffer a, b, c;
+  size_t N = 0;
+};
+
+StreamArrays make_stream_arrays(size_t N);
+void free_stream_arrays(StreamArrays& s);
+
+struct StreamResult {
+  double best_gbps = 0.0;
+  double avg_gbps = 0.0;
+  double best_seconds = 0.0;  // one pass over the arrays
+  int passes = 1;             // passes per timed sample
+};
+
+// One untimed warm-up pass, then iters timed samples. Each sample runs
+// enough passes inside one parallel region to span ~1 ms, so cache-resident
+// sizes are not dominated by region dispatch.
+StreamResult run_stream(StreamOp op, StreamArrays& s, int iters, bool nt);
 
-double stream_triad_bandwidth_gbps(size_t N, int iters, uint64_t seed);
+// ---------------------------------------------------------------------------
+// FMA throughput ceiling
+// ---------------------------------------------------------------------------
+// Every team thread runs independent register-resident FMA chains (enough of
+// them to cover FMA latency on both ports) at the widest width the kernels
+// are built for (8-wide AVX2, else scalar). Returns the best of iters
+// samples in GFLOP/s, counting an FMA as 2 flops; this is the compute roof
+// the kernels in this file can reach, not the CPU's datasheet peak.
+double fma_peak_gflops(int iters);
 
@@ -0,0 +1,542 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "a2_kernels.h"
+
+#if defined(__AVX2__) || defined(__F16C__)
+  #include <immintrin.h>
+#endif
+
+// VNNI u8 x s8 -> s32 dot product of 4-byte groups, if the target has it.
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+  #define A2_HAVE_VNNI 1
+  #define A2_DPBUSD(acc, u, s) _mm256_dpbusd_epi32((acc), (u), (s))
+#elif defined(__AVXVNNI__)
+  #define A2_HAVE_VNNI 1
+  #define A2_DPBUSD(acc, u, s) _mm256_dpbusd_avx_epi32((acc), (u), (s))
+#endif
+
+const char* dtype_name(DType t) {
+  switch (t) {
+    case DType::F32:  return "f32";
+    case DType::BF16: return "bf16";
+    case DType::F16:  return "f16";
+    case DType::I8:   return "i8";
+  }
+  return "?";
+}
+
+bool parse_dtype(const std::string& s, DType& out) {
+  if (s == "f32")  { out = DType::F32;  return true; }
+  if (s == "bf16") { out = DType::BF16; return true; }
+  if (s == "f16")  { out = DType::F16;  return true; }
+  if (s == "i8")   { out = DType::I8;   return true; }
+  return false;
+}
+
+size_t dtype_bytes(DType t) {
+  switch (t) {
+    case DType::F32:  return 4;
+    case DType::BF16: return 2;
+    case DType::F16:  return 2;
+    case DType::I8:   return 1;
+  }
+  return 4;
+}
+
+// ---------------------------------------------------------------------------
+// Scalar conversions
+// ---------------------------------------------------------------------------
+
+static inline float to_f32(bf16_t x) {
+  uint32_t u = (uint32_t)x.bits << 16;
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline bf16_t to_bf16(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  if ((u & 0x7FFFFFFFu) > 0x7F800000u) return bf16_t{(uint16_t)((u >> 16) | 0x40)};  // quiet NaN
+  u += 0x7FFFu + ((u >> 16) & 1u);
+  return bf16_t{(uint16_t)(u >> 16)};
+}
+
+#if defined(__F16C__)
+static inline float to_f32(fp16_t x) { return _cvtsh_ss(x.bits); }
+static inline fp16_t to_fp16(float f) { return fp16_t{_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT)}; }
+#else
+static inline float to_f32(fp16_t x) {
+  uint32_t sign = (uint32_t)(x.bits & 0x8000u) << 16;
+  uint32_t exp = (x.bits >> 10) & 0x1Fu;
+  uint32_t man = x.bits & 0x3FFu;
+  uint32_t u;
+  if (exp == 0x1F) {
+    u = sign | 0x7F800000u | (man << 13);
+  } else if (exp != 0) {
+    u = sign | ((exp + 112u) << 23) | (man << 13);
+  } else if (man == 0) {
+    u = sign;
+  } else {  // subnormal half -> normal float
+    int e = -1;
+    do { man <<= 1; e++; } while (!(man & 0x400u));
+    u = sign | ((uint32_t)(112 - e) << 23) | ((man & 0x3FFu) << 13);
+  }
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline fp16_t to_fp16(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  uint16_t sign = (uint16_t)((u >> 16) & 0x8000u);
+  uint32_t au = u & 0x7FFFFFFFu;
+  if (au > 0x7F800000u) return fp16_t{(uint16_t)(sign | 0x7E00u)};
+  if (au >= 0x477FF000u) return fp16_t{(uint16_t)(sign | 0x7C00u)};  // overflow -> inf
+  if (au < 0x38800000u) {                                             // half subnormal / zero
+    float a;
+    std::memcpy(&a, &au, sizeof(a));
+    return fp16_t{(uint16_t)(sign | (uint16_t)std::nearbyint(a * 16777216.0f))};
+  }
+  uint32_t r = au + 0xFFFu + ((au >> 13) & 1u);
+  return fp16_t{(uint16_t)(sign | (uint16_t)((r - 0x38000000u) >> 13))};
+}
+#endif
+
+void convert_f32(const float* src, bf16_t* dst, size_t n) {
+#pragma omp parallel for schedule(static)
+  for (size_t i0 = 0; i0 < n; i0 += 4096) {
+    size_t i1 = std::min(n, i0 + 4096);
+    size_t i = i0;
+#if defined(__AVX512BF16__) && defined(__AVX512VL__)
+    for (; i + 8 <= i1; i += 8) {
+      __m128bh h = _mm256_cvtneps_pbh(_mm256_loadu_ps(src + i));
+      _mm_storeu_si128((__m128i*)(dst + i), (__m128i)h);
+    }
+#endif
+    for (; i < i1; i++) dst[i] = to_bf16(src[i]);
+  }
+}
+
+void convert_f32(const float* src, fp16_t* dst, size_t n) {
+#pragma omp parallel for schedule(static)
+  for (size_t i0 = 0; i0 < n; i0 += 4096) {
+    size_t i1 = std::min(n, i0 + 4096);
+    size_t i = i0;
+#if defined(__F16C__)
+    for (; i + 8 <= i1; i += 8) {
+      __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+      _mm_storeu_si128((__m128i*)(dst + i), h);
+    }
+#endif
+    for (; i < i1; i++) dst[i] = to_fp16(src[i]);
+  }
+}
+
+void quantize_i8(const float* src, int8_t* dst, size_t n, float scale) {
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < n; i++) {
+    float q = std::nearbyint(src[i] * scale);
+    dst[i] = (int8_t)std::max(-127.0f, std::min(127.0f, q));
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Scalar kernels (all storage types)
+// ---------------------------------------------------------------------------
+
+static inline float widen(bf16_t x) { return to_f32(x); }
+static inline float widen(fp16_t x) { return to_f32(x); }
+static inline int32_t widen(int8_t x) { return (int32_t)x; }
+
+// C = A * B: the first k step (t == 0) stores instead of accumulating, so C
+// needs no clearing, as with the f32 kernels.
+template <typename T, typename Acc>
+static void gemm_tiled_scalar_t(const T* A, const T* B, Acc* C,
+                                int m, int k, int n, int tileM, int tileK, int tileN) {
+  if (k == 0) {
+    std::memset(C, 0, (size_t)m * (size_t)n * sizeof(Acc));
+    return;
+  }
+#pragma omp parallel for schedule(static)
+  for (int ii = 0; ii < m; ii += tileM) {
+    for (int kk = 0; kk < k; kk += tileK) {
+      for (int jj = 0; jj < n; jj += tileN) {
+        int i_end = std::min(m, ii + tileM);
+        int k_end = std::min(k, kk + tileK);
+        int j_end = std::min(n, jj + tileN);
+        for (int i = ii; i < i_end; i++) {
+          Acc* c = &C[(size_t)i * n];
+          int t = kk;
+          if (kk == 0) {
+            Acc a = widen(A[(size_t)i * k]);
+            for (int j = jj; j < j_end; j++) c[j] = a * widen(B[j]);
+            t = 1;
+          }
+          for (; t < k_end; t++) {
+            Acc a = widen(A[(size_t)i * k + t]);
+            const T* b = &B[(size_t)t * n];
+            for (int j = jj; j < j_end; j++) {
+              c[j] += a * widen(b[j]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T, typename Acc>
+static void spmm_csr_scalar_t(const CSR& A, const T* values, const T* B, Acc* C, int n, int jblock) {
+  const int m = A.m;
+  std::memset(C, 0, (size_t)m * (size_t)n * sizeof(Acc));
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < m; i++) {
+    int p0 = A.rowptr[(size_t)i];
+    int p1 = A.rowptr[(size_t)i + 1];
+    Acc* crow = &C[(size_t)i * n];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      for (int p = p0; p < p1; p++) {
+        Acc a = widen(values[(size_t)p]);
+        const T* brow = &B[(size_t)A.colidx[(size_t)p] * n];
+        for (int j = j0; j < j1; j++) {
+          crow[j] += a * widen(brow[j]);
+        }
+      }
+    }
+  }
+}
+
+void gemm_tiled_scalar(const bf16_t* A, const bf16_t* B, float* C, int m, int k, int n,
+                       int tileM, int tileK, int tileN) {
+  gemm_tiled_scalar_t(A, B, C, m, k, n, tileM, tileK, tileN);
+}
+void gemm_tiled_scalar(const fp16_t* A, const fp16_t* B, float* C, int m, int k, int n,
+                       int tileM, int tileK, int tileN) {
+  gemm_tiled_scalar_t(A, B, C, m, k, n, tileM, tileK, tileN);
+}
+void gemm_tiled_scalar(const int8_t* A, const int8_t* B, int32_t* C, int m, int k, int n,
+                       int tileM, int tileK, int tileN) {
+  gemm_tiled_scalar_t(A, B, C, m, k, n, tileM, tileK, tileN);
+}
+
+void spmm_csr_scalar(const CSR& A, const bf16_t* values, const bf16_t* B, float* C, int n, int jblock) {
+  spmm_csr_scalar_t(A, values, B, C, n, jblock);
+}
+void spmm_csr_scalar(const CSR& A, const fp16_t* values, const fp16_t* B, float* C, int n, int jblock) {
+  spmm_csr_scalar_t(A, values, B, C, n, jblock);
+}
+void spmm_csr_scalar(const CSR& A, const int8_t* values, const int8_t* B, int32_t* C, int n, int jblock) {
+  spmm_csr_scalar_t(A, values, B, C, n, jblock);
+}
+
+#if defined(__AVX2__)
+// ---------------------------------------------------------------------------
+// AVX2 kernels: 16-bit storage widened to fp32 on load, fp32 FMA accumulation
+// ---------------------------------------------------------------------------
+
+static inline __m256 load8_f32(const bf16_t* p) {
+  __m128i h = _mm_loadu_si128((const __m128i*)p);
+  return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+}
+
+#if defined(__F16C__)
+static inline __m256 load8_f32(const fp16_t* p) {
+  return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p));
+}
+#endif
+
+// Overwrites C like the scalar twin: t == 0 stores a * b.
+template <typename T>
+static void gemm_tiled_avx2_t(const T* A, const T* B, float* C,
+                              int m, int k, int n, int tileM, int tileK, int tileN) {
+  if (k == 0) {
+    zero_fill(C, (size_t)m * (size_t)n);
+    return;
+  }
+#pragma omp parallel for schedule(static)
+  for (int ii = 0; ii < m; ii += tileM) {
+    for (int kk = 0; kk < k; kk += tileK) {
+      for (int jj = 0; jj < n; jj += tileN) {
+        int i_end = std::min(m, ii + tileM);
+        int k_end = std::min(k, kk + tileK);
+        int j_end = std::min(n, jj + tileN);
+        int j_vec_end = jj + ((j_end - jj) / 8) * 8;
+
+        for (int i = ii; i < i_end; i++) {
+          float* c = &C[(size_t)i * n];
+          int t = kk;
+          if (kk == 0) {
+            float a = widen(A[(size_t)i * k]);
+            __m256 a8 = _mm256_set1_ps(a);
+            for (int j = jj; j < j_vec_end; j += 8) {
+              _mm256_storeu_ps(c + j, _mm256_mul_ps(a8, load8_f32(B + j)));
+            }
+            for (int j = j_vec_end; j < j_end; j++) c[j] = a * widen(B[j]);
+            t = 1;
+          }
+          for (; t < k_end; t++) {
+            float a = widen(A[(size_t)i * k + t]);
+            __m256 a8 = _mm256_set1_ps(a);
+            const T* b = &B[(size_t)t * n];
+
+            for (int j = jj; j < j_vec_end; j += 8) {
+              __m256 cv = _mm256_loadu_ps(c + j);
+              cv = _mm256_fmadd_ps(a8, load8_f32(b + j), cv);
+              _mm256_storeu_ps(c + j, cv);
+            }
+            for (int j = j_vec_end; j < j_end; j++) {
+              c[j] += a * widen(b[j]);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+static void spmm_csr_avx2_t(const CSR& A, const T* values, const T* B, float* C, int n, int jblock) {
+  const int m = A.m;
+  zero_fill(C, (size_t)m * (size_t)n);
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < m; i++) {
+    int p0 = A.rowptr[(size_t)i];
+    int p1 = A.rowptr[(size_t)i + 1];
+    float* crow = &C[(size_t)i * n];
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      int j_vec_end = j0 + ((j1 - j0) / 8) * 8;
+
+      for (int p = p0; p < p1; p++) {
+        float a = widen(values[(size_t)p]);
+        __m256 a8 = _mm256_set1_ps(a);
+        const T* brow = &B[(size_t)A.colidx[(size_t)p] * n];
+
+        for (int j = j0; j < j_vec_end; j += 8) {
+          __m256 cv = _mm256_loadu_ps(crow + j);
+          cv = _mm256_fmadd_ps(a8, load8_f32(brow + j), cv);
+          _mm256_storeu_ps(crow + j, cv);
+        }
+        for (int j = j_vec_end; j < j1; j++) {
+          crow[j] += a * widen(brow[j]);
+        }
+      }
+    }
+  }
+}
+
+void gemm_tiled_avx2(const bf16_t* A, const bf16_t* B, float* C, int m, int k, int n,
+                     int tileM, int tileK, int tileN) {
+  gemm_tiled_avx2_t(A, B, C, m, k, n, tileM, tileK, tileN);
+}
+
+void spmm_csr_avx2(const CSR& A, const bf16_t* values, const bf16_t* B, float* C, int n, int jblock) {
+  spmm_csr_avx2_t(A, values, B, C, n, jblock);
+}
+
+#if defined(__F16C__)
+void gemm_tiled_avx2(const fp16_t* A, const fp16_t* B, float* C, int m, int k, int n,
+                     int tileM, int tileK, int tileN) {
+  gemm_tiled_avx2_t(A, B, C, m, k, n, tileM, tileK, tileN);
+}
+
+void spmm_csr_avx2(const CSR& A, const fp16_t* values, const fp16_t* B, float* C, int n, int jblock) {
+  spmm_csr_avx2_t(A, values, B, C, n, jblock);
+}
+#else
+void gemm_tiled_avx2(const fp16_t* A, const fp16_t* B, float* C, int m, int k, int n,
+                     int tileM, int tileK, int tileN) {
+  gemm_tiled_scalar(A, B, C, m, k, n, tileM, tileK, tileN);
+}
+
+void spmm_csr_avx2(const CSR& A, const fp16_t* values, const fp16_t* B, float* C, int n, int jblock) {
+  spmm_csr_scalar(A, values, B, C, n, jblock);
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// int8: 4-element dot products into int32 lanes (VNNI dpbusd, or an exact
+// AVX2 emulation). dpbusd wants one unsigned operand, so B bytes are biased
+// by +128 (xor 0x80) and each output row is corrected by -128 * sum(a).
+// ---------------------------------------------------------------------------
+
+static inline __m256i dpbusd(__m256i acc, __m256i u, __m256i s) {
+#if defined(A2_HAVE_VNNI)
+  return A2_DPBUSD(acc, u, s);
+#else
+  const __m256i lo8 = _mm256_set1_epi16(0x00FF);
+  __m256i u_even = _mm256_and_si256(u, lo8);
+  __m256i u_odd = _mm256_srli_epi16(u, 8);
+  __m256i s_even = _mm256_srai_epi16(_mm256_slli_epi16(s, 8), 8);
+  __m256i s_odd = _mm256_srai_epi16(s, 8);
+  acc = _mm256_add_epi32(acc, _mm256_madd_epi16(u_even, s_even));
+  return _mm256_add_epi32(acc, _mm256_madd_epi16(u_odd, s_odd));
+#endif
+}
+
+static inline int32_t pack4(int8_t a0, int8_t a1, int8_t a2, int8_t a3) {
+  return (int32_t)((uint32_t)(uint8_t)a0 | ((uint32_t)(uint8_t)a1 << 8) |
+                   ((uint32_t)(uint8_t)a2 << 16) | ((uint32_t)(uint8_t)a3 << 24));
+}
+
+PackedBI8 pack_b_i8(const int8_t* B, int k, int n) {
+  PackedBI8 p;
+  p.k = k;
+  p.n = n;
+  const int k4 = (k + 3) / 4;
+  p.data = make_aligned<uint8_t>((size_t)k4 * (size_t)n * 4, 64);
+#pragma omp parallel for schedule(static)
+  for (int t4 = 0; t4 < k4; t4++) {
+    uint8_t* dst = &p.data.ptr[(size_t)t4 * n * 4];
+    for (int j = 0; j < n; j++) {
+      for (int r = 0; r < 4; r++) {
+        int t = t4 * 4 + r;
+        dst[(size_t)j * 4 + r] = (uint8_t)((t < k ? B[(size_t)t * n + j] : 0) ^ 0x80);
+      }
+    }
+  }
+  return p;
+}
+
+void free_packed_b_i8(PackedBI8& p) {
+  free_aligned(p.data);
+  p.k = p.n = 0;
+}
+
+void gemm_tiled_avx2(const int8_t* A, const PackedBI8& B, int32_t* C, int m,
+                     int tileM, int tileK, int tileN) {
+  const int k = B.k, n = B.n;
+  const int k4 = (k + 3) / 4;
+  const int tileK4 = std::max(1, (tileK + 3) / 4);
+  const uint8_t* Bp = B.data.ptr;
+
+#pragma omp parallel
+  {
+#pragma omp for schedule(static)
+    for (int i = 0; i < m; i++) {
+      // start every row at the bias correction -128 * sum(a)
+      int32_t s = 0;
+      for (int t = 0; t < k; t++) s += A[(size_t)i * k + t];
+      int32_t c0 = -128 * s;
+      for (int j = 0; j < n; j++) C[(size_t)i * n + j] = c0;
+    }
+
+#pragma omp for schedule(static)
+    for (int ii = 0; ii < m; ii += tileM) {
+      for (int kk4 = 0; kk4 < k4; kk4 += tileK4) {
+        for (int jj = 0; jj < n; jj += tileN) {
+          int i_end = std::min(m, ii + tileM);
+          int k4_end = std::min(k4, kk4 + tileK4);
+          int j_end = std::min(n, jj + tileN);
+          int j_vec_end = jj + ((j_end - jj) / 8) * 8;
+
+          for (int i = ii; i < i_end; i++) {
+            const int8_t* arow = &A[(size_t)i * k];
+            int32_t* crow = &C[(size_t)i * n];
+
+            for (int j = jj; j < j_vec_end; j += 8) {
+              __m256i acc = _mm256_loadu_si256((const __m256i*)(crow + j));
+              for (int t4 = kk4; t4 < k4_end; t4++) {
+                int t = t4 * 4;
+                int32_t a4 = (t + 4 <= k)
+                  ? pack4(arow[t], arow[t + 1], arow[t + 2], arow[t + 3])
+                  : pack4(arow[t], t + 1 < k ? arow[t + 1] : 0, t + 2 < k ? arow[t + 2] : 0, 0);
+                __m256i u = _mm256_loadu_si256((const __m256i*)&Bp[((size_t)t4 * n + j) * 4]);
+                acc = dpbusd(acc, u, _mm256_set1_epi32(a4));
+              }
+              _mm256_storeu_si256((__m256i*)(crow + j), acc);
+            }
+            // tail columns: plain int32 on the biased bytes (b + 128), which
+            // the row's -128 * sum(a) start cancels like the vector lanes
+            for (int j = j_vec_end; j < j_end; j++) {
+              int32_t s = 0;
+              for (int t = kk4 * 4; t < std::min(k, k4_end * 4); t++) {
+                s += (int32_t)arow[t] * (int32_t)Bp[((size_t)(t / 4) * n + j) * 4 + (t % 4)];
+              }
+              crow[j] += s;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+void gemm_tiled_avx2(const int8_t* A, const int8_t* B, int32_t* C, int m, int k, int n,
+                     int tileM, int tileK, int tileN) {
+  PackedBI8 Bp = pack_b_i8(B, k, n);
+  gemm_tiled_avx2(A, Bp, C, m, tileM, tileK, tileN);
+  free_packed_b_i8(Bp);
+}
+
+void spmm_csr_avx2(const CSR& A, const int8_t* values, const int8_t* B, int32_t* C, int n, int jblock) {
+  const int m = A.m;
+  const __m256i bias = _mm256_set1_epi8((char)0x80);
+
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < m; i++) {
+    const int p0 = A.rowptr[(size_t)i];
+    const int p1 = A.rowptr[(size_t)i + 1];
+    int32_t* crow = &C[(size_t)i * n];
+
+    int32_t s = 0;
+    for (int p = p0; p < p1; p++) s += values[(size_t)p];
+    const __m256i c0 = _mm256_set1_epi32(-128 * s);
+
+    for (int j0 = 0; j0 < n; j0 += jblock) {
+      int j1 = std::min(n, j0 + jblock);
+      int j_vec_end = j0 + ((j1 - j0) / 8) * 8;
+
+      for (int j = j0; j < j_vec_end; j += 8) _mm256_storeu_si256((__m256i*)(crow + j), c0);
+
+      // Four nonzeros at a time: interleave their B-row bytes so each int32
+      // lane holds (b0, b1, b2, b3) for one output column.
+      for (int p = p0; p < p1; p += 4) {
+        const int cnt = std::min(4, p1 - p);
+        const int8_t* r[4];
+        int8_t a[4] = {0, 0, 0, 0};
+        for (int q = 0; q < 4; q++) {
+          r[q] = &B[(size_t)A.colidx[(size_t)p + std::min(q, cnt - 1)] * n];
+          if (q < cnt) a[q] = values[(size_t)p + q];
+        }
+        const __m256i a4 = _mm256_set1_epi32(pack4(a[0], a[1], a[2], a[3]));
+
+        for (int j = j0; j < j_vec_end; j += 8) {
+          __m128i x0 = _mm_loadl_epi64((const __m128i*)(r[0] + j));
+          __m128i x1 = _mm_loadl_epi64((const __m128i*)(r[1] + j));
+          __m128i x2 = _mm_loadl_epi64((const __m128i*)(r[2] + j));
+          __m128i x3 = _mm_loadl_epi64((const __m128i*)(r[3] + j));
+          __m128i p01 = _mm_unpacklo_epi8(x0, x1);
+          __m128i p23 = _mm_unpacklo_epi8(x2, x3);
+          __m256i u = _mm256_set_m128i(_mm_unpackhi_epi16(p01, p23), _mm_unpacklo_epi16(p01, p23));
+          u = _mm256_xor_si256(u, bias);
+          __m256i acc = _mm256_loadu_si256((const __m256i*)(crow + j));
+          _mm256_storeu_si256((__m256i*)(crow + j), dpbusd(acc, u, a4));
+        }
+      }
+
+      for (int j = j_vec_end; j < j1; j++) {
+        int32_t sum = 0;
+        for (int p = p0; p < p1; p++) {
+          sum += (int32_t)values[(size_t)p] * (int32_t)B[(size_t)A.colidx[(size_t)p] * n + j];
+        }
+        crow[j] = sum;
+      }
+    }
+  }
+}
+#endif // __AVX2__
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "a2_kernels.h"
+#include "a2_ooc.h"
+#include "a2_threads.h"
+#include "a2_utils.h"
+
+const char* ooc_io_name(OocIo m) {
+  return m == OocIo::Mmap ? "mmap" : "pread";
+}
+
+bool parse_ooc_io(const std::string& s, OocIo& out) {
+  if (s == "pread") { out = OocIo::Pread; return true; }
+  if (s == "mmap")  { out = OocIo::Mmap;  return true; }
+  return false;
+}
+
+double ooc_overlap_pct(const OocStats& s) {
+  if (s.io_seconds <= 0.0) return 100.0;
+  return 100.0 * std::max(0.0, 1.0 - s.wait_seconds / s.io_seconds);
+}
+
+namespace {
+
+// Double-buffer slot per step for one operand: a slot that still holds the
+// step's tile is reused without a read, else the tile goes into the slot the
+// previous step did not compute from (that one may still be in use).
+void plan_slots(const std::vector<int64_t>& tag, std::vector<int>& slot, std::vector<char>& load) {
+  slot.assign(tag.size(), 0);
+  load.assign(tag.size(), 0);
+  int64_t held[2] = {-1, -1};
+  for (size_t s = 0; s < tag.size(); s++) {
+    int x = held[0] == tag[s] ? 0 : held[1] == tag[s] ? 1 : -1;
+    if (x < 0) {
+      x = s == 0 ? 0 : 1 - slot[s - 1];
+      held[x] = tag[s];
+      load[s] = 1;
+    }
+    slot[s] = x;
+  }
+}
+
+// One I/O thread for the whole pipeline, running one job at a time. It moves
+// itself off the team's CPUs first: a thread started from the pinned main
+// thread would otherwise share OpenMP thread 0's core with the compute.
+class IoThread {
+ public:
+  IoThread() : th_([this] { loop(); }) {}
+  ~IoThread() {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      quit_ = true;
+    }
+    cv_.notify_all();
+    th_.join();
+  }
+  void submit(std::function<double()> job) {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      job_ = std::move(job);
+      busy_ = true;
+    }
+    cv_.notify_all();
+  }
+  double wait() {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [this] { return !busy_; });
+    return result_;
+  }
+
+ private:
+  void loop() {
+    pin_helper_thread();
+    std::unique_lock<std::mutex> lk(mu_);
+    for (;;) {
+      cv_.wait(lk, [this] { return quit_ || (busy_ && job_); });
+      if (quit_) return;
+      std::function<double()> job = std::move(job_);
+      job_ = nullptr;
+      lk.unlock();
+      const double r = job();
+      lk.lock();
+      result_ = r;
+      busy_ = false;
+      cv_.notify_all();
+    }
+  }
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::function<double()> job_;
+  bool busy_ = false, quit_ = false;
+  double result_ = 0.0;
+  std::thread th_;  // last: starts once the state above is constructed
+};
+
+// Runs steps 0..steps-1. The I/O job submitted at the top of step s writes
+// back the C tile step s - 1 finished (if any) and reads step s + 1's
+// operands while step s computes; it is joined at the top of step s + 1.
+// The last write-back is synchronous. Returns false if any I/O failed.
+bool pipeline(int steps, const std::function<bool(int)>& read, const std::function<void(int)>& compute,
+              const std::function<bool(int)>& write_back, OocStats& st) {
+  auto io = [&](int next, int done) -> double {
+    const double t0 = now_seconds();
+    const bool ok = (done < 0 || write_back(done)) && (next >= steps || read(next));
+    return ok ? now_seconds() - t0 : -1.0;
+  };
+  bool ok = true;
+  IoThread worker;
+  bool pending = false;
+  auto join = [&]() {
+    const double w0 = now_seconds();
+    const double t = worker.wait();
+    pending = false;
+    st.wait_seconds += now_seconds() - w0;
+    if (t < 0.0) ok = false;
+    else         st.io_seconds += t;
+  };
+
+  worker.submit([&io] { return io(0, -1); });
+  pending = true;
+  for (int s = 0; s < steps; s++) {
+    join();
+    if (!ok) break;
+    worker.submit([&io, s] { return io(s + 1, s - 1); });
+    pending = true;
+    const double c0 = now_seconds();
+    compute(s);
+    st.compute_seconds += now_seconds() - c0;
+  }
+  if (pending) join();
+  if (ok && steps > 0) {
+    const double t0 = now_seconds();
+    ok = write_back(steps - 1);
+    st.io_seconds += now_seconds() - t0;
+    st.wait_seconds += now_seconds() - t0;
+  }
+  return ok;
+}
+
+// Tile side for a dimension: x rounded down to a multiple of 64 (at least
+// 64), or the whole dimension when that is smaller.
+int64_t fit_side(double x, int64_t dim) {
+  if (x >= (double)dim) return dim;
+  return std::min(dim, std::max<int64_t>(64, (int64_t)x / 64 * 64));
+}
+
+}  // namespace
+
+bool plan_gemm_ooc(int64_t m, int64_t k, int64_t n, size_t budget_bytes, OocPlan& p, std::string& err) {
+  p = OocPlan();
+  if (m > INT_MAX || k > INT_MAX || n > INT_MAX) {
+    err = "dimension exceeds int";
+    return false;
+  }
+  // Six resident tiles: 2 (mb kb + kb nb + mb nb) floats <= F. kb starts at
+  // the square side; if it is clamped by k, mb and nb take the slack.
+  const double F = (double)budget_bytes / sizeof(float) / 2.0;
+  p.kb = std::max<int64_t>(1, fit_side(std::sqrt(F / 3.0), k));
+  p.mb = std::max<int64_t>(1, fit_side(std::sqrt((double)p.kb * p.kb + F) - (double)p.kb, m));
+  p.nb = std::max<int64_t>(1, fit_side((F - (double)(p.mb * p.kb)) / (double)(p.kb + p.mb), n));
+  p.steps = ((m + p.mb - 1) / p.mb) * ((n + p.nb - 1) / p.nb) * std::max<int64_t>(1, (k + p.kb - 1) / p.kb);
+  if (p.steps > INT_MAX) {
+    err = "too many tiles for the budget";
+    return false;
+  }
+  return true;
+}
+
+bool plan_spmm_ooc(int64_t m, int64_t k, int64_t n, size_t budget_bytes, OocPlan& p, std::string& err) {
+  p = OocPlan();
+  if (m > INT_MAX || k > INT_MAX || n > INT_MAX) {
+    err = "dimension exceeds int";
+    return false;
+  }
+  const double F = (double)budget_bytes / sizeof(float) / 2.0;  // floats per buffer pair
+  if (2.0 * (double)std::max<int64_t>(n, 1) > F) {
+    err = "budget too small for one row of B and one of C";
+    return false;
+  }
+  const double row = (double)std::max<int64_t>(n, 1);
+  p.mb = std::max<int64_t>(1, std::min<int64_t>(m, (int64_t)(F / 2.0 / row)));
+  p.kb = std::max<int64_t>(1, std::min<int64_t>(k, (int64_t)((F - (double)p.mb * row) / row)));
+  p.nb = n;
+  p.steps = ((m + p.mb - 1) / p.mb) * std::max<int64_t>(1, (k + p.kb - 1) / p.kb);
+  if (p.steps > INT_MAX) {
+    err = "too many panels for the budget";
+    return false;
+  }
+  return true;
+}
+
+bool gemm_ooc(const DenseFile& A, const DenseFile& B, const DenseFile& C, size_t budget_bytes,
+              bool simd, int tileM, int tileK, int tileN, OocStats& st, std::string& err) {
+  st = OocStats();
+  const int64_t m = A.rows, k = A.cols, n = B.cols;
+  if (B.rows != k || C.rows != m || C.cols != n) {
+    err = "operand shapes do not match";
+    return false;
+  }
+  OocPlan plan;
+  if (!plan_gemm_ooc(m, k, n, budget_bytes, plan, err)) return false;
+  if (m == 0 || n == 0) return true;
+  const int64_t mb = plan.mb, kb = plan.kb, nb = plan.nb;
+  const int64_t NT = (n + nb - 1) / nb;
+  const int64_t KT = std::max<int64_t>(1, (k + kb - 1) / kb);
+  const int steps = (int)plan.steps;
+
+  // Step s = ((ib * NT) + jb) * KT + tb; A tile (ib, tb), B tile (tb, jb).
+  std::vector<int64_t> a_tag((size_t)steps), b_tag((size_t)steps);
+  for (int s = 0; s < steps; s++) {
+    const int64_t tb = s % KT, jb = (s / KT) % NT, ib = s / (KT * NT);
+    a_tag[(size_t)s] = ib * KT + tb;
+    b_tag[(size_t)s] = tb * NT + jb;
+  }
+  std::vector<int> a_slot, b_slot;
+  std::vector<char> a_load, b_load;
+  plan_slots(a_tag, a_slot, a_load);
+  plan_slots(b_tag, b_slot, b_load);
+
+  AlignedBuffer abuf[2], bbuf[2], cbuf[2];
+  for (int x = 0; x < 2; x++) {
+    abuf[x] = make_aligned_f32((size_t)(mb * std::max<int64_t>(kb, 1)), 64);
+    bbuf[x] = make_aligned_f32((size_t)(std::max<int64_t>(kb, 1) * nb), 64);
+    cbuf[x] = make_aligned_f32((size_t)(mb * nb), 64);
+    first_touch(abuf[x].ptr, abuf[x].count * sizeof(float));
+    first_touch(bbuf[x].ptr, bbuf[x].count * sizeof(float));
+    first_touch(cbuf[x].ptr, cbuf[x].count * sizeof(float));
+  }
+
+  struct Tile { int64_t i0, j0, t0, mi, ni, ki; };
+  auto tile = [&](int s) {
+    const int64_t tb = s % KT, jb = (s / KT) % NT, ib = s / (KT * NT);
+    Tile t;
+    t.i0 = ib * mb; t.j0 = jb * nb; t.t0 = tb * kb;
+    t.mi = std::min(mb, m - t.i0);
+    t.ni = std::min(nb, n - t.j0);
+    t.ki = std::min(kb, k - t.t0);
+    return t;
+  };
+
+  auto read = [&](int s) {
+    const Tile t = tile(s);
+    bool ok = true;
+    if (a_load[(size_t)s]) {
+      ok = read_dense_block(A, t.i0, t.mi, t.t0, t.ki, abuf[a_slot[(size_t)s]].ptr);
+      st.bytes += 4.0 * (double)(t.mi * t.ki);
+    }
+    if (ok && b_load[(size_t)s]) {
+      ok = read_dense_block(B, t.t0, t.ki, t.j0, t.ni, bbuf[b_slot[(size_t)s]].ptr);
+      st.bytes += 4.0 * (double)(t.ki * t.ni);
+    }
+    return ok;
+  };
+  // C tile (ib, jb) accumulates in cbuf[(s / KT) & 1] over its KT steps.
+  auto compute = [&](int s) {
+    const Tile t = tile(s);
+    Epilogue e;
+    e.beta = t.t0 == 0 ? 0.0f : 1.0f;
+    const float* a = abuf[a_slot[(size_t)s]].ptr;
+    const float* b = bbuf[b_slot[(size_t)s]].ptr;
+    float* c = cbuf[(s / KT) & 1].ptr;
+#if defined(__AVX2__)
+    if (simd) {
+      gemm_tiled_avx2(a, b, c, (int)t.mi, (int)t.ki, (int)t.ni, tileM, tileK, tileN, e);
+      return;
+    }
+#endif
+    (void)simd;
+    gemm_tiled_scalar(a, b, c, (int)t.mi, (int)t.ki, (int)t.ni, tileM, tileK, tileN, e);
+  };
+  auto write_back = [&](int s) {
+    if (s % KT != KT - 1) return true;
+    const Tile t = tile(s);
+    st.bytes += 4.0 * (double)(t.mi * t.ni);
+    return write_dense_block(C, t.i0, t.mi, t.j0, t.ni, cbuf[(s / KT) & 1].ptr);
+  };
+
+  const bool ok = pipeline(steps, read, compute, write_back, st);
+  for (int x = 0; x < 2; x++) { free_aligned(abuf[x]); free_aligned(bbuf[x]); free_aligned(cbuf[x]); }
+  if (!ok) err = "file read/write failed";
+  return ok;
+}
+
+bool spmm_ooc(const CSR& A, const DenseFile& B, const DenseFile& C, size_t budget_bytes, bool simd,
+              int jblock, OocStats& st, std::string& err) {
+  st = OocStats();
+  const int64_t m = A.m, k = A.k, n = B.cols;
+  if (B.rows != k || C.rows != m || C.cols != n) {
+    err = "operand shapes do not match";
+    return false;
+  }
+  OocPlan plan;
+  if (!plan_spmm_ooc(m, k, n, budget_bytes, plan, err)) return false;
+  if (m == 0 || n == 0) return true;
+  const int64_t mb = plan.mb, kb = plan.kb;
+  const int64_t KT = std::max<int64_t>(1, (k + kb - 1) / kb);
+  const int steps = (int)plan.steps;
+
+  std::vector<int64_t> b_tag((size_t)steps);
+  for (int s = 0; s < steps; s++) b_tag[(size_t)s] = s % KT;
+  std::vector<int> b_slot;
+  std::vector<char> b_load;
+  plan_slots(b_tag, b_slot, b_load);
+
+  AlignedBuffer bbuf[2], cbuf[2];
+  for (int x = 0; x < 2; x++) {
+    bbuf[x] = make_aligned_f32((size_t)(kb * n), 64);
+    cbuf[x] = make_aligned_f32((size_t)(mb * n), 64);
+    first_touch(bbuf[x].ptr, bbuf[x].count * sizeof(float));
+    first_touch(cbuf[x].ptr, cbuf[x].count * sizeof(float));
+  }
+  std::vector<int> cursor((size_t)m);
+
+  auto read = [&](int s) {
+    if (!b_load[(size_t)s]) return true;
+    const int64_t t0 = (s % KT) * kb;
+    const int64_t ki = std::min(kb, k - t0);
+    st.bytes += 4.0 * (double)(ki * n);
+    return read_dense_block(B, t0, ki, 0, n, bbuf[b_slot[(size_t)s]].ptr);
+  };
+  auto compute = [&](int s) {
+    const int64_t i0 = (s / KT) * mb;
+    const int64_t t0 = (s % KT) * kb;
+    const int i1 = (int)std::min(m, i0 + mb);
+    const int c1 = (int)std::min(k, t0 + kb);
+    const float* b = bbuf[b_slot[(size_t)s]].ptr;
+    float* c = cbuf[(s / KT) & 1].ptr;
+#if defined(__AVX2__)
+    if (simd) {
+      spmm_csr_rows_panel_avx2(A, (int)i0, i1, (int)t0, c1, b, c, (int)n, jblock, cursor.data());
+      return;
+    }
+#endif
+    (void)simd;
+    spmm_csr_rows_panel_scalar(A, (int)i0, i1, (int)t0, c1, b, c, (int)n, jblock, cursor.data());
+  };
+  auto write_back = [&](int s) {
+    if (s % KT != KT - 1) return true;
+    const int64_t i0 = (s / KT) * mb;
+    const int64_t mi = std::min(mb, m - i0);
+    st.bytes += 4.0 * (double)(mi * n);
+    return write_dense_block(C, i0, mi, 0, n, cbuf[(s / KT) & 1].ptr);
+  };
+
+  const bool ok = pipeline(steps, read, compute, write_back, st);
+  for (int x = 0; x < 2; x++) { free_aligned(bbuf[x]); free_aligned(cbuf[x]); }
+  if (!ok) err = "file read/write failed";
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Spot checks
+// ---------------------------------------------------------------------------
+
+namespace {
+
+const double kU = std::ldexp(1.0, -24);  // fp32 unit roundoff
+
+double gamma_n(int64_t n) {
+  const double nu = (double)n * kU;
+  return nu < 1.0 ? nu / (1.0 - nu) : 1.0;
+}
+
+// 8 distinct-ish indices in [0, dim) from an LCG.
+std::vector<int64_t> sample_indices(int64_t dim, uint64_t& x) {
+  std::vector<int64_t> v;
+  for (int i = 0; i < 8; i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    v.push_back((int64_t)((x >> 33) % (uint64_t)dim));
+  }
+  return v;
+}
+
+double ratio(float c, double ref, double mag, int64_t k) {
+  const double tol = 2.0 * gamma_n(k + 4) * mag + 1e-30;
+  return std::fabs((double)c - ref) / tol;
+}
+
+}  // namespace
+
+double gemm_ooc_check(const DenseFile& A, const DenseFile& B, const DenseFile& C, uint64_t seed) {
+  const int64_t m = A.rows, k = A.cols, n = B.cols;
+  if (m == 0 || n == 0) return 0.0;
+  uint64_t x = seed;
+  const std::vector<int64_t> rows = sample_indices(m, x), cols = sample_indices(n, x);
+  std::vector<float> a((size_t)k), b((size_t)k);
+  double worst = 0.0;
+  for (int64_t j : cols) {
+    if (!read_dense_block(B, 0, k, j, 1, b.data())) return -1.0;
+    for (int64_t i : rows) {
+      float c = 0.0f;
+      if (!read_dense_block(A, i, 1, 0, k, a.data()) || !read_dense_block(C, i, 1, j, 1, &c)) return -1.0;
+      double ref = 0.0, mag = 0.0;
+      for (int64_t p = 0; p < k; p++) {
+        ref += (double)a[(size_t)p] * b[(size_t)p];
+        mag += std::fabs((double)a[(size_t)p] * b[(size_t)p]);
+      }
+      worst = std::max(worst, ratio(c, ref, mag, k));
+    }
+  }
+  return worst;
+}
+
+double spmm_ooc_check(const CSR& A, const DenseFile& B, const DenseFile& C, uint64_t seed) {
+  const int64_t m = A.m, n = B.cols;
+  if (m == 0 || n == 0) return 0.0;
+  uint64_t x = seed;
+  const std::vector<int64_t> rows = sample_indices(m, x), cols = sample_indices(n, x);
+  double worst = 0.0;
+  for (int64_t i : rows) {
+    const int p0 = A.rowptr[(size_t)i], p1 = A.rowptr[(size_t)i + 1];
+    for (int64_t j : cols) {
+      float c = 0.0f;
+      if (!read_dense_block(C, i, 1, j, 1, &c)) return -1.0;
+      double ref = 0.0, mag = 0.0;
+      for (int p = p0; p < p1; p++) {
+        float b = 0.0f;
+        if (!read_dense_block(B, A.colidx[(size_t)p], 1, j, 1, &b)) return -1.0;
+        ref += (double)A.values[(size_t)p] * b;
+        mag += std::fabs((double)A.values[(size_t)p] * b);
+      }
+      worst = std::max(worst, ratio(c, ref, mag, p1 - p0));
+    }
+  }
+  return worst;
+}
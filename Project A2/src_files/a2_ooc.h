@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "a2_io.h"
+
+// Out-of-core GEMM / SpMM for operands larger than memory. Dense operands
+// and the result live in DenseFiles (a binary CSR is file-backed through its
+// mapping already); only a budget's worth of tiles is resident. Tiles are
+// double-buffered: while the OpenMP team computes step s, one I/O task
+// writes back the last finished C tile and reads step s + 1's operands (by
+// pread, or by copying out of the file mapping), so compute only stalls when
+// I/O is the slower side.
+enum class OocIo { Pread, Mmap };
+const char* ooc_io_name(OocIo m);
+bool parse_ooc_io(const std::string& s, OocIo& out);
+
+struct OocStats {
+  double io_seconds = 0.0;       // I/O thread busy time (reads + write-back)
+  double wait_seconds = 0.0;     // compute blocked on I/O: the exposed part
+  double compute_seconds = 0.0;
+  double bytes = 0.0;            // file bytes read + written
+};
+
+// Percentage of I/O time hidden behind compute (100 when there was none).
+double ooc_overlap_pct(const OocStats& s);
+
+// Tiling of one product under a budget; gemm_ooc / spmm_ooc use the same
+// plan, so callers can check it before creating any files. False (with err)
+// when the shape does not fit int indexing or, for spmm, the budget cannot
+// hold one row of B and of C.
+struct OocPlan {
+  int64_t mb = 0, kb = 0, nb = 0;  // spmm: C row panel mb x n, B panel kb x n
+  int64_t steps = 0;
+};
+bool plan_gemm_ooc(int64_t m, int64_t k, int64_t n, size_t budget_bytes, OocPlan& p, std::string& err);
+bool plan_spmm_ooc(int64_t m, int64_t k, int64_t n, size_t budget_bytes, OocPlan& p, std::string& err);
+
+// C = A * B (m x k times k x n files, C opened writable). Tiles mb x kb x nb,
+// as large as fits 2 A + 2 B + 2 C tiles in budget_bytes (sides multiples of
+// 64, at least 64 or the whole dimension), loop order i, j, k; a tile still
+// in its buffer from the previous step is not read again. Each step is one
+// in-memory gemm_tiled call (tileM/K/N), accumulating into C for k > 0.
+bool gemm_ooc(const DenseFile& A, const DenseFile& B, const DenseFile& C, size_t budget_bytes,
+              bool simd, int tileM, int tileK, int tileN, OocStats& st, std::string& err);
+
+// C = A * B for CSR A (column-sorted rows) and a k x n file B. C is built in
+// row panels of mb rows; for each, B streams through in panels of kb full
+// rows (one contiguous read each) and every row of A advances a cursor over
+// its columns in the panel. The two C panels take up to half the budget, the
+// two B panels the rest; a finished C panel is written back during the next.
+// Each step runs spmm_csr_rows_panel (jblock columns at a time).
+bool spmm_ooc(const CSR& A, const DenseFile& B, const DenseFile& C, size_t budget_bytes, bool simd,
+              int jblock, OocStats& st, std::string& err);
+
+// Spot check of a finished product: an 8 x 8 grid of C entries (rows and
+// columns drawn from seed) against double dot products read back from the
+// operand files. Returns the worst |C - ref| / (2 gamma_k sum |a b|); above
+// 1 is a wrong result, negative means a read failed.
+double gemm_ooc_check(const DenseFile& A, const DenseFile& B, const DenseFile& C, uint64_t seed);
+double spmm_ooc_check(const CSR& A, const DenseFile& B, const DenseFile& C, uint64_t seed);
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <omp.h>
+
+#include "a2_threads.h"
+#include "a2_utils.h"
+
+static int read_first_int(const std::string& path, int def) {
+  FILE* f = std::fopen(path.c_str(), "r");
+  if (!f) return def;
+  int v = def;
+  if (std::fscanf(f, "%d", &v) != 1) v = def;
+  std::fclose(f);
+  return v;
+}
+
+// sysfs lists a cpu's node as a "nodeN" entry in its directory.
+static int cpu_node(int cpu) {
+  std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR* d = opendir(dir.c_str());
+  if (!d) return 0;
+  int node = 0;
+  while (dirent* e = readdir(d)) {
+    int v = 0;
+    if (std::sscanf(e->d_name, "node%d", &v) == 1) { node = v; break; }
+  }
+  closedir(d);
+  return node;
+}
+
+// cache/indexN/{level,type,size}; size is like "48K" or "105M".
+static void read_cache_sizes(int cpu, CpuTopology& t) {
+  for (int idx = 0; idx < 8; idx++) {
+    std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/index" + std::to_string(idx) + "/";
+    int level = read_first_int(dir + "level", -1);
+    if (level < 0) break;
+    char type[32] = {}, size[32] = {};
+    FILE* f = std::fopen((dir + "type").c_str(), "r");
+    if (!f) continue;
+    bool ok = std::fscanf(f, "%31s", type) == 1;
+    std::fclose(f);
+    f = std::fopen((dir + "size").c_str(), "r");
+    if (!f) continue;
+    ok = ok && std::fscanf(f, "%31s", size) == 1;
+    std::fclose(f);
+    if (!ok || std::strcmp(type, "Instruction") == 0) continue;
+
+    size_t bytes = (size_t)std::strtoull(size, nullptr, 10);
+    const char unit = size[std::strlen(size) - 1];
+    if (unit == 'K') bytes <<= 10;
+    else if (unit == 'M') bytes <<= 20;
+    else if (unit == 'G') bytes <<= 30;
+    if (level == 1) t.l1d_bytes = bytes;
+    else if (level == 2) t.l2_bytes = bytes;
+    else if (level == 3) t.l3_bytes = bytes;
+  }
+}
+
+// sched_getaffinity(0) is the calling thread's mask, and start_thread_team
+// pins the main thread to one CPU, so the process mask is taken once, before
+// the first pin, and every later topology and unbind works from that copy.
+static const cpu_set_t& process_affinity() {
+  static const cpu_set_t mask = [] {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+      CPU_ZERO(&set);
+      for (int c = 0; c < CPU_SETSIZE; c++) CPU_SET(c, &set);
+    }
+    return set;
+  }();
+  return mask;
+}
+
+CpuTopology read_cpu_topology() {
+  const cpu_set_t& set = process_affinity();
+  std::vector<int> allowed;
+  for (int c = 0; c < CPU_SETSIZE; c++) {
+    if (CPU_ISSET(c, &set)) allowed.push_back(c);
+  }
+  if (allowed.empty()) allowed.push_back(0);
+
+  struct Entry { int node, smt, cpu; };
+  std::vector<Entry> e;
+  for (int c : allowed) {
+    std::string topo = "/sys/devices/system/cpu/cpu" + std::to_string(c) + "/topology/";
+    int first_sibling = read_first_int(topo + "thread_siblings_list", c);
+    e.push_back({cpu_node(c), first_sibling == c ? 0 : 1, c});
+  }
+  std::sort(e.begin(), e.end(), [](const Entry& a, const Entry& b) {
+    if (a.node != b.node) return a.node < b.node;
+    if (a.smt != b.smt) return a.smt < b.smt;
+    return a.cpu < b.cpu;
+  });
+
+  CpuTopology t;
+  int max_node = 0;
+  for (const Entry& x : e) {
+    t.cpus.push_back(x.cpu);
+    t.node.push_back(x.node);
+    max_node = std::max(max_node, x.node);
+  }
+  t.nodes = max_node + 1;
+  read_cache_sizes(t.cpus[0], t);
+  return t;
+}
+
+const char* thread_bind_name(ThreadBind b) {
+  switch (b) {
+    case ThreadBind::None:   return "none";
+    case ThreadBind::Close:  return "close";
+    case ThreadBind::Spread: return "spread";
+  }
+  return "?";
+}
+
+bool parse_thread_bind(const std::string& s, ThreadBind& out) {
+  if (s == "none")   { out = ThreadBind::None;   return true; }
+  if (s == "close")  { out = ThreadBind::Close;  return true; }
+  if (s == "spread") { out = ThreadBind::Spread; return true; }
+  return false;
+}
+
+// CPU order for the team: Close keeps the topology order, Spread deals the
+// per-node lists out round-robin.
+static std::vector<int> team_cpus(const CpuTopology& topo, ThreadBind bind, int node) {
+  std::vector<std::vector<int>> per_node((size_t)topo.nodes);
+  for (size_t i = 0; i < topo.cpus.size(); i++) {
+    if (node >= 0 && topo.node[i] != node) continue;
+    per_node[(size_t)topo.node[i]].push_back(topo.cpus[i]);
+  }
+  std::vector<int> order;
+  if (bind == ThreadBind::Spread) {
+    for (size_t r = 0;; r++) {
+      bool any = false;
+      for (const auto& l : per_node) {
+        if (r < l.size()) { order.push_back(l[r]); any = true; }
+      }
+      if (!any) break;
+    }
+  } else {
+    for (const auto& l : per_node) order.insert(order.end(), l.begin(), l.end());
+  }
+  return order;
+}
+
+// CPUs pinned by the most recent start_thread_team (empty when unbound).
+static cpu_set_t g_team_cpus;
+
+ThreadTeam start_thread_team(int threads, ThreadBind bind, int node) {
+  ThreadTeam team;
+  team.threads = std::max(1, threads);
+  team.bind = bind;
+  team.node = node;
+  team.cpu.assign((size_t)team.threads, -1);
+  omp_set_num_threads(team.threads);
+
+  const cpu_set_t& all = process_affinity();
+  std::vector<int> order;
+  if (bind != ThreadBind::None || node >= 0) {
+    order = team_cpus(read_cpu_topology(), bind == ThreadBind::None ? ThreadBind::Close : bind, node);
+  }
+
+  // Creates the workers now (not inside the first timed call) and pins them.
+  // More threads than CPUs wrap around the list. An unbound team gets the
+  // process mask back, undoing the pins of an earlier team (new workers
+  // inherit the main thread's mask, so they need it too).
+#pragma omp parallel num_threads(team.threads)
+  {
+    const int t = omp_get_thread_num();
+    if (order.empty()) {
+      sched_setaffinity(0, sizeof(all), &all);
+    } else {
+      const int c = order[(size_t)t % order.size()];
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(c, &set);
+      if (sched_setaffinity(0, sizeof(set), &set) == 0) team.cpu[(size_t)t] = c;
+    }
+  }
+  CPU_ZERO(&g_team_cpus);
+  for (int c : team.cpu) {
+    if (c >= 0) CPU_SET(c, &g_team_cpus);
+  }
+
+  team.dispatch_us = measure_dispatch_us(200);
+  return team;
+}
+
+void pin_helper_thread() {
+  const cpu_set_t& all = process_affinity();
+  cpu_set_t free_set;
+  CPU_ZERO(&free_set);
+  for (int c = 0; c < CPU_SETSIZE; c++) {
+    if (CPU_ISSET(c, &all) && !CPU_ISSET(c, &g_team_cpus)) CPU_SET(c, &free_set);
+  }
+  sched_setaffinity(0, sizeof(cpu_set_t), CPU_COUNT(&free_set) > 0 ? &free_set : &all);
+}
+
+double measure_dispatch_us(int iters) {
+  std::vector<double> s;
+  s.reserve((size_t)std::max(1, iters));
+  // The reduction keeps the compiler from dropping the otherwise empty region.
+  volatile int sink = 0;
+  for (int it = 0; it < std::max(1, iters); it++) {
+    int seen = 0;
+    double t0 = now_seconds();
+#pragma omp parallel reduction(+:seen)
+    {
+      seen += 1;
+    }
+    s.push_back(now_seconds() - t0);
+    sink = sink + seen;
+  }
+  std::nth_element(s.begin(), s.begin() + s.size() / 2, s.end());
+  return s[s.size() / 2] * 1e6;
+}
+
+void first_touch(void* p, size_t bytes) {
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  char* c = (char*)p;
+  const long pages = (long)((bytes + page - 1) / page);
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < pages; i++) {
+    c[(size_t)i * page] = 0;
+  }
+}
+
+// get_mempolicy through the raw syscall, so the build needs no libnuma.
+int page_node(const void* p) {
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, nullptr, 0UL, const_cast<void*>(p), (unsigned long)(MPOL_F_NODE | MPOL_F_ADDR)) != 0) {
+    return -1;
+  }
+  return node;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// CPUs this process may run on (taskset / cgroup cpuset respected; the mask
+// is read once, before any thread is pinned, so later calls agree), in
+// "close" order: node by node, one hardware thread per physical core first,
+// SMT siblings after.
+// Cache sizes are those of the first CPU (L1d/L2 per core, L3 shared);
+// 0 when sysfs does not report them.
+struct CpuTopology {
+  std::vector<int> cpus;
+  std::vector<int> node;  // NUMA node of cpus[i]
+  int nodes = 1;
+  size_t l1d_bytes = 0;
+  size_t l2_bytes = 0;
+  size_t l3_bytes = 0;
+};
+
+CpuTopology read_cpu_topology();
+
+enum class ThreadBind { None, Close, Spread };
+
+const char* thread_bind_name(ThreadBind b);
+bool parse_thread_bind(const std::string& s, ThreadBind& out);
+
+// The OpenMP team is the worker pool: libgomp keeps its threads parked
+// between parallel regions, so a kernel call costs a wake-up plus the join
+// barrier, not thread creation. start_thread_team sizes the team, creates
+// the threads up front and pins each one to a CPU (Close: fill a node before
+// the next; Spread: round-robin across nodes). node >= 0 restricts the team
+// to that NUMA node's CPUs; None without a node unpins the team back to the
+// process mask. Later regions of the same size reuse the same pinned threads.
+struct ThreadTeam {
+  int threads = 1;
+  ThreadBind bind = ThreadBind::None;
+  int node = -1;
+  std::vector<int> cpu;      // CPU of OpenMP thread t, -1 if unpinned
+  double dispatch_us = 0.0;  // median empty-region round trip (wake + barrier)
+};
+
+ThreadTeam start_thread_team(int threads, ThreadBind bind, int node = -1);
+
+// For a helper thread created outside the team (e.g. an I/O thread): new
+// threads inherit the creator's one-CPU pin, so this moves the calling thread
+// onto the process CPUs the current team has not pinned, or the whole process
+// mask when the team occupies all of them.
+void pin_helper_thread();
+
+// Median wall time of an empty parallel region on the current team.
+double measure_dispatch_us(int iters);
+
+// Touch every page of [p, p + bytes) from the team with a static page split,
+// so each page is placed on the node of the thread whose static share of the
+// kernel's rows it holds. Call before the first serial write to the buffer.
+void first_touch(void* p, size_t bytes);
+
+// NUMA node of the (already touched) page holding p, or -1 when the kernel
+// cannot tell (no NUMA support). Used to confirm that first_touch placement
+// landed where it was meant to.
+int page_node(const void* p);
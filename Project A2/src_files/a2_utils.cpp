@@ -6,6 +6,16 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <random>
+
+#include <sys/resource.h>
+
+#include <linux/perf_event.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <omp.h>
 
 #include "a2_utils.h"
 
@@ -31,6 +41,62 @@ void percentile_us(const std::vector<double>& samples_sec, double& p50, double&
   p99 = pick(0.99);
 }
 
+void rusage_snapshot(long& vol_csw, long& invol_csw, long& page_faults) {
+  rusage u;
+  std::memset(&u, 0, sizeof(u));
+  getrusage(RUSAGE_SELF, &u);
+  vol_csw = u.ru_nvcsw;
+  invol_csw = u.ru_nivcsw;
+  page_faults = u.ru_minflt + u.ru_majflt;
+}
+
+static double median_of(std::vector<double>& v) {
+  const size_t h = v.size() / 2;
+  std::nth_element(v.begin(), v.begin() + h, v.end());
+  return v[h];
+}
+
+void bootstrap_median_ci(const std::vector<double>& x, int resamples, unsigned long long seed,
+                         double& lo, double& hi) {
+  lo = hi = 0.0;
+  if (x.empty()) return;
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<size_t> pick(0, x.size() - 1);
+  std::vector<double> meds((size_t)std::max(1, resamples));
+  std::vector<double> r(x.size());
+  for (double& md : meds) {
+    for (double& v : r) v = x[pick(rng)];
+    md = median_of(r);
+  }
+  std::sort(meds.begin(), meds.end());
+  lo = meds[(size_t)(0.025 * (double)(meds.size() - 1))];
+  hi = meds[(size_t)(0.975 * (double)(meds.size() - 1))];
+}
+
+bool reps_converged(const RepPolicy& p, const std::vector<RepSample>& s) {
+  if (s.size() < 3) return false;
+  std::vector<double> x;
+  x.reserve(s.size());
+  for (const RepSample& r : s) x.push_back(r.seconds);
+  double lo, hi;
+  bootstrap_median_ci(x, p.resamples, p.seed, lo, hi);
+  const double med = median_of(x);
+  return med > 0.0 && 0.5 * (hi - lo) <= 0.01 * p.ci_pct * med;
+}
+
+double outlier_fence(const std::vector<double>& x, std::vector<int>& flags) {
+  flags.assign(x.size(), 0);
+  if (x.size() < 4) return 0.0;
+  std::vector<double> v = x;
+  std::sort(v.begin(), v.end());
+  const double q1 = v[(v.size() - 1) / 4];
+  const double q3 = v[3 * (v.size() - 1) / 4];
+  const double med = v[v.size() / 2];
+  const double fence = q3 + 3.0 * std::max(q3 - q1, 0.01 * med);
+  for (size_t i = 0; i < x.size(); i++) flags[i] = x[i] > fence ? 1 : 0;
+  return fence;
+}
+
 bool file_exists(const std::string& path) {
   FILE* f = std::fopen(path.c_str(), "rb");
   if (!f) return false;
@@ -38,50 +104,152 @@ bool file_exists(const std::string& path) {
   return true;
 }
 
-static bool parse_perf_csv_value(const char* perf_csv_path, const char* event, double& out_val) {
-  // perf stat -x, line format is typically:
-  // value,unit,event, ...
-  FILE* f = std::fopen(perf_csv_path, "r");
-  if (!f) return false;
+// ---------------------------------------------------------------------------
+// perf_event_open counters
+// ---------------------------------------------------------------------------
 
-  char line[4096];
-  bool ok = false;
+namespace {
 
-  while (std::fgets(line, sizeof(line), f)) {
-    if (!std::strstr(line, event)) continue;
+enum PerfField { kCycles, kInstructions, kLlcLoad, kLlcStore, kDtlbLoad, kFpOps,
+                 kTaskClock, kCtxSwitches, kMigrations, kPageFaults };
 
-    // tokenize by commas (C function, global namespace)
-    char* save = nullptr;
-    char* tok = ::strtok_r(line, ",", &save);
-    if (!tok) continue;
+struct PerfEventDef {
+  uint32_t type;
+  uint64_t config;
+  PerfField field;
+  double weight;      // multiplier when summed into the field
+  bool intel_only;
+};
 
-    // skip "<not supported>" / "<not counted>"
-    if (std::strchr(tok, '<')) continue;
+constexpr uint64_t cache_event(uint64_t cache, uint64_t op) {
+  return cache | (op << 8) | ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
 
-    out_val = std::atof(tok);
-    ok = true;
-    break;
+// FP_ARITH_INST_RETIRED (event 0xC7): scalar / 128 / 256 / 512-bit single.
+constexpr uint64_t fp_arith(uint64_t umask) { return 0xC7 | (umask << 8); }
+
+const PerfEventDef kPerfEvents[] = {
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, kCycles, 1.0, false},
+  {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, kInstructions, 1.0, false},
+  {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ), kLlcLoad, 1.0, false},
+  {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_WRITE), kLlcStore, 1.0, false},
+  {PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ), kDtlbLoad, 1.0, false},
+  {PERF_TYPE_RAW, fp_arith(0x02), kFpOps, 1.0, true},
+  {PERF_TYPE_RAW, fp_arith(0x08), kFpOps, 4.0, true},
+  {PERF_TYPE_RAW, fp_arith(0x20), kFpOps, 8.0, true},
+  {PERF_TYPE_RAW, fp_arith(0x80), kFpOps, 16.0, true},
+  {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, kTaskClock, 1e-6, false},  // ns -> ms
+  {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, kCtxSwitches, 1.0, false},
+  {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, kMigrations, 1.0, false},
+  {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, kPageFaults, 1.0, false},
+};
+constexpr int kNumPerfEvents = (int)(sizeof(kPerfEvents) / sizeof(kPerfEvents[0]));
+
+bool cpu_is_intel() {
+  FILE* f = std::fopen("/proc/cpuinfo", "r");
+  if (!f) return false;
+  char line[256];
+  bool intel = false;
+  while (std::fgets(line, sizeof(line), f)) {
+    if (std::strncmp(line, "vendor_id", 9) == 0) { intel = std::strstr(line, "GenuineIntel") != nullptr; break; }
   }
-
   std::fclose(f);
-  return ok;
+  return intel;
+}
+
+// Counts the calling thread only; starts disabled. Hardware events count
+// user mode only; software events stay unfiltered, since context switches,
+// migrations and page faults are all accounted in kernel context.
+int open_thread_event(const PerfEventDef& d) {
+  perf_event_attr a;
+  std::memset(&a, 0, sizeof(a));
+  a.size = sizeof(a);
+  a.type = d.type;
+  a.config = d.config;
+  a.disabled = 1;
+  if (d.type != PERF_TYPE_SOFTWARE) {
+    a.exclude_kernel = 1;
+    a.exclude_hv = 1;
+  }
+  a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
 }
 
-PerfCounters read_perf_csv(const std::string& perf_csv_path) {
-  PerfCounters pc{};
-  pc.valid = false;
+}  // namespace
+
+bool perf_open(PerfSession& s) {
+  s.threads = std::max(1, omp_get_max_threads());
+  s.windows = 0;
+  s.fd.assign((size_t)s.threads * kNumPerfEvents, -1);
+  const bool intel = cpu_is_intel();
+#pragma omp parallel num_threads(s.threads)
+  {
+    const int t = omp_get_thread_num();
+    for (int e = 0; e < kNumPerfEvents; e++) {
+      if (kPerfEvents[e].intel_only && !intel) continue;
+      s.fd[(size_t)t * kNumPerfEvents + e] = open_thread_event(kPerfEvents[e]);
+    }
+  }
+  for (int fd : s.fd) {
+    if (fd >= 0) return true;
+  }
+  return false;
+}
 
-  double v = 0.0;
-  bool any = false;
+// prctl toggles every event the calling thread opened, one syscall per thread.
+void perf_start(PerfSession& s) {
+  if (s.fd.empty()) return;
+#pragma omp parallel num_threads(s.threads)
+  prctl(PR_TASK_PERF_EVENTS_ENABLE, 0, 0, 0, 0);
+}
 
-  if (parse_perf_csv_value(perf_csv_path.c_str(), "cycles", v)) { pc.cycles = v; any = true; }
-  if (parse_perf_csv_value(perf_csv_path.c_str(), "instructions", v)) { pc.instructions = v; any = true; }
-  if (parse_perf_csv_value(perf_csv_path.c_str(), "cache-misses", v)) { pc.cache_misses = v; any = true; }
-  if (parse_perf_csv_value(perf_csv_path.c_str(), "LLC-load-misses", v)) { pc.llc_load_misses = v; any = true; }
-  if (parse_perf_csv_value(perf_csv_path.c_str(), "LLC-store-misses", v)) { pc.llc_store_misses = v; any = true; }
-  if (parse_perf_csv_value(perf_csv_path.c_str(), "dTLB-load-misses", v)) { pc.dtlb_load_misses = v; any = true; }
+void perf_stop(PerfSession& s) {
+  if (s.fd.empty()) return;
+#pragma omp parallel num_threads(s.threads)
+  prctl(PR_TASK_PERF_EVENTS_DISABLE, 0, 0, 0, 0);
+  s.windows++;
+}
 
-  pc.valid = any;
+PerfCounters perf_read(const PerfSession& s) {
+  double sum[kPageFaults + 1];
+  bool have[kPageFaults + 1];
+  for (int f = 0; f <= kPageFaults; f++) { sum[f] = 0.0; have[f] = true; }
+
+  // A field is reported only if every event feeding it opened on every thread.
+  for (int e = 0; e < kNumPerfEvents; e++) {
+    const PerfField f = kPerfEvents[e].field;
+    for (int t = 0; t < s.threads && have[f]; t++) {
+      const int fd = s.fd[(size_t)t * kNumPerfEvents + e];
+      uint64_t v[3] = {0, 0, 0};  // value, time_enabled, time_running
+      if (fd < 0 || ::read(fd, v, sizeof(v)) != (ssize_t)sizeof(v)) { have[f] = false; break; }
+      double x = (double)v[0];
+      if (v[2] > 0 && v[2] < v[1]) x *= (double)v[1] / (double)v[2];
+      else if (v[2] == 0 && v[1] > 0) { have[f] = false; break; }  // never scheduled
+      sum[f] += x * kPerfEvents[e].weight;
+    }
+  }
+  if (s.fd.empty()) for (int f = 0; f <= kPageFaults; f++) have[f] = false;
+
+  PerfCounters pc;
+  auto get = [&](PerfField f) { return have[f] ? sum[f] : -1.0; };
+  pc.cycles = get(kCycles);
+  pc.instructions = get(kInstructions);
+  pc.llc_load_misses = get(kLlcLoad);
+  pc.llc_store_misses = get(kLlcStore);
+  pc.dtlb_load_misses = get(kDtlbLoad);
+  pc.fp_ops = get(kFpOps);
+  pc.task_clock_ms = get(kTaskClock);
+  pc.context_switches = get(kCtxSwitches);
+  pc.cpu_migrations = get(kMigrations);
+  pc.page_faults = get(kPageFaults);
+  for (int f = 0; f <= kPageFaults; f++) pc.valid = pc.valid || have[f];
   return pc;
 }
 
+void perf_close(PerfSession& s) {
+  for (int fd : s.fd) {
+    if (fd >= 0) ::close(fd);
+  }
+  s.fd.clear();
+  s.threads = 0;
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <algorithm>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -8,15 +10,102 @@ void percentile_us(const std::vector<double>& samples_sec, double& p50, double&
 
 bool file_exists(const std::string& path);
 
+// In-process hardware/software counters via perf_event_open. Every thread of
+// the current OpenMP team opens its own events (user space only), and
+// perf_start/perf_stop toggle them from inside a parallel region, so only
+// the bracketed calls are counted. Events the kernel or hypervisor does not
+// expose are skipped and read back as -1. Totals are summed over threads and
+// over all start/stop windows, scaled for multiplexing.
 struct PerfCounters {
-  bool valid = false;
-  double cycles = 0.0;
-  double instructions = 0.0;
-  double cache_misses = 0.0;
-  double llc_load_misses = 0.0;
-  double llc_store_misses = 0.0;
-  double dtlb_load_misses = 0.0;
+  bool valid = false;  // at least one event opened
+  double cycles = -1.0;
+  double instructions = -1.0;
+  double llc_load_misses = -1.0;
+  double llc_store_misses = -1.0;
+  double dtlb_load_misses = -1.0;
+  double fp_ops = -1.0;  // single-precision FLOPs, FMA = 2 (Intel FP_ARITH_INST_RETIRED)
+  double task_clock_ms = -1.0;
+  double context_switches = -1.0;
+  double cpu_migrations = -1.0;
+  double page_faults = -1.0;
 };
 
-PerfCounters read_perf_csv(const std::string& perf_csv_path);
+struct PerfSession {
+  std::vector<int> fd;  // [thread * events + event], -1 if unavailable
+  int threads = 0;
+  int windows = 0;      // completed start/stop pairs
+};
+
+// Opens on the current team; false if no event could be opened at all.
+bool perf_open(PerfSession& s);
+void perf_start(PerfSession& s);
+void perf_stop(PerfSession& s);
+PerfCounters perf_read(const PerfSession& s);
+void perf_close(PerfSession& s);
+
+// Timed-rep control. warmup untimed calls run first; then at least reps
+// timed calls (0 = the kernel's default count). With ci_pct > 0 timing
+// continues, up to max_reps, until the bootstrap 95% CI of the median is
+// within +-ci_pct % of it. Each timed call records its wall time and the
+// process's context-switch and page-fault deltas (getrusage, all threads).
+struct RepPolicy {
+  int warmup = 1;
+  int reps = 0;
+  int max_reps = 200;
+  double ci_pct = 0.0;
+  int resamples = 1000;
+  unsigned long long seed = 1;
+  std::function<void()> flush;  // untimed, before each timed call (empty = none)
+};
+
+struct RepSample {
+  double seconds = 0.0;
+  long vol_csw = 0;    // voluntary context switches (blocking, e.g. idle team waits)
+  long invol_csw = 0;  // involuntary (preempted)
+  long page_faults = 0;
+};
+
+// Process-wide counters for RepSample deltas.
+void rusage_snapshot(long& vol_csw, long& invol_csw, long& page_faults);
+
+// Bootstrap percentile 95% CI of the median of x (empty x gives 0, 0).
+void bootstrap_median_ci(const std::vector<double>& x, int resamples, unsigned long long seed,
+                         double& lo, double& hi);
+bool reps_converged(const RepPolicy& p, const std::vector<RepSample>& s);
+
+// Tukey far-out fence: x > Q3 + 3 IQR (IQR floored at 1% of the median).
+// Returns the fence; flags[i] = 1 for outliers.
+double outlier_fence(const std::vector<double>& x, std::vector<int>& flags);
 
+// Runs prep(i) (untimed) then call() for i = 0 .. warmup + timed reps - 1,
+// with perf windows and samples on the timed calls only.
+template <typename Call, typename Prep>
+void run_reps(const RepPolicy& p, int default_reps, PerfSession& perf,
+              std::vector<RepSample>& out, Call&& call, Prep&& prep) {
+  const int base = std::max(1, p.reps > 0 ? p.reps : default_reps);
+  const int cap = p.ci_pct > 0.0 ? std::max(base, p.max_reps) : base;
+  int i = 0;
+  for (int w = 0; w < p.warmup; w++, i++) {
+    prep(i);
+    call();
+  }
+  for (int r = 0; r < cap; r++, i++) {
+    prep(i);
+    if (p.flush) p.flush();
+    RepSample s;
+    long v0, c0, f0, v1, c1, f1;
+    rusage_snapshot(v0, c0, f0);
+    perf_start(perf);
+    double t0 = now_seconds();
+    call();
+    double t1 = now_seconds();
+    perf_stop(perf);
+    rusage_snapshot(v1, c1, f1);
+    s.seconds = t1 - t0;
+    s.vol_csw = v1 - v0;
+    s.invol_csw = c1 - c0;
+    s.page_faults = f1 - f0;
+    out.push_back(s);
+    if (r + 1 >= base && p.ci_pct > 0.0 && reps_converged(p, out)) break;
+  }
+}
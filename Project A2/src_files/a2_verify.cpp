@@ -0,0 +1,1023 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <unistd.h>
+
+#include <omp.h>
+
+#include "a2_kernels.h"
+#include "a2_ooc.h"
+#include "a2_verify.h"
+
+namespace {
+
+const double kU = std::ldexp(1.0, -24);  // fp32 unit roundoff
+
+// ---------------------------------------------------------------------------
+// Operands: every buffer sits mis elements past a 64-byte boundary, with a
+// 64-byte guard zone of fill bytes on both sides.
+// ---------------------------------------------------------------------------
+
+constexpr size_t kGuardBytes = 64;
+constexpr unsigned char kFill = 0xA5;
+
+template <typename T>
+struct Guarded {
+  AlignedBufferT<T> buf;
+  T* p = nullptr;
+  size_t n = 0;
+};
+
+template <typename T>
+Guarded<T> make_guarded(size_t n, int mis) {
+  Guarded<T> g;
+  const size_t guard = kGuardBytes / sizeof(T);
+  g.buf = make_aligned<T>(n + (size_t)mis + 2 * guard, 64);
+  g.p = g.buf.ptr + guard + mis;
+  g.n = n;
+  std::memset(g.buf.ptr, kFill, g.buf.count * sizeof(T));
+  return g;
+}
+
+template <typename T>
+bool guards_intact(const Guarded<T>& g) {
+  const unsigned char* b = reinterpret_cast<const unsigned char*>(g.buf.ptr);
+  const size_t lo = (size_t)(g.p - g.buf.ptr) * sizeof(T);
+  const size_t hi = lo + g.n * sizeof(T);
+  for (size_t i = 0; i < lo; i++) if (b[i] != kFill) return false;
+  for (size_t i = hi; i < g.buf.count * sizeof(T); i++) if (b[i] != kFill) return false;
+  return true;
+}
+
+template <typename T>
+void free_guarded(Guarded<T>& g) {
+  free_aligned(g.buf);
+  g.p = nullptr;
+}
+
+Guarded<float> copy_operand(const float* src, size_t n, int mis) {
+  Guarded<float> g = make_guarded<float>(n, mis);
+  if (n) std::memcpy(g.p, src, n * sizeof(float));
+  return g;
+}
+
+// C before a call: NaN when beta == 0 (the kernel must not read it), else C0.
+void seed_c(float* C, const float* C0, size_t n, float beta) {
+  if (beta == 0.0f) std::fill(C, C + n, std::numeric_limits<float>::quiet_NaN());
+  else if (n) std::memcpy(C, C0, n * sizeof(float));
+}
+
+// ---------------------------------------------------------------------------
+// Reference and tolerances
+// ---------------------------------------------------------------------------
+
+double gamma_n(int n) {
+  const double nu = (double)n * kU;
+  return nu / (1.0 - nu);
+}
+
+// Monotone integer image of a float: ulp distance is a difference of these.
+int64_t ordered(float x) {
+  int32_t b;
+  std::memcpy(&b, &x, sizeof(b));
+  return b < 0 ? -(int64_t)(b & 0x7fffffff) : (int64_t)b;
+}
+
+// Exact-enough dot products of A's rows with B's columns: dot and sum|a b|
+// per C element, k = longest dot.
+struct DotRef {
+  int m = 0;
+  int n = 0;
+  int k = 0;
+  std::vector<double> dot;
+  std::vector<double> absdot;
+};
+
+// A (m x k) and B (k x n) row-major.
+DotRef dense_ref(const float* A, const float* B, int m, int k, int n) {
+  DotRef R;
+  R.m = m; R.n = n; R.k = k;
+  R.dot.assign((size_t)m * n, 0.0);
+  R.absdot.assign((size_t)m * n, 0.0);
+  for (int i = 0; i < m; i++) {
+    for (int t = 0; t < k; t++) {
+      const double a = A[(size_t)i * k + t];
+      for (int j = 0; j < n; j++) {
+        const double p = a * (double)B[(size_t)t * n + j];
+        R.dot[(size_t)i * n + j] += p;
+        R.absdot[(size_t)i * n + j] += std::fabs(p);
+      }
+    }
+  }
+  return R;
+}
+
+// CSR A times row-major B (A.k x n); vals overrides A.values (decoded
+// low-precision copies).
+DotRef sparse_ref(const CSR& A, const float* vals, const float* B, int n) {
+  DotRef R;
+  R.m = A.m; R.n = n;
+  R.dot.assign((size_t)A.m * n, 0.0);
+  R.absdot.assign((size_t)A.m * n, 0.0);
+  if (!vals) vals = A.values.data();
+  for (int i = 0; i < A.m; i++) {
+    const int p0 = A.rowptr[(size_t)i], p1 = A.rowptr[(size_t)i + 1];
+    R.k = std::max(R.k, p1 - p0);
+    for (int p = p0; p < p1; p++) {
+      const double a = vals[p];
+      const float* b = &B[(size_t)A.colidx[(size_t)p] * n];
+      for (int j = 0; j < n; j++) {
+        R.dot[(size_t)i * n + j] += a * (double)b[j];
+        R.absdot[(size_t)i * n + j] += std::fabs(a * (double)b[j]);
+      }
+    }
+  }
+  return R;
+}
+
+struct Expect {
+  double v;
+  double tol;
+};
+
+// act(alpha dot + beta c0 + biases) and its error budget. normwise is an
+// extra absolute allowance for algorithms without a componentwise bound.
+Expect expect(const Epilogue& e, double dot, double absdot, int k, float c0, int i, int j,
+              double normwise) {
+  double pre = (double)e.alpha * dot;
+  double mag = std::fabs((double)e.alpha) * absdot;
+  if (e.beta != 0.0f) { pre += (double)e.beta * c0; mag += std::fabs((double)e.beta * c0); }
+  if (e.row_bias) { pre += e.row_bias[i]; mag += std::fabs((double)e.row_bias[i]); }
+  if (e.col_bias) { pre += e.col_bias[j]; mag += std::fabs((double)e.col_bias[j]); }
+  const double tol = 2.0 * gamma_n(k + 4) * mag + std::fabs((double)e.alpha) * normwise;
+  switch (e.act) {
+    case Activation::ReLU: return {pre > 0.0 ? pre : 0.0, tol};
+    case Activation::GELU: {
+      // slope below 1.13; x - x / (exp(2y) + 1) and the exp polynomial add
+      // a few ulp of |x|
+      const double t = std::tanh(0.7978845608 * (pre + 0.044715 * pre * pre * pre));
+      return {0.5 * pre * (1.0 + t), 1.2 * tol + 16.0 * kU * std::fabs(pre)};
+    }
+    default: return {pre, tol};
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Per-case statistics and the run summary
+// ---------------------------------------------------------------------------
+
+struct Case {
+  std::string name;
+  size_t bad = 0;
+  double max_ulp = 0.0;  // over elements whose error budget is below |reference|
+  double max_rel = 0.0;
+  double worst = 0.0;    // max err / tol over elements not within 2 ulp
+  std::string first;   // first mismatch
+
+  void miss(size_t idx, double got, double want, double tol) {
+    if (bad++ == 0) {
+      std::ostringstream s;
+      s << "C[" << idx << "] = " << got << ", want " << want << " +- " << tol;
+      first = s.str();
+    }
+  }
+
+  void elem(size_t idx, float got, const Expect& x) {
+    if (!std::isfinite(got)) {
+      max_ulp = std::numeric_limits<double>::infinity();
+      miss(idx, got, x.v, x.tol);
+      return;
+    }
+    const double err = std::fabs((double)got - x.v);
+    const double ulp = std::fabs((double)(ordered(got) - ordered((float)x.v)));
+    if (std::fabs(x.v) > x.tol) {
+      max_ulp = std::max(max_ulp, ulp);
+      max_rel = std::max(max_rel, err / std::fabs(x.v));
+    }
+    if (ulp <= 2.0) return;
+    const double r = err / std::max(x.tol, (double)FLT_MIN);
+    worst = std::max(worst, r);
+    if (r > 1.0) miss(idx, got, x.v, x.tol);
+  }
+
+  void exact(size_t idx, int64_t got, int64_t want) {
+    if (got != want) miss(idx, (double)got, (double)want, 0.0);
+  }
+};
+
+struct Verifier {
+  uint64_t seed = 1;
+  bool verbose = false;
+  int cases = 0;
+  int failed = 0;
+  double max_ulp = 0.0;
+  double worst = 0.0;
+
+  void report(const Case& c, bool guards_ok) {
+    cases++;
+    max_ulp = std::max(max_ulp, c.max_ulp);
+    worst = std::max(worst, c.worst);
+    const bool fail = c.bad != 0 || !guards_ok;
+    if (fail) failed++;
+    if (!fail && !verbose) return;
+    std::cerr << (fail ? "FAIL " : "ok   ") << c.name << ": max_ulp " << c.max_ulp
+              << " max_rel " << c.max_rel << " err/tol " << c.worst;
+    if (c.bad) std::cerr << "; " << c.bad << " bad, first " << c.first;
+    if (!guards_ok) std::cerr << "; wrote outside its output";
+    std::cerr << "\n";
+  }
+};
+
+// Compares C (R.m x R.n, row-major) against the reference under e; C0 is
+// what C held before the call.
+void compare(Case& c, const DotRef& R, const Epilogue& e, const float* C0, const float* C,
+             double normwise = 0.0) {
+  for (int i = 0; i < R.m; i++) {
+    for (int j = 0; j < R.n; j++) {
+      const size_t idx = (size_t)i * R.n + j;
+      c.elem(idx, C[idx], expect(e, R.dot[idx], R.absdot[idx], R.k, C0 ? C0[idx] : 0.0f, i, j,
+                                 normwise));
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Cases
+// ---------------------------------------------------------------------------
+
+struct EpiCase {
+  const char* name;
+  float alpha;
+  float beta;
+  bool row_bias;
+  bool col_bias;
+  Activation act;
+};
+
+const EpiCase kEpis[] = {
+  {"plain", 1.0f, 0.0f, false, false, Activation::None},
+  {"beta+bias+relu", 0.5f, 1.5f, true, true, Activation::ReLU},
+  {"alpha+colbias+gelu", -1.25f, 0.0f, false, true, Activation::GELU},
+};
+
+struct Shape {
+  int m, k, n;
+};
+
+// Tails on every side of the 8-wide vectors and 4 x 16 / 6 x 16 register
+// tiles, k == 0, and one exact multiple.
+const Shape kGemmShapes[] = {
+  {1, 1, 1}, {5, 0, 9}, {7, 13, 9}, {17, 31, 15}, {33, 65, 47},
+  {64, 64, 64}, {100, 37, 129}, {130, 257, 71},
+};
+
+struct Tiles {
+  int m, k, n;
+};
+const Tiles kTiles[] = {{64, 64, 128}, {16, 24, 40}};
+
+struct SparseShape {
+  int m, k, n;
+  double density;
+  const char* pattern;  // make_random_csr pattern, or "skew"
+};
+
+const SparseShape kSparseShapes[] = {
+  {1, 1, 1, 1.0, "uniform"},
+  {37, 53, 9, 0.1, "uniform"},
+  {64, 100, 33, 0.05, "band"},
+  {130, 77, 71, 0.2, "blockdiag"},
+  {200, 300, 17, 0.01, "uniform"},  // mostly empty rows
+  {96, 160, 40, 0.0, "skew"},
+};
+
+// One full row, a few long ones, the rest empty or short: the load-balancing
+// and long-row paths of SpMV / SELL.
+CSR make_skewed_csr(int m, int k, uint64_t seed) {
+  std::vector<int> rows, cols;
+  for (int j = 0; j < k; j++) { rows.push_back(0); cols.push_back(j); }
+  for (int i = 1; i < m; i++) {
+    const int len = (i % 5 == 0) ? (int)((i * 37) % k) : (i % 3 == 0 ? 0 : 1 + i % 4);
+    for (int t = 0; t < len; t++) {
+      rows.push_back(i);
+      cols.push_back((int)(((uint64_t)t * 7919 + (uint64_t)i * 104729 + seed) % (uint64_t)k));
+    }
+  }
+  std::vector<float> vals(rows.size());
+  fill_random(vals.data(), vals.size(), seed ^ 0x5EEDu);
+  return csr_from_coo(m, k, rows.size(), rows.data(), cols.data(), vals.data());
+}
+
+CSR make_case_csr(const SparseShape& s, uint64_t seed) {
+  if (std::string(s.pattern) == "skew") return make_skewed_csr(s.m, s.k, seed);
+  return make_random_csr(s.m, s.k, s.density, s.pattern, seed);
+}
+
+std::string shape_name(int m, int k, int n) {
+  std::ostringstream s;
+  s << m << "x" << k << "x" << n;
+  return s.str();
+}
+
+// Random operands for one epilogue case, same offset as the kernel's inputs.
+struct EpiOperands {
+  Guarded<float> C0, rb, cb;
+};
+
+EpiOperands make_epi_operands(int m, int n, int mis, uint64_t seed) {
+  EpiOperands o;
+  o.C0 = make_guarded<float>((size_t)m * n, mis);
+  o.rb = make_guarded<float>((size_t)m, mis);
+  o.cb = make_guarded<float>((size_t)n, mis);
+  fill_random(o.C0.p, o.C0.n, seed ^ 0xC0C0u);
+  fill_random(o.rb.p, o.rb.n, seed ^ 0xB1A5u);
+  fill_random(o.cb.p, o.cb.n, seed ^ 0xB1A6u);
+  return o;
+}
+
+void free_epi_operands(EpiOperands& o) {
+  free_guarded(o.C0); free_guarded(o.rb); free_guarded(o.cb);
+}
+
+Epilogue make_epi(const EpiCase& ec, const EpiOperands& o) {
+  Epilogue e;
+  e.alpha = ec.alpha;
+  e.beta = ec.beta;
+  e.row_bias = ec.row_bias ? o.rb.p : nullptr;
+  e.col_bias = ec.col_bias ? o.cb.p : nullptr;
+  e.act = ec.act;
+  return e;
+}
+
+// ---- dense f32 GEMM -------------------------------------------------------
+
+using GemmCall = std::function<void(const float*, const float*, float*, int, int, int,
+                                    const Tiles&, const Epilogue&)>;
+
+struct GemmVariant {
+  const char* name;
+  GemmCall call;
+  bool tiled;     // tile sizes matter
+  bool strassen;  // normwise error bound
+};
+
+void verify_gemm(Verifier& v) {
+  GemmArena arena;
+  const int cutoff = 16;
+  std::vector<GemmVariant> variants = {
+    {"gemm_tiled/scalar", [](const float* A, const float* B, float* C, int m, int k, int n,
+                             const Tiles& t, const Epilogue& e) {
+       gemm_tiled_scalar(A, B, C, m, k, n, t.m, t.k, t.n, e);
+     }, true, false},
+    {"gemm_recursive/scalar", [](const float* A, const float* B, float* C, int m, int k, int n,
+                                 const Tiles&, const Epilogue& e) {
+       gemm_recursive_scalar(A, B, C, m, k, n, e);
+     }, false, false},
+    {"gemm_morton/scalar", [](const float* A, const float* B, float* C, int m, int k, int n,
+                              const Tiles& t, const Epilogue& e) {
+       MortonMatrix Am = make_morton(A, m, k, t.m), Bm = make_morton(B, k, n, t.m);
+       gemm_morton_scalar(Am, Bm, C, e);
+       free_morton(Am); free_morton(Bm);
+     }, true, false},
+    {"gemm_strassen/scalar", [&](const float* A, const float* B, float* C, int m, int k, int n,
+                                 const Tiles& t, const Epilogue& e) {
+       gemm_strassen_scalar(A, B, C, m, k, n, cutoff, t.m, t.k, t.n, arena, e);
+     }, true, true},
+#if defined(__AVX2__)
+    {"gemm_tiled/avx2", [](const float* A, const float* B, float* C, int m, int k, int n,
+                           const Tiles& t, const Epilogue& e) {
+       gemm_tiled_avx2(A, B, C, m, k, n, t.m, t.k, t.n, e);
+     }, true, false},
+    {"gemm_recursive/avx2", [](const float* A, const float* B, float* C, int m, int k, int n,
+                               const Tiles&, const Epilogue& e) {
+       gemm_recursive_avx2(A, B, C, m, k, n, e);
+     }, false, false},
+    {"gemm_morton/avx2", [](const float* A, const float* B, float* C, int m, int k, int n,
+                            const Tiles& t, const Epilogue& e) {
+       MortonMatrix Am = make_morton(A, m, k, t.m), Bm = make_morton(B, k, n, t.m);
+       gemm_morton_avx2(Am, Bm, C, e);
+       free_morton(Am); free_morton(Bm);
+     }, true, false},
+    {"gemm_strassen/avx2", [&](const float* A, const float* B, float* C, int m, int k, int n,
+                               const Tiles& t, const Epilogue& e) {
+       gemm_strassen_avx2(A, B, C, m, k, n, cutoff, t.m, t.k, t.n, arena, e);
+     }, true, true},
+#endif
+  };
+
+  for (const Shape& s : kGemmShapes) {
+    const size_t na = (size_t)s.m * s.k, nb = (size_t)s.k * s.n, nc = (size_t)s.m * s.n;
+    std::vector<float> A0(na), B0(nb);
+    fill_random(A0.data(), na, v.seed ^ 0xA5A5u);
+    fill_random(B0.data(), nb, v.seed ^ 0x5A5Au);
+    const DotRef R = dense_ref(A0.data(), B0.data(), s.m, s.k, s.n);
+    double amax = 0.0, bmax = 0.0;
+    for (float x : A0) amax = std::max(amax, (double)std::fabs(x));
+    for (float x : B0) bmax = std::max(bmax, (double)std::fabs(x));
+
+    for (int mis = 0; mis <= 1; mis++) {
+      Guarded<float> A = copy_operand(A0.data(), na, mis), B = copy_operand(B0.data(), nb, mis);
+      Guarded<float> C = make_guarded<float>(nc, mis);
+      EpiOperands o = make_epi_operands(s.m, s.n, mis, v.seed);
+      for (const GemmVariant& gv : variants) {
+        for (const Tiles& t : kTiles) {
+          if (!gv.tiled && &t != &kTiles[0]) continue;
+          const double normwise =
+              gv.strassen ? 2.0 * strassen_error_bound(s.m, s.k, s.n, cutoff) * amax * bmax : 0.0;
+          for (const EpiCase& ec : kEpis) {
+            const Epilogue e = make_epi(ec, o);
+            seed_c(C.p, o.C0.p, nc, e.beta);
+            gv.call(A.p, B.p, C.p, s.m, s.k, s.n, t, e);
+            Case c;
+            std::ostringstream name;
+            name << gv.name << " " << shape_name(s.m, s.k, s.n);
+            if (gv.tiled) name << " tiles " << t.m << "/" << t.k << "/" << t.n;
+            name << " mis " << mis << " " << ec.name;
+            c.name = name.str();
+            compare(c, R, e, o.C0.p, C.p, normwise);
+            v.report(c, guards_intact(C));
+          }
+        }
+      }
+      free_epi_operands(o);
+      free_guarded(A); free_guarded(B); free_guarded(C);
+    }
+  }
+  free_arena(arena);
+}
+
+// ---- op(A) * op(B) on strided views ---------------------------------------
+
+// rows x cols row-major src stored with row stride ld (>= cols), or as its
+// transpose (cols x rows, ld >= rows); spare columns hold a sentinel.
+const float kPadValue = 7.0f;
+
+Guarded<float> store_op(const float* src, int rows, int cols, Trans op, int ld, int mis) {
+  const int stored_rows = op == Trans::N ? rows : cols;
+  Guarded<float> g = make_guarded<float>((size_t)stored_rows * ld, mis);
+  std::fill(g.p, g.p + g.n, kPadValue);
+  for (int r = 0; r < rows; r++) {
+    for (int c = 0; c < cols; c++) {
+      const float x = src[(size_t)r * cols + c];
+      if (op == Trans::N) g.p[(size_t)r * ld + c] = x;
+      else                g.p[(size_t)c * ld + r] = x;
+    }
+  }
+  return g;
+}
+
+void verify_gemm_op(Verifier& v) {
+  using OpCall = void (*)(Trans, Trans, const float*, int, const float*, int, float*, int,
+                          int, int, int, int, int, int, const Epilogue&);
+  std::vector<std::pair<const char*, OpCall>> variants = {{"gemm_tiled_op/scalar", gemm_tiled_op_scalar}};
+#if defined(__AVX2__)
+  variants.push_back({"gemm_tiled_op/avx2", gemm_tiled_op_avx2});
+#endif
+  const Trans ops[] = {Trans::N, Trans::T};
+  const int pad = 3;  // every view is a sub-block of a wider matrix
+
+  for (const Shape& s : kGemmShapes) {
+    const size_t na = (size_t)s.m * s.k, nb = (size_t)s.k * s.n;
+    std::vector<float> A0(na), B0(nb);
+    fill_random(A0.data(), na, v.seed ^ 0xA5A5u);
+    fill_random(B0.data(), nb, v.seed ^ 0x5A5Au);
+    const DotRef R = dense_ref(A0.data(), B0.data(), s.m, s.k, s.n);
+    const int ldc = s.n + pad;
+
+    for (int mis = 0; mis <= 1; mis++) {
+      EpiOperands o = make_epi_operands(s.m, s.n, mis, v.seed);
+      Guarded<float> C = make_guarded<float>((size_t)s.m * ldc, mis);
+      std::vector<float> C0v((size_t)s.m * ldc, kPadValue), Cv((size_t)s.m * s.n);
+      for (int i = 0; i < s.m; i++) {
+        std::memcpy(&C0v[(size_t)i * ldc], o.C0.p + (size_t)i * s.n, (size_t)s.n * sizeof(float));
+      }
+      for (Trans ta : ops) {
+        for (Trans tb : ops) {
+          const int lda = (ta == Trans::N ? s.k : s.m) + pad;
+          const int ldb = (tb == Trans::N ? s.n : s.k) + pad;
+          Guarded<float> A = store_op(A0.data(), s.m, s.k, ta, lda, mis);
+          Guarded<float> B = store_op(B0.data(), s.k, s.n, tb, ldb, mis);
+          for (const auto& ov : variants) {
+            for (const Tiles& t : kTiles) {
+              for (const EpiCase& ec : kEpis) {
+                const Epilogue e = make_epi(ec, o);
+                std::memcpy(C.p, C0v.data(), C0v.size() * sizeof(float));
+                for (int i = 0; e.beta == 0.0f && i < s.m; i++) {
+                  seed_c(C.p + (size_t)i * ldc, nullptr, (size_t)s.n, 0.0f);
+                }
+                ov.second(ta, tb, A.p, lda, B.p, ldb, C.p, ldc, s.m, s.k, s.n, t.m, t.k, t.n, e);
+                bool pad_ok = true;
+                for (int i = 0; i < s.m; i++) {
+                  std::memcpy(&Cv[(size_t)i * s.n], C.p + (size_t)i * ldc, (size_t)s.n * sizeof(float));
+                  for (int j = s.n; j < ldc; j++) pad_ok &= C.p[(size_t)i * ldc + j] == kPadValue;
+                }
+                Case c;
+                std::ostringstream name;
+                name << ov.first << " " << (ta == Trans::N ? "N" : "T") << (tb == Trans::N ? "N" : "T")
+                     << " " << shape_name(s.m, s.k, s.n) << " ld " << lda << "/" << ldb << "/" << ldc
+                     << " tiles " << t.m << "/" << t.k << "/" << t.n << " mis " << mis << " " << ec.name;
+                c.name = name.str();
+                compare(c, R, e, o.C0.p, Cv.data());
+                v.report(c, pad_ok && guards_intact(C));
+              }
+            }
+          }
+          free_guarded(A); free_guarded(B);
+        }
+      }
+      free_guarded(C);
+      free_epi_operands(o);
+    }
+  }
+}
+
+// ---- batched GEMM ---------------------------------------------------------
+
+void verify_batched(Verifier& v) {
+  // the unrolled 16/32/64/128 kernels and the generic path
+  const std::vector<GemmShape> shapes = {
+    {16, 16, 16}, {32, 32, 32}, {64, 64, 64}, {128, 128, 128},
+    {5, 7, 3}, {33, 17, 9}, {1, 1, 1}, {16, 8, 24},
+  };
+  std::vector<size_t> ao, bo, co;
+  size_t na = 0, nb = 0, nc = 0;
+  for (const GemmShape& sh : shapes) {
+    ao.push_back(na); bo.push_back(nb); co.push_back(nc);
+    na += (size_t)sh.m * sh.k; nb += (size_t)sh.k * sh.n; nc += (size_t)sh.m * sh.n;
+  }
+  std::vector<float> A0(na), B0(nb);
+  fill_random(A0.data(), na, v.seed ^ 0xA5A5u);
+  fill_random(B0.data(), nb, v.seed ^ 0x5A5Au);
+
+  using BatchedCall = void (*)(const float* const*, const float* const*, float* const*,
+                               const GemmShape*, int, double*);
+  std::vector<std::pair<const char*, BatchedCall>> variants = {{"gemm_batched/scalar", gemm_batched_scalar}};
+#if defined(__AVX2__)
+  variants.push_back({"gemm_batched/avx2", gemm_batched_avx2});
+#endif
+
+  for (int mis = 0; mis <= 1; mis++) {
+    Guarded<float> A = copy_operand(A0.data(), na, mis), B = copy_operand(B0.data(), nb, mis);
+    Guarded<float> C = make_guarded<float>(nc, mis);
+    std::vector<const float*> pa, pb;
+    std::vector<float*> pc;
+    for (size_t b = 0; b < shapes.size(); b++) {
+      pa.push_back(A.p + ao[b]); pb.push_back(B.p + bo[b]); pc.push_back(C.p + co[b]);
+    }
+    for (const auto& bv : variants) {
+      seed_c(C.p, nullptr, nc, 0.0f);
+      // With per-matrix timing on, as a2_benchmark runs it.
+      std::vector<double> secs(shapes.size());
+      bv.second(pa.data(), pb.data(), pc.data(), shapes.data(), (int)shapes.size(), secs.data());
+      Case c;
+      c.name = std::string(bv.first) + " mixed batch mis " + std::to_string(mis);
+      for (size_t b = 0; b < shapes.size(); b++) {
+        const GemmShape& sh = shapes[b];
+        compare(c, dense_ref(A0.data() + ao[b], B0.data() + bo[b], sh.m, sh.k, sh.n), Epilogue(),
+                nullptr, pc[b]);
+      }
+      v.report(c, guards_intact(C));
+    }
+    free_guarded(A); free_guarded(B); free_guarded(C);
+  }
+}
+
+// ---- SpMM in every format, SpMV, SpGEMM -----------------------------------
+
+struct SparseInputs {
+  const CSR* csr;
+  const CSC* csc;
+  const ELL* ell;
+  const SELL* sell;
+  const BSR* bsr;
+  const float* Brow;  // k x n row-major
+  const float* Bcol;  // same values, column-major
+};
+
+using SpmmCall = std::function<void(const SparseInputs&, float*, int, int, const Epilogue&)>;
+
+struct SpmmVariant {
+  const char* name;
+  SpmmCall call;
+  bool epilogue;  // false: plain overwrite only (CSC)
+};
+
+std::vector<SpmmVariant> spmm_variants() {
+  std::vector<SpmmVariant> v = {
+    {"spmm_csr/scalar rowB", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_scalar(*in.csr, in.Brow, C, n, jb, LayoutB::RowMajor, e);
+     }, true},
+    {"spmm_csr/scalar colB", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_scalar(*in.csr, in.Bcol, C, n, jb, LayoutB::ColMajor, e);
+     }, true},
+    {"spmm_csr_panel/scalar k7", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_panel_scalar(*in.csr, in.Brow, C, n, jb, 7, e);
+     }, true},
+    {"spmm_csr_panel/scalar k0", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_panel_scalar(*in.csr, in.Brow, C, n, jb, 0, e);
+     }, true},
+    {"spmm_csc/scalar", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue&) {
+       spmm_csc_scalar(*in.csc, in.Brow, C, n, jb);
+     }, false},
+    {"spmm_ell/scalar", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_ell_scalar(*in.ell, in.Brow, C, n, jb, e);
+     }, true},
+    {"spmm_sell/scalar", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_sell_scalar(*in.sell, in.Brow, C, n, jb, e);
+     }, true},
+    {"spmm_bsr/scalar", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_bsr_scalar(*in.bsr, in.Brow, C, n, jb, e);
+     }, true},
+#if defined(__AVX2__)
+    {"spmm_csr/avx2 rowB", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_avx2(*in.csr, in.Brow, C, n, jb, LayoutB::RowMajor, e);
+     }, true},
+    {"spmm_csr/avx2 colB", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_avx2(*in.csr, in.Bcol, C, n, jb, LayoutB::ColMajor, e);
+     }, true},
+    {"spmm_csr_panel/avx2 k7", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_panel_avx2(*in.csr, in.Brow, C, n, jb, 7, e);
+     }, true},
+    {"spmm_csr_panel/avx2 k0", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_csr_panel_avx2(*in.csr, in.Brow, C, n, jb, 0, e);
+     }, true},
+    {"spmm_csc/avx2", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue&) {
+       spmm_csc_avx2(*in.csc, in.Brow, C, n, jb);
+     }, false},
+    {"spmm_ell/avx2", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_ell_avx2(*in.ell, in.Brow, C, n, jb, e);
+     }, true},
+    {"spmm_sell/avx2", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_sell_avx2(*in.sell, in.Brow, C, n, jb, e);
+     }, true},
+    {"spmm_bsr/avx2", [](const SparseInputs& in, float* C, int n, int jb, const Epilogue& e) {
+       spmm_bsr_avx2(*in.bsr, in.Brow, C, n, jb, e);
+     }, true},
+#endif
+  };
+  return v;
+}
+
+void verify_sparse(Verifier& v) {
+  const std::vector<SpmmVariant> variants = spmm_variants();
+  const int jblocks[] = {128, 24};
+
+  for (const SparseShape& s : kSparseShapes) {
+    const CSR A = make_case_csr(s, v.seed);
+    const CSC csc = csr_to_csc(A);
+    const ELL ell = csr_to_ell(A);
+    const SELL sell = csr_to_sell(A, 8, 4);
+    const BSR bsr = csr_to_bsr(A, 4);
+    const size_t nb = (size_t)A.k * s.n, nc = (size_t)A.m * s.n;
+    std::vector<float> B0(nb), Bc0(nb);
+    fill_random(B0.data(), nb, v.seed ^ 0x1234u);
+    for (int t = 0; t < A.k; t++) {
+      for (int j = 0; j < s.n; j++) Bc0[(size_t)j * A.k + t] = B0[(size_t)t * s.n + j];
+    }
+    const DotRef R = sparse_ref(A, nullptr, B0.data(), s.n);
+    const std::string shape = std::string(s.pattern) + " " + shape_name(A.m, A.k, s.n) +
+                              " nnz " + std::to_string(csr_nnz(A));
+
+    for (int mis = 0; mis <= 1; mis++) {
+      Guarded<float> B = copy_operand(B0.data(), nb, mis), Bc = copy_operand(Bc0.data(), nb, mis);
+      Guarded<float> C = make_guarded<float>(nc, mis);
+      EpiOperands o = make_epi_operands(A.m, s.n, mis, v.seed);
+      const SparseInputs in = {&A, &csc, &ell, &sell, &bsr, B.p, Bc.p};
+      for (const SpmmVariant& sv : variants) {
+        for (int jb : jblocks) {
+          for (const EpiCase& ec : kEpis) {
+            if (!sv.epilogue && &ec != &kEpis[0]) continue;
+            const Epilogue e = make_epi(ec, o);
+            seed_c(C.p, o.C0.p, nc, e.beta);
+            sv.call(in, C.p, s.n, jb, e);
+            Case c;
+            c.name = std::string(sv.name) + " " + shape + " jblock " + std::to_string(jb) +
+                     " mis " + std::to_string(mis) + " " + ec.name;
+            compare(c, R, e, o.C0.p, C.p);
+            v.report(c, guards_intact(C));
+          }
+        }
+      }
+
+      // SpMV: y = A x with x = B's first column
+      std::vector<float> x0(A.k);
+      for (int t = 0; t < A.k; t++) x0[t] = B0[(size_t)t * s.n];
+      Guarded<float> x = copy_operand(x0.data(), x0.size(), mis);
+      Guarded<float> y = make_guarded<float>((size_t)A.m, mis);
+      const DotRef Rx = sparse_ref(A, nullptr, x0.data(), 1);
+      const SpmvPlan plan = make_spmv_plan(A, omp_get_max_threads());
+      std::vector<std::pair<const char*, void (*)(const CSR&, const SpmvPlan&, const float*, float*)>>
+          spmv = {{"spmv_csr/scalar", spmv_csr_scalar}};
+#if defined(__AVX2__)
+      spmv.push_back({"spmv_csr/avx2", spmv_csr_avx2});
+#endif
+      for (const auto& sv : spmv) {
+        seed_c(y.p, nullptr, y.n, 0.0f);
+        sv.second(A, plan, x.p, y.p);
+        Case c;
+        c.name = std::string(sv.first) + " " + shape + " mis " + std::to_string(mis);
+        compare(c, Rx, Epilogue(), nullptr, y.p);
+        v.report(c, guards_intact(y));
+      }
+      free_guarded(x); free_guarded(y);
+      free_epi_operands(o);
+      free_guarded(B); free_guarded(Bc); free_guarded(C);
+    }
+
+    // SpGEMM against the dense product of both operands
+    const CSR Bs = make_random_csr(A.k, s.n, 0.1, "uniform", v.seed ^ 0x77u);
+    std::vector<float> Ad((size_t)A.m * A.k, 0.0f), Bd((size_t)Bs.m * Bs.k, 0.0f);
+    for (int i = 0; i < A.m; i++) {
+      for (int p = A.rowptr[(size_t)i]; p < A.rowptr[(size_t)i + 1]; p++) {
+        Ad[(size_t)i * A.k + A.colidx[(size_t)p]] += A.values[(size_t)p];
+      }
+    }
+    for (int i = 0; i < Bs.m; i++) {
+      for (int p = Bs.rowptr[(size_t)i]; p < Bs.rowptr[(size_t)i + 1]; p++) {
+        Bd[(size_t)i * Bs.k + Bs.colidx[(size_t)p]] += Bs.values[(size_t)p];
+      }
+    }
+    const DotRef Rs = dense_ref(Ad.data(), Bd.data(), A.m, A.k, Bs.k);
+    for (SpgemmAccum acc : {SpgemmAccum::Auto, SpgemmAccum::Hash, SpgemmAccum::Dense}) {
+      const CSR P = spgemm_csr(A, Bs, acc);
+      Case c;
+      c.name = std::string("spgemm/") + spgemm_accum_name(acc) + " " + shape;
+      bool structure = P.m == A.m && P.k == Bs.k && P.rowptr.size() == (size_t)A.m + 1;
+      std::vector<float> Pd((size_t)A.m * Bs.k, 0.0f);
+      for (int i = 0; structure && i < P.m; i++) {
+        for (int p = P.rowptr[(size_t)i]; p < P.rowptr[(size_t)i + 1]; p++) {
+          const int j = P.colidx[(size_t)p];
+          // rows must be sorted and duplicate-free
+          if (j < 0 || j >= P.k || (p > P.rowptr[(size_t)i] && j <= P.colidx[(size_t)p - 1])) {
+            structure = false;
+            break;
+          }
+          Pd[(size_t)i * P.k + j] = P.values[(size_t)p];
+        }
+      }
+      if (structure) {
+        compare(c, Rs, Epilogue(), nullptr, Pd.data());
+      } else {
+        c.bad++;
+        c.first = "unsorted, duplicate or out-of-range columns";
+      }
+      v.report(c, true);
+    }
+  }
+}
+
+// ---- out-of-core GEMM / SpMM ----------------------------------------------
+
+// Operand files in a temporary directory and budgets small enough for
+// several tiles or panels per dimension, so slot reuse, k accumulation
+// across tiles and the row cursors across B panels all run. C starts as a
+// NaN-filled file, so a tile never written back shows up.
+void verify_ooc(Verifier& v) {
+  char tmpl[] = "/tmp/a2_verify_XXXXXX";
+  if (!mkdtemp(tmpl)) {
+    Case c;
+    c.name = "ooc: cannot create a temporary directory";
+    c.bad = 1;
+    v.report(c, true);
+    return;
+  }
+  const std::string dir = tmpl;
+  const std::string a_path = dir + "/A.f32", b_path = dir + "/B.f32", c_path = dir + "/C.f32";
+  std::string err;
+
+  // rows x cols from src (nullptr: NaN) into path
+  auto put = [&](const std::string& path, const float* src, int rows, int cols) {
+    std::vector<float> nan;
+    if (!src) { nan.assign((size_t)rows * cols, std::numeric_limits<float>::quiet_NaN()); src = nan.data(); }
+    DenseFile f;
+    bool ok = create_dense_file(path, rows, cols, false, 0, err) && open_dense_file(path, true, false, f, err) &&
+              write_dense_block(f, 0, rows, 0, cols, src);
+    close_dense_file(f);
+    return ok;
+  };
+  std::vector<std::pair<const char*, bool>> variants = {{"scalar", false}};
+#if defined(__AVX2__)
+  variants.push_back({"avx2", true});
+#endif
+
+  // Runs one product into a fresh C and compares every element.
+  auto check = [&](const std::string& name, const DotRef& R,
+                   const std::function<bool(const DenseFile&, const DenseFile&, OocStats&)>& run, bool mapped) {
+    Case c;
+    c.name = name + (mapped ? " mmap" : " pread");
+    DenseFile B, C;
+    std::vector<float> Cv((size_t)R.m * R.n);
+    OocStats st;
+    bool ok = put(c_path, nullptr, R.m, R.n) && open_dense_file(b_path, false, mapped, B, err) &&
+              open_dense_file(c_path, true, false, C, err) && run(B, C, st) &&
+              read_dense_block(C, 0, R.m, 0, R.n, Cv.data());
+    close_dense_file(B);
+    close_dense_file(C);
+    if (ok) {
+      compare(c, R, Epilogue(), nullptr, Cv.data());
+    } else {
+      c.bad++;
+      c.first = err;
+    }
+    v.report(c, true);
+  };
+
+  // 192 KiB: 64 x 64 A/B tiles, 64 x 128 C tiles; {70, 40, 150} keeps
+  // each A tile across the j tiles.
+  const Shape gemm_shapes[] = {{150, 130, 200}, {70, 40, 150}, {65, 0, 3}, {1, 1, 1}};
+  for (const Shape& sh : gemm_shapes) {
+    std::vector<float> A0((size_t)sh.m * sh.k), B0((size_t)sh.k * sh.n);
+    fill_random(A0.data(), A0.size(), v.seed ^ 0xA5A5u);
+    fill_random(B0.data(), B0.size(), v.seed ^ 0x5A5Au);
+    const DotRef R = dense_ref(A0.data(), B0.data(), sh.m, sh.k, sh.n);
+    if (!put(a_path, A0.data(), sh.m, sh.k) || !put(b_path, B0.data(), sh.k, sh.n)) break;
+    for (bool mapped : {false, true}) {
+      for (const auto& var : variants) {
+        auto run = [&](const DenseFile& B, const DenseFile& C, OocStats& st) {
+          DenseFile A;
+          bool ok = open_dense_file(a_path, false, mapped, A, err) &&
+                    gemm_ooc(A, B, C, (size_t)192 << 10, var.second, kTiles[1].m, kTiles[1].k,
+                             kTiles[1].n, st, err);
+          close_dense_file(A);
+          return ok;
+        };
+        check(std::string("gemm_ooc/") + var.first + " " + shape_name(sh.m, sh.k, sh.n), R, run, mapped);
+      }
+    }
+  }
+
+  // 4 KiB: C row panels and B panels of a few rows each.
+  for (const SparseShape& s : kSparseShapes) {
+    const CSR A = make_case_csr(s, v.seed);
+    std::vector<float> B0((size_t)A.k * s.n);
+    fill_random(B0.data(), B0.size(), v.seed ^ 0x1234u);
+    const DotRef R = sparse_ref(A, nullptr, B0.data(), s.n);
+    if (!put(b_path, B0.data(), A.k, s.n)) break;
+    for (bool mapped : {false, true}) {
+      for (const auto& var : variants) {
+        auto run = [&](const DenseFile& B, const DenseFile& C, OocStats& st) {
+          return spmm_ooc(A, B, C, (size_t)4 << 10, var.second, 24, st, err);
+        };
+        check(std::string("spmm_ooc/") + var.first + " " + s.pattern + " " + shape_name(A.m, A.k, s.n),
+              R, run, mapped);
+      }
+    }
+  }
+
+  if (!err.empty() && v.verbose) std::cerr << "ooc: " << err << "\n";
+  std::remove(a_path.c_str());
+  std::remove(b_path.c_str());
+  std::remove(c_path.c_str());
+  ::rmdir(dir.c_str());
+}
+
+// ---- bf16 / f16 / i8 ------------------------------------------------------
+
+void store_as(const float* s, bf16_t* d, size_t n) { convert_f32(s, d, n); }
+void store_as(const float* s, fp16_t* d, size_t n) { convert_f32(s, d, n); }
+void store_as(const float* s, int8_t* d, size_t n) { quantize_i8(s, d, n, 127.0f); }
+
+float decode(bf16_t x) {
+  const uint32_t b = (uint32_t)x.bits << 16;
+  float f;
+  std::memcpy(&f, &b, sizeof(f));
+  return f;
+}
+
+float decode(fp16_t x) {
+  const int e = (x.bits >> 10) & 0x1f, mant = x.bits & 0x3ff;
+  const float s = (x.bits & 0x8000) ? -1.0f : 1.0f;
+  if (e == 0) return s * std::ldexp((float)mant, -24);
+  if (e == 31) return mant ? std::numeric_limits<float>::quiet_NaN() : s * INFINITY;
+  return s * std::ldexp((float)(1024 + mant), e - 25);
+}
+
+float decode(int8_t x) { return (float)x; }
+
+// Storage-typed operand plus its decoded f32 image for the reference.
+template <typename T>
+struct LpOperand {
+  Guarded<T> g;
+  std::vector<float> wide;
+};
+
+template <typename T>
+LpOperand<T> make_lp(const float* src, size_t n, int mis) {
+  LpOperand<T> o;
+  o.g = make_guarded<T>(n, mis);
+  if (n) store_as(src, o.g.p, n);
+  o.wide.resize(n);
+  for (size_t i = 0; i < n; i++) o.wide[i] = decode(o.g.p[i]);
+  return o;
+}
+
+// NaN for float accumulators, INT32_MAX for int32 ones.
+template <typename Acc>
+Acc poison() {
+  return std::numeric_limits<Acc>::has_quiet_NaN ? std::numeric_limits<Acc>::quiet_NaN()
+                                                 : std::numeric_limits<Acc>::max();
+}
+
+template <typename Acc>
+void compare_lp(Case& c, const DotRef& R, const Acc* C) {
+  for (size_t idx = 0; idx < R.dot.size(); idx++) {
+    if (std::is_integral<Acc>::value) c.exact(idx, (int64_t)C[idx], (int64_t)R.dot[idx]);
+    else c.elem(idx, (float)C[idx], expect(Epilogue(), R.dot[idx], R.absdot[idx], R.k, 0.0f, 0, 0, 0.0));
+  }
+}
+
+template <typename T, typename Acc>
+void verify_lp(Verifier& v, const char* dtype) {
+  for (const Shape& s : kGemmShapes) {
+    const size_t na = (size_t)s.m * s.k, nb = (size_t)s.k * s.n, nc = (size_t)s.m * s.n;
+    std::vector<float> A0(na), B0(nb);
+    fill_random(A0.data(), na, v.seed ^ 0xA5A5u);
+    fill_random(B0.data(), nb, v.seed ^ 0x5A5Au);
+    for (int mis = 0; mis <= 1; mis++) {
+      LpOperand<T> A = make_lp<T>(A0.data(), na, mis), B = make_lp<T>(B0.data(), nb, mis);
+      const DotRef R = dense_ref(A.wide.data(), B.wide.data(), s.m, s.k, s.n);
+      Guarded<Acc> C = make_guarded<Acc>(nc, mis);
+      for (const Tiles& t : kTiles) {
+        for (int simd = 0; simd <= 1; simd++) {
+          // the kernels overwrite C; a poisoned C catches one that adds
+          std::fill(C.p, C.p + nc, poison<Acc>());
+#if defined(__AVX2__)
+          if (simd) gemm_tiled_avx2(A.g.p, B.g.p, C.p, s.m, s.k, s.n, t.m, t.k, t.n);
+          else
+#else
+          if (simd) continue;
+#endif
+          gemm_tiled_scalar(A.g.p, B.g.p, C.p, s.m, s.k, s.n, t.m, t.k, t.n);
+          Case c;
+          std::ostringstream name;
+          name << "gemm_tiled/" << (simd ? "avx2 " : "scalar ") << dtype << " "
+               << shape_name(s.m, s.k, s.n) << " tiles " << t.m << "/" << t.k << "/" << t.n
+               << " mis " << mis;
+          c.name = name.str();
+          compare_lp(c, R, C.p);
+          v.report(c, guards_intact(C));
+        }
+      }
+      free_guarded(A.g); free_guarded(B.g); free_guarded(C);
+    }
+  }
+
+  for (const SparseShape& s : kSparseShapes) {
+    const CSR A = make_case_csr(s, v.seed);
+    const size_t nnz = csr_nnz(A), nb = (size_t)A.k * s.n, nc = (size_t)A.m * s.n;
+    std::vector<float> B0(nb);
+    fill_random(B0.data(), nb, v.seed ^ 0x1234u);
+    for (int mis = 0; mis <= 1; mis++) {
+      LpOperand<T> vals = make_lp<T>(A.values.data(), nnz, mis), B = make_lp<T>(B0.data(), nb, mis);
+      const DotRef R = sparse_ref(A, vals.wide.data(), B.wide.data(), s.n);
+      Guarded<Acc> C = make_guarded<Acc>(nc, mis);
+      for (int simd = 0; simd <= 1; simd++) {
+        // as above: each variant starts from a poisoned C, not the last result
+        std::fill(C.p, C.p + nc, poison<Acc>());
+#if defined(__AVX2__)
+        if (simd) spmm_csr_avx2(A, vals.g.p, B.g.p, C.p, s.n, 24);
+        else
+#else
+        if (simd) continue;
+#endif
+        spmm_csr_scalar(A, vals.g.p, B.g.p, C.p, s.n, 24);
+        Case c;
+        c.name = std::string("spmm_csr/") + (simd ? "avx2 " : "scalar ") + dtype + " " + s.pattern +
+                 " " + shape_name(A.m, A.k, s.n) + " mis " + std::to_string(mis);
+        compare_lp(c, R, C.p);
+        v.report(c, guards_intact(C));
+      }
+      free_guarded(vals.g); free_guarded(B.g); free_guarded(C);
+    }
+  }
+}
+
+}  // namespace
+
+int run_verify(uint64_t seed, bool verbose) {
+  Verifier v;
+  v.seed = seed;
+  v.verbose = verbose;
+  verify_gemm(v);
+  verify_gemm_op(v);
+  verify_batched(v);
+  verify_sparse(v);
+  verify_ooc(v);
+  verify_lp<bf16_t, float>(v, "bf16");
+  verify_lp<fp16_t, float>(v, "f16");
+  verify_lp<int8_t, int32_t>(v, "i8");
+  std::cerr << "verify: " << v.cases << " cases on " << omp_get_max_threads() << " thread(s), "
+            << v.failed << " failed; max " << v.max_ulp << " ulp, max err/tol " << v.worst << "\n";
+  return v.failed;
+}
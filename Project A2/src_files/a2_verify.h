@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+// Correctness harness behind a2_benchmark --verify. Every kernel variant
+// compiled in (f32 GEMM incl. op(A) op(B) on strided views / SpMM in all
+// formats / SpMV / SpGEMM, batched GEMM, out-of-core GEMM / SpMM over temporary
+// files, bf16 / f16 / i8) runs over tail shapes, odd tile and jblock sizes, both B
+// layouts, the fused epilogues and operands one element off alignment, and each
+// element is compared with a double-precision reference:
+//   - within 2 ulp of the rounded reference, or
+//   - within 2 gamma(k + 4) (|alpha| sum|a b| + |beta c| + |bias|), the
+//     forward error bound of an fp32 dot product in any summation order
+//     (FMA or not); GELU adds its own evaluation error, Strassen uses
+//     strassen_error_bound (normwise) instead.
+// i8 results must be exact. Guard zones around every output catch stray
+// stores, and beta == 0 runs start from NaN-filled C. Failing cases print to
+// stderr (verbose: every case); returns the number of failed cases.
+int run_verify(uint64_t seed, bool verbose);
@@ -207,10 +207,11 @@ def main():
         print("[plot] CSV has no rows; nothing to plot.")
         return
 
-    # STREAM bandwidth reference
+    # STREAM bandwidth reference: best DRAM-sized row of the suite (cache-level
+    # sweep rows would overstate the ceiling); older CSVs have no ws_level.
     stream_bw = 0.0
     for r in rows:
-        if r.get("kernel", "") == "stream":
+        if r.get("kernel", "") == "stream" and r.get("ws_level", "DRAM") == "DRAM":
             stream_bw = max(stream_bw, f(r.get("bandwidth_GBps", "0")))
     if stream_bw <= 0:
         stream_bw = 20.0
@@ -312,8 +313,13 @@ def main():
         plt.legend()
         savefig(args.outdir, "fig_breakeven_density_runtime.png")
 
-    # Roofline (still simple)
-    peak_gflops = 500.0  # placeholder
+    # Roofline: compute roof from --roofline rows (measured FMA peak), else a
+    # placeholder for CSVs that have none.
+    peak_gflops = max([f(r.get("peak_gflops", "0")) for r in rows] + [0.0])
+    peak_src = "measured"
+    if peak_gflops <= 0:
+        peak_gflops = 500.0
+        peak_src = "placeholder"
     pts = []
     for r in rows:
         if r.get("kernel") not in ("gemm", "spmm_csr"):
@@ -339,7 +345,7 @@ def main():
 
         plt.xlabel("Arithmetic Intensity (FLOP/byte) [model]")
         plt.ylabel("Achieved GFLOP/s")
-        plt.title(f"Roofline (STREAM BW={stream_bw:.1f} GB/s, Peak={peak_gflops:.0f} GFLOP/s placeholder)")
+        plt.title(f"Roofline (STREAM BW={stream_bw:.1f} GB/s, Peak={peak_gflops:.0f} GFLOP/s {peak_src})")
         plt.grid(True, which="both")
         plt.legend()
         savefig(args.outdir, "fig_roofline.png")
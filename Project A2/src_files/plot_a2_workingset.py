@@ -113,7 +113,7 @@ def main():
         m = i(r.get("m"))
         return (m == i(r.get("k")) and m == i(r.get("n")))
 
-    def keep_spmm(r):
+    def keep_spmm(r, panel):
         if r.get("kernel") != "spmm_csr":
             return False
         if r.get("variant") != args.spmm_variant:
@@ -128,11 +128,15 @@ def main():
             return False
         if abs(f(r.get("density")) - args.spmm_density) > 1e-12:
             return False
+        if (i(r.get("panel_k", "0")) > 0) != panel:
+            return False
         m = i(r.get("m"))
         return (m == i(r.get("k")))
 
     gemm_rows = [r for r in rows if keep_gemm(r)]
-    spmm_rows = [r for r in rows if keep_spmm(r)]
+    spmm_rows = [r for r in rows if keep_spmm(r, False)]
+    # 2D-blocked CSR-SpMM (--panel_k), same sizes
+    spmm2d_rows = [r for r in rows if keep_spmm(r, True)]
 
     def agg_by_size(rs, value_key):
         mp = defaultdict(list)
@@ -147,9 +151,11 @@ def main():
 
     g_gflops = agg_by_size(gemm_rows, "gflops")
     s_gflops = agg_by_size(spmm_rows, "gflops")
+    p_gflops = agg_by_size(spmm2d_rows, "gflops")
 
     g_bw = agg_by_size(gemm_rows, "bandwidth_GBps")
     s_bw = agg_by_size(spmm_rows, "bandwidth_GBps")
+    p_bw = agg_by_size(spmm2d_rows, "bandwidth_GBps")
 
     # ---- Plot 1: GFLOP/s vs size ----
     if g_gflops or s_gflops:
@@ -163,6 +169,10 @@ def main():
             ys = [x[1] for x in s_gflops]
             plt.plot(xs, ys, marker="o",
                      label=f"CSR-SpMM ({args.spmm_variant}, n={args.spmm_n}, d={args.spmm_density:g}, {args.threads}t)")
+        if p_gflops:
+            xs = [x[0] for x in p_gflops]
+            ys = [x[1] for x in p_gflops]
+            plt.plot(xs, ys, marker="s", label=f"CSR-SpMM 2D-blocked ({args.spmm_variant}, {args.threads}t)")
         plt.xlabel("Size parameter (GEMM: m=k=n; SpMM: m=k)")
         plt.ylabel("GFLOP/s (median over runs)")
         plt.title("Working-set transitions: performance vs size")
@@ -184,6 +194,10 @@ def main():
             ys = [x[1] for x in s_bw]
             plt.plot(xs, ys, marker="o",
                      label=f"CSR-SpMM BW est ({args.spmm_variant}, n={args.spmm_n}, d={args.spmm_density:g}, {args.threads}t)")
+        if p_bw:
+            xs = [x[0] for x in p_bw]
+            ys = [x[1] for x in p_bw]
+            plt.plot(xs, ys, marker="s", label=f"CSR-SpMM 2D-blocked BW est ({args.spmm_variant}, {args.threads}t)")
         if has_stream:
             plt.axhline(stream_bw, linestyle="--", label=f"STREAM triad ~ {stream_bw:.1f} GB/s")
         plt.xlabel("Size parameter (GEMM: m=k=n; SpMM: m=k)")
@@ -6,21 +6,40 @@ set -euo pipefail
 # ----------------------------
 RUNS="${RUNS:-3}"
 QUICK="${QUICK:-0}"
-PERF="${PERF:-0}"              # PERF=1 collects only supported counters (no cycles/instructions)
-PIN_MHZ="${PIN_MHZ:-2400}"     # used for cycles_est = seconds * PIN_MHZ*1e6
+PERF="${PERF:-1}"              # PERF=1 reads perf_event counters around the timed calls (empty where unsupported)
+PIN_MHZ="${PIN_MHZ:-2400}"     # cycles_est fallback (seconds * PIN_MHZ*1e6) when no cycles counter
 CPUSET="${CPUSET:-0-15}"       # pin process to these CPUs
+BIND="${BIND:-close}"          # per-thread pinning inside CPUSET: close | spread | none
+MATRICES="${MATRICES:-}"       # space-separated .mtx / binary CSR files for real-input SpMM runs
+WARMUP="${WARMUP:-1}"          # untimed calls before the timed reps
+CI_PCT="${CI_PCT:-0}"          # >0: add reps until the median's 95% CI is within +-CI_PCT %
+VERIFY="${VERIFY:-1}"          # 1: check every kernel against a double-precision reference before timing
+SWEEP="${SWEEP:-1}"            # 1: queue every config and run them in one --sweep process (inputs reused)
+OOC_DIR="${OOC_DIR:-results/ooc}"  # operand files for the out-of-core runs (kept; put on the disk under test)
 
 OUTDIR="results"
 OUTCSV="${OUTDIR}/results_a2.csv"
-PERF_TMP="${OUTDIR}/perf_tmp.csv"
+REPSCSV="${OUTDIR}/reps_a2.csv"  # one row per timed call
+SPEC="${OUTDIR}/sweep_a2.jsonl"  # SWEEP=1: one queued config per line
 
 CXX="${CXX:-g++}"
 CXXFLAGS="-O3 -march=native -std=c++17 -fopenmp"
 
 mkdir -p "${OUTDIR}"
 
-echo "[build] ${CXX} ${CXXFLAGS} a2_benchmark.cpp a2_kernels.cpp a2_utils.cpp -o a2_benchmark"
-${CXX} ${CXXFLAGS} a2_benchmark.cpp a2_kernels.cpp a2_utils.cpp -o a2_benchmark
+SRCS="a2_benchmark.cpp a2_kernels.cpp a2_utils.cpp a2_io.cpp a2_mixed.cpp a2_threads.cpp a2_verify.cpp a2_ooc.cpp"
+
+echo "[build] ${CXX} ${CXXFLAGS} ${SRCS} -o a2_benchmark"
+${CXX} ${CXXFLAGS} ${SRCS} -o a2_benchmark
+
+# No numbers from a build whose kernels disagree with the reference
+if [[ "${VERIFY}" == "1" ]]; then
+  echo "[verify] kernels vs double-precision reference"
+  if ! taskset -c "${CPUSET}" ./a2_benchmark --verify 1 --threads 4; then
+    echo "[verify] FAILED: kernel results differ from the reference (details above)" >&2
+    exit 1
+  fi
+fi
 
 # Header
 if [[ ! -f "${OUTCSV}" ]]; then
@@ -52,7 +71,7 @@ else
   THREADS=(1 2 4 8 12 16)
 fi
 
-# Helper: run one config, append one row (and only supported perf counters)
+# Helper: run one config, append one row
 run_one() {
   local kernel="$1"
   local variant="$2"
@@ -69,6 +88,7 @@ run_one() {
   local jblock="${13}"
   local seed="${14}"
   local runid="${15}"
+  local extra=("${@:16}")        # optional extra a2_benchmark flags
 
   local cmd=(./a2_benchmark
     --kernel "${kernel}"
@@ -83,41 +103,60 @@ run_one() {
     --seed "${seed}"
     --run "${runid}"
     --freq_mhz "${PIN_MHZ}"
+    --bind "${BIND}"
+    --warmup "${WARMUP}" --ci_pct "${CI_PCT}" --reps_csv "${REPSCSV}"
+    "${extra[@]}"
   )
 
-  if [[ "${PERF}" == "1" ]]; then
-    # Only counters that work in your environment
-    perf stat -x, -e task-clock,context-switches,cpu-migrations,page-faults \
-      -o "${PERF_TMP}" -- taskset -c "${CPUSET}" "${cmd[@]}" > "${OUTDIR}/row_tmp.txt" || true
-
-    # Extract perf values (first column)
-    local task_clock ctx mig pf
-    task_clock="$(awk -F, '/task-clock/ {gsub(/ /,"",$1); print $1; exit}' "${PERF_TMP}")"
-    ctx="$(awk -F, '/context-switches/ {gsub(/ /,"",$1); print $1; exit}' "${PERF_TMP}")"
-    mig="$(awk -F, '/cpu-migrations/ {gsub(/ /,"",$1); print $1; exit}' "${PERF_TMP}")"
-    pf="$(awk -F, '/page-faults/ {gsub(/ /,"",$1); print $1; exit}' "${PERF_TMP}")"
-    task_clock="${task_clock:-0}"
-    ctx="${ctx:-0}"
-    mig="${mig:-0}"
-    pf="${pf:-0}"
-
-    # Re-run once without perf to print row with correct perf columns populated
-    # (cheap relative to full sweep; avoids merging columns by hand)
-    taskset -c "${CPUSET}" "${cmd[@]}" \
-      --perf_task_clock_ms "${task_clock}" \
-      --perf_context_switches "${ctx}" \
-      --perf_cpu_migrations "${mig}" \
-      --perf_page_faults "${pf}" >> "${OUTCSV}"
-  else
-    taskset -c "${CPUSET}" "${cmd[@]}" >> "${OUTCSV}"
+  if [[ "${SWEEP}" == "1" ]]; then
+    # queue as a JSON run object, flag -> string value, for run_sweep below
+    local obj="" i v
+    for ((i = 1; i < ${#cmd[@]}; i += 2)); do
+      v="${cmd[i+1]//\\/\\\\}"
+      obj+="${obj:+, }\"${cmd[i]}\": \"${v//\"/\\\"}\""
+    done
+    echo "{${obj}, \"--counters\": \"${PERF}\"}" >> "${SPEC}"
+    return
   fi
+  taskset -c "${CPUSET}" "${cmd[@]}" --counters "${PERF}" >> "${OUTCSV}"
+}
+
+# SWEEP=1: one process runs the queued configs, so random inputs and CSRs are
+# built once per shape and rows stream into OUTCSV as each config finishes.
+run_sweep() {
+  [[ "${SWEEP}" == "1" && -s "${SPEC}" ]] || return 0
+  local json="${SPEC%.jsonl}.json"
+  { echo '{"runs": ['; paste -sd, "${SPEC}"; echo ']}'; } > "${json}"
+  echo "[run] $(wc -l < "${SPEC}") queued configs via --sweep ${json}"
+  taskset -c "${CPUSET}" ./a2_benchmark --sweep "${json}" >> "${OUTCSV}"
 }
+rm -f "${SPEC}"
 
 # ----------------------------
 # Always include STREAM once
 # ----------------------------
-echo "[run] stream bandwidth"
-run_one stream scalar 1 1 1 1.0 uniform row 1 0 0 0 0 123 0
+echo "[run] STREAM suite: copy/scale/add/triad, cache-level sweep, regular + NT stores"
+STREAM_T="${THREADS[${#THREADS[@]}-1]}"
+for nt in 0 1; do
+  run_one stream simd 1 1 1 1.0 uniform row "${STREAM_T}" 0 0 0 0 123 0 --stream_sweep 1 --stream_nt "${nt}"
+done
+# Per-node and cross-node bandwidth (threads on node c, memory on node m)
+NODES="$(ls -d /sys/devices/system/node/node[0-9]* 2>/dev/null | wc -l)"
+if (( NODES > 1 )); then
+  for ((c = 0; c < NODES; c++)); do
+    for ((mn = 0; mn < NODES; mn++)); do
+      run_one stream simd 1 1 1 1.0 uniform row "${STREAM_T}" 0 0 0 0 123 0 \
+        --numa_node "${c}" --mem_node "${mn}" --stream_nt 1
+    done
+  done
+fi
+
+# ----------------------------------------------
+# Roofline triage: measured peaks + % of roof
+# ----------------------------------------------
+echo "[run] roofline triage (simd, measured FMA peak + STREAM ceiling)"
+run_one gemm     simd 1536 1536 1536 1.0  uniform row "${STREAM_T}" 64 128 64 128 100 0 --roofline 1
+run_one spmm_csr simd 2048 2048 512  0.01 uniform row "${STREAM_T}" 64 128 64 128 200 0 --roofline 1
 
 # -----------------------------------------
 # Figure 1: GEMM scaling (scalar + simd)
@@ -138,6 +177,7 @@ for t in "${THREADS[@]}"; do
   for r in $(seq 1 "${RUNS}"); do
     run_one spmm_csr scalar 2048 2048 512 0.01 uniform row "${t}" 64 128 64 128 200 "$r"
     run_one spmm_csr simd   2048 2048 512 0.01 uniform row "${t}" 64 128 64 128 200 "$r"
+    run_one spmm_csr simd   2048 2048 512 0.01 uniform col "${t}" 64 128 64 128 200 "$r"
   done
 done
 
@@ -152,6 +192,94 @@ if [[ "${QUICK}" == "0" ]]; then
     for r in $(seq 1 "${RUNS}"); do
       run_one spmm_csr simd 2048 2048 512 "${d}" uniform row 8 64 128 64 128 300 "$r"
       run_one gemm     simd 2048 2048 512 1.0    uniform row 8 64 128 64 128 300 "$r"
+      run_one spmm_auto simd 2048 2048 512 "${d}" uniform row 8 64 128 64 128 300 "$r"
+    done
+  done
+
+  echo "[run] sparse format comparison on structured patterns (simd)"
+  for pat in band blockdiag uniform; do
+    for fmt in spmm_csr spmm_csc spmm_ell spmm_sell spmm_bsr; do
+      for r in $(seq 1 "${RUNS}"); do
+        run_one "${fmt}" simd 2048 2048 512 0.01 "${pat}" row 8 64 128 64 128 500 "$r"
+      done
+    done
+  done
+
+  echo "[run] storage precision sweep (simd)"
+  for dt in f32 bf16 f16 i8; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one gemm     simd 2048 2048 512 1.0  uniform row 8 64 128 64 128 700 "$r" --dtype "${dt}"
+      run_one spmm_csr simd 2048 2048 512 0.01 uniform row 8 64 128 64 128 700 "$r" --dtype "${dt}"
+    done
+  done
+
+  echo "[run] batched small GEMM (simd)"
+  for d in 16 32 64 128; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one gemm_batched simd "${d}" "${d}" "${d}" 1.0 uniform row 8 0 0 0 0 800 "$r" --batch 2000
+    done
+  done
+  for r in $(seq 1 "${RUNS}"); do
+    run_one gemm_batched simd 0 0 0 1.0 uniform row 8 0 0 0 0 800 "$r" --batch 2000 --batch_mix 1
+  done
+
+  echo "[run] fused epilogues (simd)"
+  for epi in "--act none" "--bias col --act relu" "--bias row --act gelu" "--alpha 0.5 --beta 1"; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one gemm      simd 2048 2048 512 1.0  uniform row 8 64 128 64 128 900 "$r" ${epi}
+      run_one spmm_csr  simd 2048 2048 512 0.01 uniform row 8 64 128 64 128 900 "$r" ${epi}
+      run_one spmm_sell simd 2048 2048 512 0.01 uniform row 8 64 128 64 128 900 "$r" ${epi}
+    done
+  done
+
+  echo "[run] reordering for B locality (simd)"
+  for pat in uniform band; do
+    for ro in none rcm degree; do
+      for r in $(seq 1 "${RUNS}"); do
+        run_one spmm_csr simd 100000 100000 64 0.0001 "${pat}" row 8 64 128 64 128 1200 "$r" --reorder "${ro}"
+      done
+    done
+  done
+
+  echo "[run] page size: 4K vs THP vs 2M hugetlb (simd; watch dtlb_load_misses)"
+  for pg in 4k thp 2m; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one gemm     simd 2048 2048 2048 1.0  uniform row 8 64 128 64 128 1400 "$r" --pages "${pg}"
+      run_one spmm_csr simd 8192 8192 512  0.001 uniform row 8 64 128 64 128 1400 "$r" --pages "${pg}"
+    done
+  done
+
+  echo "[run] SpMV (iterative y = A x)"
+  for d in 0.0001 0.001 0.01; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one spmv scalar 50000 50000 1 "${d}" uniform row 8 0 0 0 0 1100 "$r" --iters 100
+      run_one spmv simd   50000 50000 1 "${d}" uniform row 8 0 0 0 0 1100 "$r" --iters 100
+    done
+  done
+
+  echo "[run] SpGEMM A^2 (auto/hash/dense accumulators)"
+  for acc in auto hash dense; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one spgemm simd 20000 20000 20000 0.0005 uniform row 8 0 0 0 0 1000 "$r" --accum "${acc}"
+      run_one spgemm simd 20000 20000 20000 0.0005 band    row 8 0 0 0 0 1000 "$r" --accum "${acc}"
+    done
+  done
+
+  echo "[run] Strassen-Winograd cutoff sweep (simd leaves)"
+  for cut in 256 512 1024; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one gemm strassen 3072 3072 3072 1.0 uniform row 8 64 128 64 128 1300 "$r" --strassen_cutoff "${cut}"
+    done
+  done
+
+  # op(A) op(B) through tile packing vs. the plain nn kernel; ld_pad makes
+  # every operand a strided sub-block of a wider matrix
+  echo "[run] transposed / strided-view GEMM (simd)"
+  for tr in nn tn nt tt; do
+    for pad in 0 64; do
+      for r in $(seq 1 "${RUNS}"); do
+        run_one gemm simd 2048 2048 2048 1.0 uniform row 8 64 128 64 128 1500 "$r" --trans "${tr}" --ld_pad "${pad}"
+      done
     done
   done
 
@@ -160,11 +288,53 @@ if [[ "${QUICK}" == "0" ]]; then
   for s in "${SIZES[@]}"; do
     for r in $(seq 1 "${RUNS}"); do
       run_one gemm     simd "${s}" "${s}" "${s}" 1.0  uniform row 8 64 128 64 128 400 "$r"
+      run_one gemm     recursive "${s}" "${s}" "${s}" 1.0 uniform row 8 64 128 64 128 400 "$r"
+      run_one gemm     morton    "${s}" "${s}" "${s}" 1.0 uniform row 8 64 128 64 128 400 "$r"
+      run_one gemm     strassen  "${s}" "${s}" "${s}" 1.0 uniform row 8 64 128 64 128 400 "$r"
       run_one spmm_csr simd "${s}" "${s}" 256    0.01 uniform row 8 64 128 64 128 400 "$r"
+      run_one spmm_csr simd "${s}" "${s}" 256    0.01 uniform row 8 64 128 64 128 400 "$r" --panel_k -1
+    done
+  done
+  # B = 256 columns x s rows runs past the LLC here; the 2D-blocked kernel
+  # (panel_k sized from L2) should stay flat where the 1D one drops off.
+  for s in 4096 8192 16384; do
+    for r in $(seq 1 "${RUNS}"); do
+      run_one spmm_csr simd "${s}" "${s}" 256    0.01 uniform row 8 64 128 64 128 400 "$r"
+      run_one spmm_csr simd "${s}" "${s}" 256    0.01 uniform row 8 64 128 64 128 400 "$r" --panel_k -1
+    done
+  done
+
+  # Operands stay in files (GEMM A/B 144 MiB each, SpMM B 400 MiB) and only
+  # --ooc_mib of tiles is resident; overlap_pct is the share of I/O time
+  # hidden behind compute. Page cache is dropped before every call.
+  echo "[run] out-of-core GEMM / SpMM (simd, pread vs mmap)"
+  mkdir -p "${OOC_DIR}"
+  for io in pread mmap; do
+    for mib in 32 128; do
+      for r in $(seq 1 "${RUNS}"); do
+        run_one gemm_ooc simd 6144 6144 6144 1.0 uniform row 8 64 128 64 128 1600 "$r" \
+          --ooc_dir "${OOC_DIR}" --ooc_mib "${mib}" --ooc_io "${io}"
+        run_one spmm_ooc simd 100000 100000 1024 0.0001 uniform row 8 64 128 64 128 1600 "$r" \
+          --ooc_dir "${OOC_DIR}" --ooc_mib "${mib}" --ooc_io "${io}"
+      done
     done
   done
 fi
 
+# ------------------------------------------------
+# Real-world matrices (MATRICES="a.mtx b.a2csr")
+# ------------------------------------------------
+for mtx in ${MATRICES}; do
+  echo "[run] CSR-SpMM on ${mtx}"
+  for r in $(seq 1 "${RUNS}"); do
+    run_one spmm_csr simd 0 0 512 0 file row 8 64 128 64 128 600 "$r" --matrix "${mtx}"
+    run_one spgemm   simd 0 0 0   0 file row 8 0 0 0 0 600 "$r" --matrix "${mtx}"
+    run_one spmv     simd 0 0 1   0 file row 8 0 0 0 0 600 "$r" --matrix "${mtx}" --iters 100
+  done
+done
+
+run_sweep
+
 echo "[run] done -> ${OUTCSV}"
 echo "[plot] python3 plot_a2.py --csv ${OUTCSV} --outdir ${OUTDIR}"
 